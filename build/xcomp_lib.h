@@ -23,7 +23,8 @@
 // -------
 typedef enum CompressionAlgorithm {
 	ZSTD,
-	ZLIB
+	ZLIB,
+	GZIP
 } CompressionAlgorithm;
 
 /* -------------------------------------------------------------------------------------------------------- */
@@ -33,19 +34,28 @@ typedef enum CompressionAlgorithm {
 /// NOTE: the stream will be always deallocated both in case of failure and success.
 /// 	  Furthermore, the function allocates the returned stream of bytes, so that
 /// 	  once it's on the hand of the caller, it's responsible to manage that memory.
-unsigned char* deflate(unsigned char* stream, unsigned int size, unsigned int* compressed_len, CompressionAlgorithm compression_algorithm, int* err);
+/// 	  The level goes from 0 (fastest) to 10 (smallest, ultra), and it's ignored by ZSTD for now.
+unsigned char* deflate(unsigned char* stream, unsigned int size, unsigned char level, unsigned int* compressed_len, CompressionAlgorithm compression_algorithm, int* err);
 
 /// NOTE: the stream will be always deallocated both in case of failure and success.
 /// 	  Furthermore, the function allocates the returned stream of bytes, so that
 /// 	  once it's on the hand of the caller, it's responsible to manage that memory.
 unsigned char* inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_len, CompressionAlgorithm compression_algorithm, int* err);
 
+/// NOTE: the stream is only read, and it's never deallocated, while the data is
+/// 	  decompressed straight into the caller's buffer of out_size bytes.
+/// 	  Returns the length of the decompressed data, or a negative error code,
+/// 	  which is the need more output one of each algorithm when the buffer is too small.
+int inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size, CompressionAlgorithm compression_algorithm);
+
 /* -------------------------------------------------------------------------------------------------------- */
-unsigned char* deflate(unsigned char* stream, unsigned int size, unsigned int* compressed_len, CompressionAlgorithm compression_algorithm, int* err) {
+unsigned char* deflate(unsigned char* stream, unsigned int size, unsigned char level, unsigned int* compressed_len, CompressionAlgorithm compression_algorithm, int* err) {
 	if (compression_algorithm == ZLIB) {
-		return zlib_deflate(stream, size, compressed_len, err);	
-	} else if (compression_algorithm == ZLIB) {
+		return zlib_deflate(stream, size, level, compressed_len, err);	
+	} else if (compression_algorithm == ZSTD) {
 		return zstd_deflate(stream, size, compressed_len, err);	
+	} else if (compression_algorithm == GZIP) {
+		return gzip_deflate(stream, size, level, compressed_len, err);
 	}
 
 	*err = UNKNOWN_COMPRESSION_ALGORITHM;
@@ -57,8 +67,10 @@ unsigned char* deflate(unsigned char* stream, unsigned int size, unsigned int* c
 unsigned char* inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_len, CompressionAlgorithm compression_algorithm, int* err) {
 	if (compression_algorithm == ZLIB) {
 		return zlib_inflate(stream, size, decompressed_len, err);
-	} else if (compression_algorithm == ZLIB) {
-		return zlib_inflate(stream, size, decompressed_len, err);
+	} else if (compression_algorithm == ZSTD) {
+		return zstd_inflate(stream, size, decompressed_len, err);
+	} else if (compression_algorithm == GZIP) {
+		return gzip_inflate(stream, size, decompressed_len, err);
 	}
 	
 	*err = UNKNOWN_COMPRESSION_ALGORITHM;
@@ -67,7 +79,19 @@ unsigned char* inflate(unsigned char* stream, unsigned int size, unsigned int* d
 	return NULL;
 }
 
+int inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size, CompressionAlgorithm compression_algorithm) {
+	if (compression_algorithm == ZLIB) {
+		return zlib_inflate_into(stream, size, out, out_size);
+	} else if (compression_algorithm == ZSTD) {
+		return zstd_inflate_into(stream, size, out, out_size);
+	} else if (compression_algorithm == GZIP) {
+		return gzip_inflate_into(stream, size, out, out_size);
+	}
+	
+	printf("XCOMP_LIB::ERROR: Unknown compression algorithm.");
 
+	return -UNKNOWN_COMPRESSION_ALGORITHM;
+}
 
 #endif //_XCOMP_LIB_H_
 
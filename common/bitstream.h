@@ -23,9 +23,10 @@
 // -------------------
 #define IS_EOS(bit_stream) ((bit_stream) -> byte_pos == (bit_stream) -> size)
 #define IS_REVERSED_EOS(bit_stream) ((bit_stream) -> byte_pos == 0 && (bit_stream) -> bit_pos == 0)
-#define REWIND_BIT_STREAM(bit_stream) ((bit_stream) -> byte_pos = 0, (bit_stream) -> bit_pos = 0, (bit_stream) -> error = 0)
-#define CREATE_BIT_STREAM(data_stream, data_size) (BitStream) { .stream = data_stream, .size = data_size, .byte_pos = 0, .bit_pos = 0, .bit_lower_limit = 0, .error = 0 }
-#define CREATE_REVERSED_BIT_STREAM(data_stream, data_size, data_lower_limit) (BitStream) { .stream = data_stream, .size = data_size, .byte_pos = data_size - 1, .bit_pos = 8, .bit_lower_limit = data_lower_limit, .error = 0 }
+#define REWIND_BIT_STREAM(bit_stream) ((bit_stream) -> byte_pos = 0, (bit_stream) -> bit_pos = 0, (bit_stream) -> error = 0, (bit_stream) -> bit_buffer_len = 0)
+#define CREATE_BIT_STREAM(data_stream, data_size) (BitStream) { .stream = data_stream, .size = data_size, .byte_pos = 0, .bit_pos = 0, .bit_lower_limit = 0, .error = 0, .bit_buffer = 0, .bit_buffer_len = 0, .capacity = data_size, .fixed_capacity = FALSE }
+#define CREATE_FIXED_BIT_STREAM(data_stream, data_capacity) (BitStream) { .stream = data_stream, .size = 0, .byte_pos = 0, .bit_pos = 0, .bit_lower_limit = 0, .error = 0, .bit_buffer = 0, .bit_buffer_len = 0, .capacity = data_capacity, .fixed_capacity = TRUE }
+#define CREATE_REVERSED_BIT_STREAM(data_stream, data_size, data_lower_limit) (BitStream) { .stream = data_stream, .size = data_size, .byte_pos = data_size - 1, .bit_pos = 8, .bit_lower_limit = data_lower_limit, .error = 0, .bit_buffer = 0, .bit_buffer_len = 0, .capacity = data_size, .fixed_capacity = FALSE }
 #define CREATE_EMPTY_BIT_STREAM() CREATE_BIT_STREAM(NULL, 0)
 #define PRINT_BIT_STREAM_INFO(bit_stream) DEBUG_LOG("%s: byte_pos: %u, bit_pos: %d, size: %u, error: %u, current_byte: 0x%X.", #bit_stream, (bit_stream) -> byte_pos, (bit_stream) -> bit_pos, (bit_stream) -> size, (bit_stream) -> error, ((bit_stream) -> stream)[(bit_stream) -> byte_pos % (bit_stream) -> byte_pos])
 
@@ -123,6 +124,13 @@ typedef enum {
    	BITSTREAM_IO_ERROR = 1
 } BitStreamError;
 
+/// The bit_buffer caches the next bit_buffer_len bits starting from the
+/// current position (byte_pos, bit_pos), so that multi-bit reads only touch
+/// the stream once per refill. The position is always kept up to date, so
+/// any function moving it directly must drop the cached bits.
+/// When writing, bit_buffer holds instead the bit_pos pending bits of the
+/// current byte, while capacity is the allocated size of the stream, that can
+/// only grow if the stream wasn't created with a fixed capacity.
 typedef struct PACKED_STRUCT BitStream {
 	unsigned char* stream;
 	unsigned int size;
@@ -130,6 +138,10 @@ typedef struct PACKED_STRUCT BitStream {
 	unsigned int byte_pos;
 	char bit_pos;
 	unsigned char error;
+	unsigned long long int bit_buffer;
+	unsigned char bit_buffer_len;
+	unsigned int capacity;
+	unsigned char fixed_capacity;
 } BitStream;
 
 /* ---------------------------------------------------------------------------------------------------------- */
@@ -137,17 +149,24 @@ typedef struct PACKED_STRUCT BitStream {
 //  Functions Declarations
 // ------------------------
 static void* bitstream_read_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb);
-static unsigned char bitstream_read_next_bit(BitStream* bit_stream);
+static inline void bitstream_refill(BitStream* bit_stream);
+static inline unsigned long long int bitstream_peek_bits(BitStream* bit_stream, unsigned char n_bits);
+static inline void bitstream_consume_bits(BitStream* bit_stream, unsigned char n_bits);
+UNUSED_FUNCTION static unsigned char bitstream_read_next_bit(BitStream* bit_stream);
 static unsigned long long int bitstream_read_bits(BitStream* bit_stream, unsigned char n_bits);
-static void* reversed_bitstream_read_bytes(BitStream* reversed_bit_stream, unsigned int size, unsigned int nmemb);
-static unsigned char reversed_bitstream_read_next_bit(BitStream* reversed_bit_stream);
-UNUSED_FUNCTION static unsigned long long int reversed_bitstream_read_bits(BitStream* reversed_bit_stream, unsigned char n_bits);
+UNUSED_FUNCTION static void* reversed_bitstream_read_bytes(BitStream* reversed_bit_stream, unsigned int size, unsigned int nmemb);
+static inline void reversed_bitstream_refill(BitStream* reversed_bit_stream);
+UNUSED_FUNCTION static unsigned char reversed_bitstream_read_next_bit(BitStream* reversed_bit_stream);
+static inline unsigned long long int reversed_bitstream_read_bits(BitStream* reversed_bit_stream, unsigned char n_bits);
 UNUSED_FUNCTION static void bitstream_unread_bit(BitStream* bit_stream);
 UNUSED_FUNCTION static void skip_to_next_byte(BitStream* bit_stream);
-static void resize_bit_stream(BitStream* bit_stream);
-static void bitstream_write_next_bit(BitStream* bit_stream, unsigned char bit);
+static void resize_bit_stream(BitStream* bit_stream, unsigned int min_capacity);
+UNUSED_FUNCTION static void bitstream_write_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb, const void* src);
+static inline unsigned long long int bitstream_reverse_bits(unsigned long long int bits, unsigned char n_bits);
+UNUSED_FUNCTION static void bitstream_write_next_bit(BitStream* bit_stream, unsigned char bit);
 UNUSED_FUNCTION static void bitstream_write_bits_reversed(BitStream* bit_stream, unsigned long long int bits, unsigned char n_bits);
 UNUSED_FUNCTION static void bitstream_write_bits(BitStream* bit_stream, unsigned long long int bits, unsigned char n_bits);
+UNUSED_FUNCTION static void bitstream_truncate(BitStream* bit_stream, unsigned int byte_pos, unsigned char bit_pos);
 UNUSED_FUNCTION static void deallocate_bit_stream(BitStream* bit_stream);
 
 /* ---------------------------------------------------------------------------------------------------------- */
@@ -165,6 +184,7 @@ static void* bitstream_read_bytes(BitStream* bit_stream, unsigned int size, unsi
 		(bit_stream -> byte_pos)++;
 	}
 
+	bit_stream -> bit_buffer_len = 0;
 	if (bit_stream -> byte_pos + tot_size > bit_stream -> size) {
 		bit_stream -> error = 1;
 		WARNING_LOG("Bitstream gen error bytes, size: %u, nmemb: %u.", size, nmemb); 
@@ -178,25 +198,52 @@ static void* bitstream_read_bytes(BitStream* bit_stream, unsigned int size, unsi
 	return bit_stream -> stream + old_pos;
 }
 
-static unsigned char bitstream_read_next_bit(BitStream* bit_stream) {
-    if (bit_stream -> error) {
-		WARNING_LOG("Bitstream error bits."); 
-		return 0;
-	}
-	
-	if (bit_stream -> byte_pos >= bit_stream -> size) {
-		bit_stream -> error = 1;
-		WARNING_LOG("Gen bit error");
-		PRINT_BIT_STREAM_INFO(bit_stream);
-		return 0;
+/// Load the next 64 bits (or whatever is left) starting from byte_pos into the
+/// bit_buffer, discarding the bit_pos bits of the current byte already consumed.
+static inline void bitstream_refill(BitStream* bit_stream) {
+	const unsigned int remaining = (bit_stream -> byte_pos < bit_stream -> size) ? bit_stream -> size - bit_stream -> byte_pos : 0;
+	unsigned long long int word = 0;
+	if (remaining >= sizeof(unsigned long long int)) {
+		word = xcomp_read_le64(bit_stream -> stream + bit_stream -> byte_pos);
+		bit_stream -> bit_buffer_len = 64 - bit_stream -> bit_pos;
+	} else {
+		for (unsigned int i = 0; i < remaining; ++i) word |= ((unsigned long long int) (bit_stream -> stream)[bit_stream -> byte_pos + i]) << (i * 8);
+		bit_stream -> bit_buffer_len = remaining ? remaining * 8 - bit_stream -> bit_pos : 0;
 	}
+	bit_stream -> bit_buffer = word >> bit_stream -> bit_pos;
+	return;
+}
 
-	unsigned char bit_value = (bit_stream -> stream[bit_stream -> byte_pos] >> bit_stream -> bit_pos) & 1;
-	(bit_stream -> bit_pos)++;
+/// Return the next n_bits (at most 56) without moving the position, bits past
+/// the end of the stream are returned as zeros, the error is only raised once
+/// they get consumed.
+static inline unsigned long long int bitstream_peek_bits(BitStream* bit_stream, unsigned char n_bits) {
+	if (bit_stream -> bit_buffer_len < n_bits) bitstream_refill(bit_stream);
+	return bit_stream -> bit_buffer & XCOMP_MASK_BITS_PRECEDING(n_bits);
+}
 
-	if (bit_stream -> bit_pos > 7) bitstream_read_bytes(bit_stream, sizeof(unsigned char), 1);
+static inline void bitstream_consume_bits(BitStream* bit_stream, unsigned char n_bits) {
+	if (bit_stream -> bit_buffer_len < n_bits) {
+		bitstream_refill(bit_stream);
+		if (bit_stream -> bit_buffer_len < n_bits) {
+			bit_stream -> error = 1;
+			WARNING_LOG("Gen bit error");
+			PRINT_BIT_STREAM_INFO(bit_stream);
+			return;
+		}
+	}
+	
+	bit_stream -> bit_buffer >>= n_bits;
+	bit_stream -> bit_buffer_len -= n_bits;
+	bit_stream -> bit_pos += n_bits;
+	bit_stream -> byte_pos += bit_stream -> bit_pos >> 3;
+	bit_stream -> bit_pos &= 7;
+	
+	return;
+}
 
-    return bit_value;
+UNUSED_FUNCTION static unsigned char bitstream_read_next_bit(BitStream* bit_stream) {
+	return bitstream_read_bits(bit_stream, 1);
 }
 
 static unsigned long long int bitstream_read_bits(BitStream* bit_stream, unsigned char n_bits) {
@@ -204,21 +251,28 @@ static unsigned long long int bitstream_read_bits(BitStream* bit_stream, unsigne
 		bit_stream -> error = 1;
 		WARNING_LOG("Tried to read more than %lu bits: %u", sizeof(unsigned long long int) * 8, n_bits);
 		return 0;
+	} else if (bit_stream -> error) {
+		WARNING_LOG("Bitstream error n_bits."); 
+		return 0;
 	}
 
-	unsigned long long int bits = 0;
-    for (unsigned char i = 0; i < n_bits; ++i) {
-        bits += bitstream_read_next_bit(bit_stream) << i;
-		if (bit_stream -> error) {
-			WARNING_LOG("Bitstream error n_bits."); 
-			return 0;
-		}
-    }
+	// After the refill at least 57 bits are available, so split the larger reads
+	if (n_bits > 56) {
+		const unsigned long long int low_bits = bitstream_read_bits(bit_stream, 32);
+		return low_bits | (bitstream_read_bits(bit_stream, n_bits - 32) << 32);
+	}
+
+	const unsigned long long int bits = bitstream_peek_bits(bit_stream, n_bits);
+	bitstream_consume_bits(bit_stream, n_bits);
+	if (bit_stream -> error) {
+		WARNING_LOG("Bitstream error n_bits."); 
+		return 0;
+	}
 
     return bits;
 }
 
-static void* reversed_bitstream_read_bytes(BitStream* reversed_bit_stream, unsigned int size, unsigned int nmemb) {
+UNUSED_FUNCTION static void* reversed_bitstream_read_bytes(BitStream* reversed_bit_stream, unsigned int size, unsigned int nmemb) {
 	if (reversed_bit_stream -> error) {
 		WARNING_LOG("Reversed Bitstream error bytes."); 
 		return NULL;
@@ -238,47 +292,72 @@ static void* reversed_bitstream_read_bytes(BitStream* reversed_bit_stream, unsig
 	}
 
 	reversed_bit_stream -> bit_pos = 8;
+	reversed_bit_stream -> bit_buffer_len = 0;
 	unsigned int old_pos = reversed_bit_stream -> byte_pos;
 	reversed_bit_stream -> byte_pos -= tot_size; 
 
 	return reversed_bit_stream -> stream + old_pos;
 }
 
-static unsigned char reversed_bitstream_read_next_bit(BitStream* reversed_bit_stream) {
-	if (reversed_bit_stream -> error) {
-		WARNING_LOG("Reversed Bitstream error bits."); 
-		return 0;
+/// In the reversed stream the bit_buffer holds the bits preceding the current
+/// position (byte_pos * 8 + bit_pos) aligned to its most significant bit, so
+/// that a read is a single shift. Near the start of the stream the buffer is
+/// zero filled, up to the bits allowed by the bit_lower_limit.
+static inline void reversed_bitstream_refill(BitStream* reversed_bit_stream) {
+	const long long int remaining_bits = (long long int) reversed_bit_stream -> byte_pos * 8 + reversed_bit_stream -> bit_pos;
+	const long long int end_byte = (remaining_bits > 0) ? (remaining_bits + 7) >> 3 : 0;
+	const unsigned char consumed_bits = end_byte * 8 - MAX(remaining_bits, 0);
+	
+	unsigned long long int word = 0;
+	if (end_byte >= (long long int) sizeof(unsigned long long int)) {
+		reversed_bit_stream -> bit_buffer = xcomp_read_le64(reversed_bit_stream -> stream + end_byte - sizeof(unsigned long long int)) << consumed_bits;
+		reversed_bit_stream -> bit_buffer_len = 64 - consumed_bits;
+		return;
 	}
 	
-	if (reversed_bit_stream -> byte_pos == 0 && (reversed_bit_stream -> bit_pos <= 0 && reversed_bit_stream -> bit_pos >= reversed_bit_stream -> bit_lower_limit)) {
-		(reversed_bit_stream -> bit_pos)--;
-		return 0;
-	} else if (reversed_bit_stream -> byte_pos == 0 && reversed_bit_stream -> bit_pos < reversed_bit_stream -> bit_lower_limit) {
-		reversed_bit_stream -> error = 1;
-		WARNING_LOG("Reversed Gen bit error");
-		PRINT_BIT_STREAM_INFO(reversed_bit_stream);
-		return 0;
-	} 
+	for (long long int i = 0; i < end_byte; ++i) word |= ((unsigned long long int) (reversed_bit_stream -> stream)[i]) << (64 - 8 * (end_byte - i));
+	const long long int available_bits = remaining_bits - reversed_bit_stream -> bit_lower_limit + 1;
+	reversed_bit_stream -> bit_buffer = word << consumed_bits;
+	reversed_bit_stream -> bit_buffer_len = (available_bits > 0) ? MIN(available_bits, 64 - consumed_bits) : 0;
 
-	if (reversed_bit_stream -> bit_pos == 0) reversed_bitstream_read_bytes(reversed_bit_stream, sizeof(unsigned char), 1);
-	
-    unsigned char bit_value = (reversed_bit_stream -> stream[reversed_bit_stream -> byte_pos] >> (reversed_bit_stream -> bit_pos - 1)) & 1;
-    (reversed_bit_stream -> bit_pos)--;
-	
-	return bit_value;
+	return;
 }
 
-UNUSED_FUNCTION static unsigned long long int reversed_bitstream_read_bits(BitStream* reversed_bit_stream, unsigned char n_bits) {
+UNUSED_FUNCTION static unsigned char reversed_bitstream_read_next_bit(BitStream* reversed_bit_stream) {
+	return reversed_bitstream_read_bits(reversed_bit_stream, 1);
+}
+
+static inline unsigned long long int reversed_bitstream_read_bits(BitStream* reversed_bit_stream, unsigned char n_bits) {
 	if (n_bits > sizeof(unsigned long long int) * 8) {
 		reversed_bit_stream -> error = 1;
 		WARNING_LOG("Tried to read more than %lu bits: %u", sizeof(unsigned long long int) * 8, n_bits);
 		return 0;
+	} else if (reversed_bit_stream -> error || n_bits == 0) return 0;
+	
+	// The bits are read from the most significant, so the high part comes first
+	if (n_bits > 56) {
+		const unsigned long long int high_bits = reversed_bitstream_read_bits(reversed_bit_stream, n_bits - 32);
+		return (high_bits << 32) | reversed_bitstream_read_bits(reversed_bit_stream, 32);
 	}
 
-	unsigned long long int bits = 0;
-    for (unsigned char i = 0; i < n_bits; ++i) {
-        bits += reversed_bitstream_read_next_bit(reversed_bit_stream) << (n_bits - i - 1);
-    }
+	if (reversed_bit_stream -> bit_buffer_len < n_bits) {
+		reversed_bitstream_refill(reversed_bit_stream);
+		if (reversed_bit_stream -> bit_buffer_len < n_bits) {
+			reversed_bit_stream -> error = 1;
+			WARNING_LOG("Reversed Gen bit error");
+			PRINT_BIT_STREAM_INFO(reversed_bit_stream);
+			return 0;
+		}
+	}
+
+	const unsigned long long int bits = reversed_bit_stream -> bit_buffer >> (64 - n_bits);
+	reversed_bit_stream -> bit_buffer <<= n_bits;
+	reversed_bit_stream -> bit_buffer_len -= n_bits;
+
+	// Once past the start of the stream, byte_pos stays at 0 and bit_pos goes negative
+	const int remaining_bits = (int) (reversed_bit_stream -> byte_pos * 8) + reversed_bit_stream -> bit_pos - n_bits;
+	reversed_bit_stream -> byte_pos = (remaining_bits > 0) ? (unsigned int) remaining_bits >> 3 : 0;
+	reversed_bit_stream -> bit_pos  = (remaining_bits > 0) ? remaining_bits & 7 : remaining_bits;
 
     return bits;
 }
@@ -289,6 +368,7 @@ UNUSED_FUNCTION static void bitstream_unread_bit(BitStream* bit_stream) {
 		return;
 	}
 
+	bit_stream -> bit_buffer_len = 0;
 	if (bit_stream -> bit_pos) {
 	   	(bit_stream -> bit_pos)--;
 		return;
@@ -316,48 +396,76 @@ UNUSED_FUNCTION static void skip_to_next_byte(BitStream* bit_stream) {
 		return;
 	}
 
+	bit_stream -> bit_buffer_len = 0;
 	bit_stream -> bit_pos = 0;
 	(bit_stream -> byte_pos)++;
 
 	return;
 }
 
-static void resize_bit_stream(BitStream* bit_stream) {
+/// Grow the stream geometrically so that it can hold at least min_capacity bytes.
+static void resize_bit_stream(BitStream* bit_stream, unsigned int min_capacity) {
 	if (bit_stream -> error) {
 		WARNING_LOG("BitStream error resize stream.");
 		return;
+	} else if (bit_stream -> fixed_capacity) {
+		bit_stream -> error = 1;
+		WARNING_LOG("Not enough capacity in the stream: %u, required: %u.", bit_stream -> capacity, min_capacity);
+		return;
 	}
 
-	bit_stream -> stream = realloc(bit_stream -> stream, bit_stream -> size * sizeof(unsigned char));
+	const unsigned int old_capacity = bit_stream -> capacity;
+	bit_stream -> capacity = MAX(MAX(old_capacity * 2, min_capacity), 64U);
+	bit_stream -> stream = xcomp_realloc(bit_stream -> stream, bit_stream -> capacity * sizeof(unsigned char));
 	if (bit_stream -> stream == NULL) {
-		WARNING_LOG("Failed to reallocate the stream to %u.", bit_stream -> size);
+		WARNING_LOG("Failed to reallocate the stream to %u.", bit_stream -> capacity);
 		bit_stream -> error = 1;
 		return;
 	}
 	
-	mem_set(bit_stream -> stream + bit_stream -> byte_pos, 0, bit_stream -> size - bit_stream -> byte_pos);
+	mem_set(bit_stream -> stream + old_capacity, 0, bit_stream -> capacity - old_capacity);
 
 	return;
 }
 
+/// Append all the bits written in src_bit_stream, a plain copy if the
+/// destination is byte-aligned, otherwise 56 bits at a time shifted into the
+/// write accumulator.
 UNUSED_FUNCTION static void bitstream_bit_copy(BitStream* dest_bit_stream, BitStream* src_bit_stream) {
 	if (dest_bit_stream -> error || src_bit_stream -> error) {
 		WARNING_LOG("BitStream error bit copy.");
 		return;
 	}
 
-	unsigned long long int bits_cnt = src_bit_stream -> byte_pos * 8 + src_bit_stream -> bit_pos;
-	for (unsigned long long int i = 0; i < bits_cnt; ++i) {
-		bitstream_write_next_bit(dest_bit_stream, (src_bit_stream -> stream)[(i - (i % 8)) / 8] >> (i % 8));
-		if (dest_bit_stream -> error) {
-			WARNING_LOG("BitStream gen error bit copy.");
-			return;
+	const unsigned int full_bytes = src_bit_stream -> byte_pos;
+	const unsigned char tail_bits = src_bit_stream -> bit_pos;
+	if (dest_bit_stream -> bit_pos == 0) bitstream_write_bytes(dest_bit_stream, sizeof(unsigned char), full_bytes, src_bit_stream -> stream);
+	else {
+		if (dest_bit_stream -> byte_pos + full_bytes + sizeof(unsigned long long int) > dest_bit_stream -> capacity && !(dest_bit_stream -> fixed_capacity)) {
+			resize_bit_stream(dest_bit_stream, dest_bit_stream -> byte_pos + full_bytes + sizeof(unsigned long long int));
 		}
+
+		unsigned int i = 0;
+		for (; i + sizeof(unsigned long long int) <= full_bytes; i += 7) bitstream_write_bits(dest_bit_stream, xcomp_read_le64(src_bit_stream -> stream + i), 56);
+		for (; i < full_bytes; ++i) bitstream_write_bits(dest_bit_stream, (src_bit_stream -> stream)[i], 8);
 	}
+	
+	if (tail_bits) bitstream_write_bits(dest_bit_stream, (src_bit_stream -> stream)[full_bytes], tail_bits);
+	if (dest_bit_stream -> error) WARNING_LOG("BitStream gen error bit copy.");
 
 	return;
 }
 
+/// Drop everything written after the given position, so that it can be overwritten.
+UNUSED_FUNCTION static void bitstream_truncate(BitStream* bit_stream, unsigned int byte_pos, unsigned char bit_pos) {
+	if (bit_stream -> error || byte_pos + (bit_pos > 0) > bit_stream -> size) return;
+	bit_stream -> byte_pos = byte_pos;
+	bit_stream -> bit_pos = bit_pos;
+	bit_stream -> bit_buffer = bit_pos ? (bit_stream -> stream)[byte_pos] & XCOMP_MASK_BITS_PRECEDING(bit_pos) : 0;
+	bit_stream -> size = byte_pos + (bit_pos > 0);
+	return;
+}
+
 UNUSED_FUNCTION static void bitstream_write_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb, const void* src) {
 	if (bit_stream -> error) {
 		WARNING_LOG("BitStream error write next bit.");
@@ -366,50 +474,37 @@ UNUSED_FUNCTION static void bitstream_write_bytes(BitStream* bit_stream, unsigne
 	
 	if (bit_stream -> bit_pos != 0) {
 		bit_stream -> bit_pos = 0;
+		bit_stream -> bit_buffer = 0;
 		(bit_stream -> byte_pos)++;
 	}
 
-	// Update the size of the bitstream
-	unsigned int original_byte_pos = bit_stream -> byte_pos;
-	bit_stream -> byte_pos += size * nmemb;
-	
-	if (bit_stream -> byte_pos >= bit_stream -> size) {
-		bit_stream -> size = bit_stream -> byte_pos;
-		resize_bit_stream(bit_stream);
+	const unsigned int tot_size = size * nmemb;
+	if (bit_stream -> byte_pos + tot_size > bit_stream -> capacity) {
+		resize_bit_stream(bit_stream, bit_stream -> byte_pos + tot_size);
 		if (bit_stream -> error) {
 			WARNING_LOG("Failed to resize the stream.");
 			return;
 		}
 	}
 
-	mem_cpy(bit_stream -> stream + original_byte_pos, src, size * nmemb);
+	mem_cpy(bit_stream -> stream + bit_stream -> byte_pos, src, tot_size);
+	bit_stream -> byte_pos += tot_size;
+	bit_stream -> size = MAX(bit_stream -> size, bit_stream -> byte_pos);
 
 	return;
 }
 
-static void bitstream_write_next_bit(BitStream* bit_stream, unsigned char bit) {
-	if (bit_stream -> error) {
-		WARNING_LOG("BitStream error write next bit.");
-		return;
-	}
-	
-	if (bit_stream -> bit_pos == 8) {
-		bit_stream -> bit_pos = 0;
-		(bit_stream -> byte_pos)++;
-	}
-	
-	if (bit_stream -> byte_pos >= bit_stream -> size) {
-		bit_stream -> size = bit_stream -> byte_pos + 1;
-		resize_bit_stream(bit_stream);
-		if (bit_stream -> error) {
-			WARNING_LOG("Failed to resize the stream.");
-			return;
-		}
-	}
-
-	(bit_stream -> stream)[bit_stream -> byte_pos] |= bit << (bit_stream -> bit_pos);
-	(bit_stream -> bit_pos)++;
+/// Mirror the lowest n_bits, used to emit the huffman codes starting from their most significant bit.
+static inline unsigned long long int bitstream_reverse_bits(unsigned long long int bits, unsigned char n_bits) {
+	if (n_bits == 0) return 0;
+	bits = ((bits >> 1) & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+	bits = ((bits >> 2) & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+	bits = ((bits >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((bits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return __builtin_bswap64(bits) >> (64 - n_bits);
+}
 
+UNUSED_FUNCTION static void bitstream_write_next_bit(BitStream* bit_stream, unsigned char bit) {
+	bitstream_write_bits(bit_stream, bit & 1, 1);
 	return;
 }
 
@@ -420,34 +515,53 @@ UNUSED_FUNCTION static void bitstream_write_bits_reversed(BitStream* bit_stream,
 		return;
 	}
 
-	unsigned int mask = 1 << (n_bits - 1);
-	for (unsigned char i = 0; i < n_bits; ++i, mask >>= 1) {
-		bitstream_write_next_bit(bit_stream, (bits & mask) >> (n_bits - 1 - i));
-		if (bit_stream -> error) {
-			WARNING_LOG("An error occurred while writing %u bits reversed to the stream.", n_bits);
-			return;
-		}
-	}
+	bitstream_write_bits(bit_stream, bitstream_reverse_bits(bits, n_bits), n_bits);
 
 	return;
 }
 
+/// The pending bits are merged in the 64-bit accumulator, which is then stored
+/// as a whole word, so that the stream is always up to date, while only the
+/// completed bytes are flushed out of it.
 UNUSED_FUNCTION static void bitstream_write_bits(BitStream* bit_stream, unsigned long long int bits, unsigned char n_bits) {
-	if (n_bits > sizeof(unsigned long long int) * 8) {
+	if (bit_stream -> error) {
+		WARNING_LOG("BitStream error write bits.");
+		return;
+	} else if (n_bits > sizeof(unsigned long long int) * 8) {
 		bit_stream -> error = 1;
 		WARNING_LOG("Tried to write more than %lu bits: %u", sizeof(unsigned long long int) * 8, n_bits);
 		return;
+	} else if (n_bits == 0) return;
+
+	// At most 7 bits are pending, so split the larger writes to not overflow the accumulator
+	if (n_bits > 56) {
+		bitstream_write_bits(bit_stream, bits & 0xFFFFFFFF, 32);
+		bitstream_write_bits(bit_stream, bits >> 32, n_bits - 32);
+		return;
 	}
 
-	unsigned int mask = 1;
-	for (unsigned char i = 0; i < n_bits; ++i, mask <<= 1) {
-		bitstream_write_next_bit(bit_stream, (bits & mask) >> i);
+	if (bit_stream -> byte_pos + sizeof(unsigned long long int) > bit_stream -> capacity) {
+		const unsigned int required = bit_stream -> byte_pos + ((bit_stream -> bit_pos + n_bits + 7) >> 3);
+		if (!(bit_stream -> fixed_capacity)) resize_bit_stream(bit_stream, bit_stream -> byte_pos + sizeof(unsigned long long int));
+		else if (required > bit_stream -> capacity) resize_bit_stream(bit_stream, required);
 		if (bit_stream -> error) {
-			WARNING_LOG("An error occurred while writing %u bits to the stream.", n_bits);
+			WARNING_LOG("Failed to resize the stream.");
 			return;
 		}
 	}
 
+	const unsigned long long int accumulator = bit_stream -> bit_buffer | ((bits & XCOMP_MASK_BITS_PRECEDING(n_bits)) << bit_stream -> bit_pos);
+	if (bit_stream -> byte_pos + sizeof(unsigned long long int) <= bit_stream -> capacity) xcomp_write_le64(bit_stream -> stream + bit_stream -> byte_pos, accumulator);
+	else {
+		for (unsigned int i = 0; i < bit_stream -> capacity - bit_stream -> byte_pos; ++i) (bit_stream -> stream)[bit_stream -> byte_pos + i] = accumulator >> (i * 8);
+	}
+
+	const unsigned char tot_bits = bit_stream -> bit_pos + n_bits;
+	bit_stream -> bit_buffer = accumulator >> (tot_bits & ~7);
+	bit_stream -> byte_pos += tot_bits >> 3;
+	bit_stream -> bit_pos = tot_bits & 7;
+	bit_stream -> size = MAX(bit_stream -> size, bit_stream -> byte_pos + (bit_stream -> bit_pos > 0));
+
 	return;
 }
 
@@ -457,6 +571,7 @@ UNUSED_FUNCTION static void deallocate_bit_stream(BitStream* bit_stream) {
 	bit_stream -> byte_pos = 0;
 	bit_stream -> bit_pos = 0;
 	bit_stream -> size = 0;
+	bit_stream -> capacity = 0;
 	return;
 }
 
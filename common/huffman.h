@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2025 TheProgxy <theprogxy@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HUFFMAN_H_
+#define _HUFFMAN_H_
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Resources:                                                                                            *
+ *  - In-Place Calculation of Minimum-Redundancy Codes (Moffat, Katajainen, 1995)                        *
+ *  - A Fast and Space-Economical Algorithm for Length-Limited Coding (Katajainen, Moffat, Turpin, 1995)  *
+ *  - https://en.wikipedia.org/wiki/Package-merge_algorithm                                              *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// -------------------
+//  Macros Definition
+// -------------------
+#define HUFFMAN_MAX_CODE_LENGTH 32
+
+// -------
+//  Enums
+// -------
+typedef enum {
+	HUFFMAN_IO_ERROR = 1,
+	HUFFMAN_INVALID_MAX_LENGTH
+} HuffmanError;
+
+/* -------------------------------------------------------------------------------------------------------- */
+// ------------------------
+//  Functions Declarations
+// ------------------------
+static void huffman_sort_symbols(const unsigned int* frequencies, unsigned short int* symbols, unsigned short int* sorted, unsigned short int symbols_cnt);
+static void huffman_minimum_redundancy(unsigned long long int* weights, unsigned short int weights_cnt);
+static int huffman_package_merge(const unsigned int* frequencies, const unsigned short int* symbols, unsigned short int symbols_cnt, unsigned char max_length, unsigned char* lengths);
+UNUSED_FUNCTION static int huffman_code_lengths(const unsigned int* frequencies, unsigned short int alphabet_size, unsigned char max_length, unsigned char* lengths);
+
+/* -------------------------------------------------------------------------------------------------------- */
+// Stable radix sort by frequency, a byte at a time, so the symbols listed in ascending order keep it among equal frequencies
+static void huffman_sort_symbols(const unsigned int* frequencies, unsigned short int* symbols, unsigned short int* sorted, unsigned short int symbols_cnt) {
+	unsigned int max_frequency = 0;
+	for (unsigned short int i = 0; i < symbols_cnt; ++i) max_frequency = MAX(max_frequency, frequencies[symbols[i]]);
+	
+	for (unsigned char shift = 0; shift < 32 && (max_frequency >> shift) > 0; shift += 8) {
+		unsigned int offsets[256] = {0};
+		for (unsigned short int i = 0; i < symbols_cnt; ++i) offsets[(frequencies[symbols[i]] >> shift) & 0xFF]++;
+		
+		unsigned int total = 0;
+		for (unsigned short int j = 0; j < 256; ++j) {
+			const unsigned int digit_cnt = offsets[j];
+			offsets[j] = total;
+			total += digit_cnt;
+		}
+		
+		for (unsigned short int i = 0; i < symbols_cnt; ++i) sorted[offsets[(frequencies[symbols[i]] >> shift) & 0xFF]++] = symbols[i];
+		mem_cpy(symbols, sorted, symbols_cnt * sizeof(unsigned short int));
+	}
+
+	return;
+}
+
+/// Compute the optimal prefix code lengths bounded by max_length: plain Huffman codes are built in place first,
+/// falling back to package-merge only when they would be longer than the limit.
+/// Unused symbols get a zero length, while a lone symbol gets a length of one, leaving
+/// to the caller whether to pair it with another symbol to keep the code complete.
+/// Returns zero on success, or a negated HuffmanError.
+UNUSED_FUNCTION static int huffman_code_lengths(const unsigned int* frequencies, unsigned short int alphabet_size, unsigned char max_length, unsigned char* lengths) {
+	mem_set(lengths, 0, alphabet_size);
+
+	// The second half of the symbols is the scratch buffer of the sort
+	unsigned short int* symbols = (unsigned short int*) xcomp_calloc(2 * MAX(alphabet_size, 1), sizeof(unsigned short int));
+	if (symbols == NULL) {
+		WARNING_LOG("Failed to allocate buffer for symbols.\n");
+		return -HUFFMAN_IO_ERROR;
+	}
+
+	unsigned short int symbols_cnt = 0;
+	for (unsigned short int i = 0; i < alphabet_size; ++i) if (frequencies[i]) symbols[symbols_cnt++] = i;
+
+	if (symbols_cnt <= 1) {
+		if (symbols_cnt == 1) lengths[symbols[0]] = 1;
+		XCOMP_SAFE_FREE(symbols);
+		return 0;
+	}
+
+	if (max_length == 0 || max_length > HUFFMAN_MAX_CODE_LENGTH || (max_length < 16 && symbols_cnt > (1U << max_length))) {
+		XCOMP_SAFE_FREE(symbols);
+		WARNING_LOG("Cannot fit %u symbols in codes of at most %u bits.\n", symbols_cnt, max_length);
+		return -HUFFMAN_INVALID_MAX_LENGTH;
+	}
+
+	huffman_sort_symbols(frequencies, symbols, symbols + alphabet_size, symbols_cnt);
+
+	unsigned long long int* depths = (unsigned long long int*) xcomp_calloc(symbols_cnt, sizeof(unsigned long long int));
+	if (depths == NULL) {
+		XCOMP_SAFE_FREE(symbols);
+		WARNING_LOG("Failed to allocate buffer for depths.\n");
+		return -HUFFMAN_IO_ERROR;
+	}
+
+	for (unsigned short int i = 0; i < symbols_cnt; ++i) depths[i] = frequencies[symbols[i]];
+	huffman_minimum_redundancy(depths, symbols_cnt);
+	
+	// The least frequent symbol is the deepest one
+	int err = 0;
+	if (depths[0] <= max_length) {
+		for (unsigned short int i = 0; i < symbols_cnt; ++i) lengths[symbols[i]] = depths[i];
+	} else err = huffman_package_merge(frequencies, symbols, symbols_cnt, max_length, lengths);
+
+	XCOMP_MULTI_FREE(symbols, depths);
+
+	return err;
+}
+
+/// Turn the weights, sorted in ascending order, into the depths of their leaves in the Huffman tree,
+/// reusing the same array for the parent links of the internal nodes and then for their depths.
+static void huffman_minimum_redundancy(unsigned long long int* weights, unsigned short int weights_cnt) {
+	// First pass, left to right, merging the two lightest among the leaves and the internal nodes
+	weights[0] += weights[1];
+	unsigned int root = 0;
+	unsigned int leaf = 2;
+	for (unsigned int next = 1; next < weights_cnt - 1U; ++next) {
+		if (leaf >= weights_cnt || weights[root] < weights[leaf]) {
+			weights[next] = weights[root];
+			weights[root++] = next;
+		} else weights[next] = weights[leaf++];
+
+		if (leaf >= weights_cnt || (root < next && weights[root] < weights[leaf])) {
+			weights[next] += weights[root];
+			weights[root++] = next;
+		} else weights[next] += weights[leaf++];
+	}
+
+	// Second pass, right to left, turning the parent links into the depths of the internal nodes
+	weights[weights_cnt - 2] = 0;
+	for (int next = weights_cnt - 3; next >= 0; --next) weights[next] = weights[weights[next]] + 1;
+
+	// Third pass, right to left, handing out the depths of the leaves
+	unsigned int available = 1;
+	unsigned int used = 0;
+	unsigned long long int depth = 0;
+	int internal = weights_cnt - 2;
+	int next = weights_cnt - 1;
+	while (available > 0) {
+		while (internal >= 0 && weights[internal] == depth) {
+			used++;
+			internal--;
+		}
+
+		while (available > used) {
+			weights[next--] = depth;
+			available--;
+		}
+
+		available = 2 * used;
+		depth++;
+		used = 0;
+	}
+
+	return;
+}
+
+/// Package-merge over the symbols sorted by frequency, adding their lengths into the zeroed lengths.
+static int huffman_package_merge(const unsigned int* frequencies, const unsigned short int* symbols, unsigned short int symbols_cnt, unsigned char max_length, unsigned char* lengths) {
+	// No list ever needs more than the 2n - 2 items that end up selected at the top one
+	const unsigned int list_capacity = 2 * symbols_cnt - 2;
+	unsigned long long int* weights = (unsigned long long int*) xcomp_calloc(max_length * list_capacity, sizeof(unsigned long long int));
+	unsigned char* is_package = (unsigned char*) xcomp_calloc(max_length * list_capacity, sizeof(unsigned char));
+	if (weights == NULL || is_package == NULL) {
+		XCOMP_MULTI_FREE(weights, is_package);
+		WARNING_LOG("Failed to allocate buffers for the package-merge lists.\n");
+		return -HUFFMAN_IO_ERROR;
+	}
+
+	// The list at index zero is the deepest level, made of the leaves alone,
+	// every other one merges the leaves with the pairs packaged from the level below
+	unsigned int lists_sizes[HUFFMAN_MAX_CODE_LENGTH] = {0};
+	for (unsigned short int i = 0; i < symbols_cnt; ++i) weights[i] = frequencies[symbols[i]];
+	lists_sizes[0] = symbols_cnt;
+
+	for (unsigned char level = 1; level < max_length; ++level) {
+		const unsigned long long int* prev_weights = weights + (level - 1) * list_capacity;
+		unsigned long long int* list_weights = weights + level * list_capacity;
+		unsigned char* list_is_package = is_package + level * list_capacity;
+		const unsigned int packages_cnt = lists_sizes[level - 1] / 2;
+
+		unsigned int leaf = 0;
+		unsigned int package = 0;
+		unsigned int size = 0;
+		while (size < list_capacity && (leaf < symbols_cnt || package < packages_cnt)) {
+			const unsigned long long int package_weight = (package < packages_cnt) ? prev_weights[2 * package] + prev_weights[2 * package + 1] : 0;
+			if (package >= packages_cnt || (leaf < symbols_cnt && frequencies[symbols[leaf]] <= package_weight)) {
+				list_weights[size] = frequencies[symbols[leaf++]];
+				list_is_package[size++] = FALSE;
+			} else {
+				list_weights[size] = package_weight;
+				list_is_package[size++] = TRUE;
+				package++;
+			}
+		}
+
+		lists_sizes[level] = size;
+	}
+
+	// Walk back down from the top: every leaf within the selected prefix of a level adds
+	// one bit to its symbol, while every package selects two more items at the level below
+	unsigned int selected = list_capacity;
+	for (int level = max_length - 1; level >= 0 && selected > 0; --level) {
+		const unsigned char* list_is_package = is_package + level * list_capacity;
+		unsigned int packages_cnt = 0;
+		for (unsigned int i = 0; i < selected; ++i) packages_cnt += list_is_package[i];
+		for (unsigned int i = 0; i < selected - packages_cnt; ++i) lengths[symbols[i]]++;
+		selected = 2 * packages_cnt;
+	}
+
+	XCOMP_MULTI_FREE(weights, is_package);
+
+	return 0;
+}
+
+#endif //_HUFFMAN_H_
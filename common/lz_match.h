@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2025 TheProgxy <theprogxy@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LZ_MATCH_H_
+#define _LZ_MATCH_H_
+
+// The vector paths are picked at compile time, following the instruction sets enabled for the target
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#elif defined(__SSE2__)
+#	include <emmintrin.h>
+#endif //__AVX2__
+
+/* -------------------------------------------------------------------------------------------------------- */
+// ------------------------
+//  Functions Declarations
+// ------------------------
+UNUSED_FUNCTION static inline unsigned int lz_match_length(const unsigned char* match, const unsigned char* current, unsigned int max_length);
+
+/* -------------------------------------------------------------------------------------------------------- */
+/// Count how many leading bytes of match and current are equal, up to max_length, which both must be able to read.
+/// The bytes are compared 32 or 16 at a time with AVX2 or SSE2, then 8 at a time, where the first
+/// differing byte is the lowest set one in the xor of the two words, and one at a time for the tail.
+UNUSED_FUNCTION static inline unsigned int lz_match_length(const unsigned char* match, const unsigned char* current, unsigned int max_length) {
+	unsigned int length = 0;
+
+#if defined(__AVX2__)
+	for (; length + 32 <= max_length; length += 32) {
+		const __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (match + length)), _mm256_loadu_si256((const __m256i*) (current + length)));
+		const unsigned int mismatch = ~((unsigned int) _mm256_movemask_epi8(equal));
+		if (mismatch) return length + __builtin_ctz(mismatch);
+	}
+#endif //__AVX2__
+
+#if defined(__SSE2__)
+	for (; length + 16 <= max_length; length += 16) {
+		const __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (match + length)), _mm_loadu_si128((const __m128i*) (current + length)));
+		const unsigned int mismatch = ~((unsigned int) _mm_movemask_epi8(equal)) & 0xFFFF;
+		if (mismatch) return length + __builtin_ctz(mismatch);
+	}
+#endif //__SSE2__
+
+	for (; length + 8 <= max_length; length += 8) {
+		const unsigned long long int diff = xcomp_read_le64(match + length) ^ xcomp_read_le64(current + length);
+		if (diff) return length + (__builtin_ctzll(diff) >> 3);
+	}
+
+	while (length < max_length && match[length] == current[length]) ++length;
+
+	return length;
+}
+
+#endif //_LZ_MATCH_H_
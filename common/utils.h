@@ -113,6 +113,24 @@
     #define xcomp_be_to_le(ptr_val, size)
 #endif // CHECK_ENDIANNESS
 
+// Unaligned little-endian loads/stores, the __builtin_memcpy is lowered to a single mov
+UNUSED_FUNCTION static inline unsigned long long int xcomp_read_le64(const void* ptr) {
+	unsigned long long int value = 0;
+	__builtin_memcpy(&value, ptr, sizeof(unsigned long long int));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif // __ORDER_BIG_ENDIAN__
+	return value;
+}
+
+UNUSED_FUNCTION static inline void xcomp_write_le64(void* ptr, unsigned long long int value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif // __ORDER_BIG_ENDIAN__
+	__builtin_memcpy(ptr, &value, sizeof(unsigned long long int));
+	return;
+}
+
 #define XCOMP_SAFE_FREE(ptr) do { if ((ptr) != NULL) xcomp_free(ptr), (ptr) = NULL; } while(0)
 #define XCOMP_MULTI_FREE(...) 															\
 	do {																				\
@@ -136,27 +154,77 @@ UNUSED_FUNCTION static size_t str_len(const char* str);
 UNUSED_FUNCTION static int str_n_cmp(const char* str1, const char* str2, size_t n);
 
 /* -------------------------------------------------------------------------------------------------------- */
+/// The value is repeated every val_size bytes, if val_size divides 8 the
+/// pattern is replicated into a word and stored 16 bytes at a time.
 UNUSED_FUNCTION static void mem_set_var(void* ptr, int value, size_t size, size_t val_size) {
-	if (ptr == NULL) return;
-	for (size_t i = 0; i < size; ++i) XCOMP_CAST_PTR(ptr, unsigned char)[i] = XCOMP_CAST_PTR(&value, unsigned char)[i % val_size]; 
+	if (ptr == NULL || val_size == 0) return;
+	
+	unsigned char* dest = (unsigned char*) ptr;
+	if (size < 16 || (8 % val_size) != 0) {
+		for (size_t i = 0, j = 0; i < size; ++i, j = (j + 1 == val_size) ? 0 : j + 1) dest[i] = (j < sizeof(int)) ? XCOMP_CAST_PTR(&value, unsigned char)[j] : 0;
+		return;
+	}
+
+	unsigned char pattern[16] = {0};
+	for (size_t i = 0; i < 16; ++i) pattern[i] = ((i % val_size) < sizeof(int)) ? XCOMP_CAST_PTR(&value, unsigned char)[i % val_size] : 0;
+	
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) __builtin_memcpy(dest + i, pattern, 16);
+	for (; i < size; ++i) dest[i] = pattern[i & 15];
+
 	return;
 }
 
+/// The regions must not overlap, the short copies are done with two
+/// overlapping moves, and the longer ones 32 bytes at a time.
 static void* mem_cpy(void* dest, const void* src, size_t size) {
 	if (dest == NULL || src == NULL) return NULL;
-	for (size_t i = 0; i < size; ++i) XCOMP_CAST_PTR(dest, unsigned char)[i] = XCOMP_CAST_PTR(src, unsigned char)[i];
+	
+	unsigned char* d = (unsigned char*) dest;
+	const unsigned char* s = (const unsigned char*) src;
+	if (size >= 32) {
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32) __builtin_memcpy(d + i, s + i, 32);
+		if (i < size) __builtin_memcpy(d + size - 32, s + size - 32, 32);
+	} else if (size >= 16) {
+		__builtin_memcpy(d, s, 16);
+		__builtin_memcpy(d + size - 16, s + size - 16, 16);
+	} else if (size >= 8) {
+		__builtin_memcpy(d, s, 8);
+		__builtin_memcpy(d + size - 8, s + size - 8, 8);
+	} else if (size >= 4) {
+		__builtin_memcpy(d, s, 4);
+		__builtin_memcpy(d + size - 4, s + size - 4, 4);
+	} else {
+		for (size_t i = 0; i < size; ++i) d[i] = s[i];
+	}
+	
 	return dest;
 }
 
+/// Each chunk is loaded before being stored, copying forward when dest
+/// precedes src and backward otherwise, so no temporary buffer is needed.
 UNUSED_FUNCTION static void mem_move(void* dest, const void* src, size_t size) {
-    if (dest == NULL || src == NULL || size == 0) return;
+    if (dest == NULL || src == NULL || size == 0 || dest == src) return;
     
-	unsigned char* temp = (unsigned char*) xcomp_calloc(size, sizeof(unsigned char));
-	
-	for (size_t i = 0; i < size; ++i) *XCOMP_CAST_PTR(temp + i, unsigned char) = *XCOMP_CAST_PTR(XCOMP_CAST_PTR(src, unsigned char) + i, unsigned char); 
-    for (size_t i = 0; i < size; ++i) *XCOMP_CAST_PTR(XCOMP_CAST_PTR(dest, unsigned char) + i, unsigned char) = *XCOMP_CAST_PTR(temp + i, unsigned char);
-    
-	XCOMP_SAFE_FREE(temp);
+	unsigned char* d = (unsigned char*) dest;
+	const unsigned char* s = (const unsigned char*) src;
+	unsigned char chunk[16] = {0};
+	if (d < s) {
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16) {
+			__builtin_memcpy(chunk, s + i, 16);
+			__builtin_memcpy(d + i, chunk, 16);
+		}
+		for (; i < size; ++i) d[i] = s[i];
+	} else {
+		size_t i = size;
+		for (; i >= 16; i -= 16) {
+			__builtin_memcpy(chunk, s + i - 16, 16);
+			__builtin_memcpy(d + i - 16, chunk, 16);
+		}
+		while (i--) d[i] = s[i];
+	}
     
     return;
 }
@@ -167,10 +235,20 @@ UNUSED_FUNCTION static int mem_n_cmp(const void* ptr1, const void* ptr2, size_t
     if (ptr1 == NULL) return -1;
     else if (ptr2 == NULL) return 1;
 
-    unsigned char* a = (unsigned char*) ptr1;
-    unsigned char* b = (unsigned char*) ptr2;
+    const unsigned char* a = (const unsigned char*) ptr1;
+    const unsigned char* b = (const unsigned char*) ptr2;
 
-	while (n--) if (*a++ != *b++) return *(a - 1) - *(b - 1);
+	// Compare a word at a time, the first differing byte is the lowest set one in the xor
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const unsigned long long int diff = xcomp_read_le64(a + i) ^ xcomp_read_le64(b + i);
+		if (diff) {
+			const size_t j = i + (__builtin_ctzll(diff) >> 3);
+			return a[j] - b[j];
+		}
+	}
+	
+	for (; i < n; ++i) if (a[i] != b[i]) return a[i] - b[i];
 
 	return 0;
 }
@@ -20,12 +20,320 @@
 
 #define _XCOMP_PRINTING_UTILS_
 #define _XCOMP_UTILS_IMPLEMENTATION_
-#include "./utils.h"
+#include "../common/utils.h"
 #define _XCOMP_BITSTREAM_
 #include "./xcomp_zlib.h"
 
 static const char zlib_data[] = "This is a test string, DEFLATE.";
 
+#define TEXT_TEST_SIZE   (256 * 1024)
+#define MIXED_TEST_SIZE  (48 * 1024)
+#define STREAM_TEST_SIZE (160 * 1024)
+
+// Odd split of the text in two gzip members, so that neither is a multiple of the CRC-32 strides
+#define GZIP_TEST_SPLIT  100003
+
+// Random data repeating with a period within the window, but longer than a deflate block apart
+#define PERIODIC_TEST_SIZE   200000
+#define PERIODIC_TEST_PERIOD 30000
+
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+// Four full chunks and a partial one, of random data repeating with a period shorter than the window
+#define PARALLEL_TEST_SIZE   (4 * PARALLEL_CHUNK_SIZE + PARALLEL_CHUNK_SIZE / 2)
+#define PARALLEL_TEST_PERIOD 4000
+#endif //_XCOMP_PARALLEL_DEFLATE_
+
+static const char* text_words[] = {
+	"the", "deflate", "stream", "block", "of", "window", "a", "match", "literal", "distance",
+	"huffman", "and", "length", "to", "code", "in", "table", "is", "bits", "with"
+};
+
+/// Fill the buffer with words drawn by a linear congruential generator from the seed,
+/// so that the data compresses well while still needing both literals and matches.
+static void fill_text(unsigned char* data, unsigned int len, unsigned int seed) {
+	unsigned int pos = 0;
+	while (pos < len) {
+		seed = seed * 1103515245 + 12345;
+		const char* word = text_words[(seed >> 16) % XCOMP_ARR_SIZE(text_words)];
+		for (unsigned int i = 0; word[i] != '\0' && pos < len; ++i) data[pos++] = word[i];
+		if (pos < len) data[pos++] = ((seed >> 8) % 16 == 0) ? '\n' : ' ';
+	}
+	return;
+}
+
+/// Fill the buffer with bytes skewed towards the upper half, which share almost no literal with text,
+/// and barely repeat, so that a block mixing them with text is better split into separate tables.
+static void fill_binary(unsigned char* data, unsigned int len, unsigned int seed) {
+	for (unsigned int i = 0; i < len; ++i) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = 0x80 | ((seed >> 24) & (seed >> 16));
+	}
+	return;
+}
+
+/// Fill the buffer with uniformly distributed bytes, which no level can compress unless they repeat.
+static void fill_random(unsigned char* data, unsigned int len, unsigned int seed) {
+	for (unsigned int i = 0; i < len; ++i) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 24;
+	}
+	return;
+}
+
+static unsigned char* duplicate_data(const unsigned char* data, unsigned int len) {
+	unsigned char* data_copy = (unsigned char*) xcomp_calloc(len, sizeof(unsigned char));
+	if (data_copy == NULL) {
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return NULL;
+	}
+
+	mem_cpy(data_copy, data, len);
+	
+	return data_copy;
+}
+
+/// Inflate the zlib stream, which is deallocated, checking that it gives back exactly the original data,
+/// returning the compressed length, or zero if it did not.
+static unsigned int check_round_trip(unsigned char* compressed_data, unsigned int compressed_data_length, const unsigned char* data, unsigned int len, unsigned char level) {
+	int err = 0;
+	unsigned int decompressed_data_length = 0;
+	unsigned char* decompressed_data = zlib_inflate(compressed_data, compressed_data_length, &decompressed_data_length, &err);
+	if (err) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u: %s", zlib_errors_str[-err], level, decompressed_data);
+		return 0;
+	}
+
+	const int is_mismatch = (decompressed_data_length != len) || mem_n_cmp(decompressed_data, data, len);
+	xcomp_free(decompressed_data);
+	if (is_mismatch) {
+		printf(COLOR_STR("ERROR: ", RED) "level %u: decompressed %u bytes out of %u, not matching the original data.\n", level, decompressed_data_length, len);
+		return 0;
+	}
+
+	return compressed_data_length;
+}
+
+/// Compress a copy of the data with the zlib wrapper through the context, then inflate it back, 
+/// returning the compressed length, or zero if the data did not come back exactly the same.
+static unsigned int round_trip_with_context(DeflateContext* ctx, const unsigned char* data, unsigned int len) {
+	int err = 0;
+	unsigned char* data_copy = duplicate_data(data, len);
+	if (data_copy == NULL) return 0;
+
+	unsigned int compressed_data_length = 0;
+	unsigned char* compressed_data = zlib_deflate_with_context(ctx, data_copy, len, &compressed_data_length, &err);
+	if (err) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u: %s", zlib_errors_str[-err], ctx -> level, compressed_data);
+		return 0;
+	}
+
+	return check_round_trip(compressed_data, compressed_data_length, data, len, ctx -> level);
+}
+
+/// Inflate the newly produced output through the inflate stream, checking it against the data from inflated_len on.
+static int inflate_stream_output(ZLIBInflateStream* inflate_stream, const unsigned char* compressed_data, unsigned int compressed_data_length, const unsigned char* data, unsigned int len, unsigned int* inflated_len) {
+	unsigned char out_chunk[1024] = {0};
+	unsigned int pos = 0;
+	while (TRUE) {
+		unsigned int consumed = 0;
+		unsigned int produced = 0;
+		const int status = zlib_inflate_stream(inflate_stream, compressed_data + pos, compressed_data_length - pos, &consumed, out_chunk, sizeof(out_chunk), &produced);
+		if (status < 0) return status;
+		if (*inflated_len + produced > len || mem_n_cmp(out_chunk, data + *inflated_len, produced)) return -ZLIB_CORRUPTED_DATA;
+		*inflated_len += produced;
+		pos += consumed;
+		if (status == ZLIB_STREAM_END || (pos == compressed_data_length && produced < sizeof(out_chunk))) break;
+	}
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Compress the data through the deflate stream in pieces of up to max_piece bytes, each passed along with the flush mode
+/// but the last one, passed with ZLIB_FINISH, while the output is drained out_chunk_size bytes at a time, where ZLIB_FINISH
+/// as the flush mode passes the whole data at once. The output is inflated alongside, which must give back the whole input
+/// so far at each flush, starting again from scratch after a full flush, then as a whole by zlib_inflate,
+/// returning the compressed length, or zero on failure.
+static unsigned int stream_round_trip(const unsigned char* data, unsigned int len, unsigned char level, ZlibFlushMode flush, unsigned int max_piece, unsigned int out_chunk_size) {
+	ZLIBDeflateStream deflate_stream = {0};
+	int err = 0;
+	if ((err = zlib_deflate_stream_init(&deflate_stream, level, TRUE)) < 0) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u: failed to initialize the deflate stream.\n", zlib_errors_str[-err], level);
+		return 0;
+	}
+
+	unsigned int capacity = len + out_chunk_size;
+	unsigned char* compressed_data = (unsigned char*) xcomp_calloc(capacity, sizeof(unsigned char));
+	unsigned char* out_chunk = (unsigned char*) xcomp_calloc(out_chunk_size, sizeof(unsigned char));
+	ZLIBInflateStream* inflate_stream = (ZLIBInflateStream*) xcomp_calloc(1, sizeof(ZLIBInflateStream));
+	if (compressed_data == NULL || out_chunk == NULL || inflate_stream == NULL) {
+		XCOMP_MULTI_FREE(compressed_data, out_chunk, inflate_stream);
+		zlib_deflate_stream_end(&deflate_stream);
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return 0;
+	}
+
+	zlib_inflate_stream_init(inflate_stream, TRUE);
+
+	unsigned int seed = level * 31 + flush;
+	unsigned int in_pos = 0;
+	unsigned int compressed_data_length = 0;
+	unsigned int checked_len = 0;
+	unsigned int inflated_len = 0;
+	int status = ZLIB_STREAM_CONTINUE;
+	while (status == ZLIB_STREAM_CONTINUE && err == ZLIB_NO_ERROR) {
+		seed = seed * 1103515245 + 12345;
+		const unsigned int piece = (flush == ZLIB_FINISH) ? len : MIN(1 + (seed >> 8) % max_piece, len - in_pos);
+		const ZlibFlushMode piece_flush = (in_pos + piece == len) ? ZLIB_FINISH : flush;
+		
+		// The same piece is passed again until consumed, and the flush until the output is drained
+		unsigned int piece_pos = 0;
+		while (TRUE) {
+			unsigned int consumed = 0;
+			unsigned int produced = 0;
+			if ((status = zlib_deflate_stream(&deflate_stream, data + in_pos + piece_pos, piece - piece_pos, &consumed, out_chunk, out_chunk_size, &produced, piece_flush)) < 0) break;
+			
+			if (compressed_data_length + produced > capacity) {
+				capacity *= 2;
+				unsigned char* grown_data = (unsigned char*) xcomp_realloc(compressed_data, capacity);
+				if (grown_data == NULL) {
+					status = -ZLIB_IO_ERROR;
+					break;
+				}
+				compressed_data = grown_data;
+			}
+
+			mem_cpy(compressed_data + compressed_data_length, out_chunk, produced);
+			compressed_data_length += produced;
+			piece_pos += consumed;
+			if (status == ZLIB_STREAM_END || (piece_pos == piece && produced < out_chunk_size && piece_flush != ZLIB_FINISH)) break;
+		}
+		
+		in_pos += piece;
+		if (status < 0) {
+			err = status;
+			break;
+		}
+
+		err = inflate_stream_output(inflate_stream, compressed_data + checked_len, compressed_data_length - checked_len, data, len, &inflated_len);
+		checked_len = compressed_data_length;
+		if (err == ZLIB_NO_ERROR && piece_flush != ZLIB_NO_FLUSH && inflated_len != in_pos) err = -ZLIB_CORRUPTED_DATA;
+
+		// Past a full flush the output must be decodable without any of the data before it
+		if (piece_flush == ZLIB_FULL_FLUSH) {
+			zlib_inflate_stream_end(inflate_stream);
+			zlib_inflate_stream_init(inflate_stream, FALSE);
+		}
+	}
+
+	zlib_inflate_stream_end(inflate_stream);
+	zlib_deflate_stream_end(&deflate_stream);
+	XCOMP_MULTI_FREE(out_chunk, inflate_stream);
+	if (err < 0 || status != ZLIB_STREAM_END || inflated_len != len) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u, flush %u: streamed %u bytes out of %u, status: %d.\n", zlib_errors_str[err < 0 ? -err : ZLIB_CORRUPTED_DATA], level, flush, inflated_len, len, status);
+		xcomp_free(compressed_data);
+		return 0;
+	}
+
+	return check_round_trip(compressed_data, compressed_data_length, data, len, level);
+}
+
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+static unsigned int parallel_round_trip(const unsigned char* data, unsigned int len, unsigned char level, unsigned char threads_cnt) {
+	int err = 0;
+	unsigned char* data_copy = duplicate_data(data, len);
+	if (data_copy == NULL) return 0;
+
+	unsigned int compressed_data_length = 0;
+	unsigned char* compressed_data = zlib_deflate_parallel(data_copy, len, level, threads_cnt, &compressed_data_length, &err);
+	if (err) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u, %u threads: %s", zlib_errors_str[-err], level, threads_cnt, compressed_data);
+		return 0;
+	}
+
+	return check_round_trip(compressed_data, compressed_data_length, data, len, level);
+}
+#endif //_XCOMP_PARALLEL_DEFLATE_
+
+static unsigned int round_trip(const unsigned char* data, unsigned int len, unsigned char level) {
+	DeflateContext ctx = {0};
+	int err = 0;
+	if ((err = init_deflate_context(&ctx, level)) < 0) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u: failed to initialize the deflate context.\n", zlib_errors_str[-err], level);
+		return 0;
+	}
+
+	const unsigned int compressed_data_length = round_trip_with_context(&ctx, data, len);
+	deallocate_deflate_context(&ctx);
+
+	return compressed_data_length;
+}
+
+/// Compress a copy of the data as a single gzip member, returning it, or NULL on failure.
+static unsigned char* gzip_member(const unsigned char* data, unsigned int len, unsigned char level, unsigned int* member_len) {
+	int err = 0;
+	unsigned char* data_copy = duplicate_data(data, len);
+	if (data_copy == NULL) return NULL;
+
+	unsigned char* member = gzip_deflate(data_copy, len, level, member_len, &err);
+	if (err) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u: %s", zlib_errors_str[-err], level, member);
+		return NULL;
+	}
+
+	return member;
+}
+
+/// Inflate the gzip stream, which is deallocated, checking that its members give back exactly the original data,
+/// returning the length of the stream, or zero if they did not.
+static unsigned int check_gzip_round_trip(unsigned char* stream, unsigned int stream_len, const unsigned char* data, unsigned int len, unsigned char level) {
+	int err = 0;
+	unsigned int decompressed_data_length = 0;
+	unsigned char* decompressed_data = gzip_inflate(stream, stream_len, &decompressed_data_length, &err);
+	if (err) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u: %s.\n", zlib_errors_str[-err], level, decompressed_data);
+		return 0;
+	}
+
+	const int is_mismatch = (decompressed_data_length != len) || mem_n_cmp(decompressed_data, data, len);
+	xcomp_free(decompressed_data);
+	if (is_mismatch) {
+		printf(COLOR_STR("ERROR: ", RED) "level %u: gzip decompressed %u bytes out of %u, not matching the original data.\n", level, decompressed_data_length, len);
+		return 0;
+	}
+
+	return stream_len;
+}
+
+/// Concatenate the gzip members of the two parts of the data, compressed at different levels,
+/// checking that they decode as a single multi-member stream, both into a buffer of the exact size and an allocated one.
+static unsigned int gzip_members_round_trip(const unsigned char* data, unsigned int len, unsigned int split) {
+	unsigned int first_len = 0;
+	unsigned int second_len = 0;
+	unsigned char* first = gzip_member(data, split, ZLIB_BEST_SPEED, &first_len);
+	unsigned char* second = (first == NULL) ? NULL : gzip_member(data + split, len - split, ZLIB_BEST_COMPRESSION, &second_len);
+	unsigned char* stream = (second == NULL) ? NULL : (unsigned char*) xcomp_calloc(first_len + second_len, sizeof(unsigned char));
+	unsigned char* out = (stream == NULL) ? NULL : (unsigned char*) xcomp_calloc(len, sizeof(unsigned char));
+	if (out == NULL) {
+		XCOMP_MULTI_FREE(first, second, stream);
+		return 0;
+	}
+
+	mem_cpy(stream, first, first_len);
+	mem_cpy(stream + first_len, second, second_len);
+	XCOMP_MULTI_FREE(first, second);
+
+	const int out_len = gzip_inflate_into(stream, first_len + second_len, out, len);
+	const int is_mismatch = (out_len != (int) len) || mem_n_cmp(out, data, len);
+	xcomp_free(out);
+	if (is_mismatch) {
+		printf(COLOR_STR("ERROR: ", RED) "gzip members decompressed into %d bytes out of %u, not matching the original data.\n", out_len, len);
+		xcomp_free(stream);
+		return 0;
+	}
+
+	return check_gzip_round_trip(stream, first_len + second_len, data, len, ZLIB_BEST_COMPRESSION);
+}
+
 int main(void) {
 	int err = 0;
 	
@@ -35,7 +343,7 @@ int main(void) {
 	unsigned char* zlib_deflate_test = (unsigned char*) xcomp_calloc(sizeof(zlib_data), sizeof(unsigned char));
 	mem_cpy(zlib_deflate_test, zlib_data, sizeof(zlib_data));
 	
-	unsigned char* zlib_compressed_data = zlib_deflate((unsigned char*) zlib_deflate_test, sizeof(zlib_data), &zlib_compressed_data_length, &err);
+	unsigned char* zlib_compressed_data = zlib_deflate((unsigned char*) zlib_deflate_test, sizeof(zlib_data), ZLIB_DEFAULT_COMPRESSION, &zlib_compressed_data_length, &err);
 	if (err) {
 		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "%s", zlib_errors_str[-err], zlib_compressed_data);
 		return -1;
@@ -50,7 +358,7 @@ int main(void) {
 		return -1;
 	}
 
-	if (str_n_cmp(zlib_data, (const char*) zlib_decompressed_data, MIN(sizeof(zlib_data), zlib_decompressed_data_length)) != 0) {
+	if (zlib_decompressed_data_length != sizeof(zlib_data) || mem_n_cmp(zlib_data, zlib_decompressed_data, sizeof(zlib_data))) {
 		printf(COLOR_STR("ERROR: ", RED) "Failed to decompress/compress the string.\n");
 		printf("Original String: '%s'\n", zlib_data);
 		printf("String After   : '%.*s'\n", zlib_decompressed_data_length, zlib_decompressed_data);
@@ -61,5 +369,169 @@ int main(void) {
 	printf("ZLib test string: '%.*s'\n", zlib_decompressed_data_length, zlib_decompressed_data);
 	xcomp_free(zlib_decompressed_data);
 	
+	// Round trip a larger text through every level, where the stored level must not shrink it and the others must
+	unsigned char* text_data = (unsigned char*) xcomp_calloc(TEXT_TEST_SIZE, sizeof(unsigned char));
+	if (text_data == NULL) {
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return -1;
+	}
+
+	fill_text(text_data, TEXT_TEST_SIZE, 1);
+	for (unsigned char level = ZLIB_NO_COMPRESSION; level <= ZLIB_ULTRA_COMPRESSION; ++level) {
+		const unsigned int compressed_len = round_trip(text_data, TEXT_TEST_SIZE, level);
+		if (compressed_len == 0 || (level == ZLIB_NO_COMPRESSION) != (compressed_len > TEXT_TEST_SIZE / 2)) {
+			printf(COLOR_STR("ERROR: ", RED) "level %u: round trip failed, compressed length: %u.\n", level, compressed_len);
+			xcomp_free(text_data);
+			return -1;
+		}
+		printf("Level %2u compressed from %u -> %u bytes.\n", level, TEXT_TEST_SIZE, compressed_len);
+	}
+
+	// An out of range level is rejected, and the input is still released
+	unsigned char* invalid_data = (unsigned char*) xcomp_calloc(TEXT_TEST_SIZE, sizeof(unsigned char));
+	if (invalid_data == NULL) {
+		xcomp_free(text_data);
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return -1;
+	}
+
+	mem_cpy(invalid_data, text_data, TEXT_TEST_SIZE);
+	unsigned int invalid_len = 0;
+	zlib_deflate(invalid_data, TEXT_TEST_SIZE, ZLIB_ULTRA_COMPRESSION + 1, &invalid_len, &err);
+	if (err != -ZLIB_INVALID_COMPRESSION_LEVEL || invalid_len != 0) {
+		printf(COLOR_STR("ERROR: ", RED) "level %u: expected ZLIB_INVALID_COMPRESSION_LEVEL, got %d.\n", ZLIB_ULTRA_COMPRESSION + 1, err);
+		xcomp_free(text_data);
+		return -1;
+	}
+
+	// Feed the text to the deflate stream in pieces, with each flush mode, draining it through a small output buffer
+	const unsigned char stream_levels[] = { ZLIB_NO_COMPRESSION, ZLIB_BEST_SPEED, ZLIB_DEFAULT_COMPRESSION, ZLIB_ULTRA_COMPRESSION };
+	const ZlibFlushMode flush_modes[] = { ZLIB_NO_FLUSH, ZLIB_SYNC_FLUSH, ZLIB_FULL_FLUSH };
+	for (unsigned char i = 0; i < XCOMP_ARR_SIZE(stream_levels); ++i) {
+		for (unsigned char j = 0; j < XCOMP_ARR_SIZE(flush_modes); ++j) {
+			const unsigned int stream_len = stream_round_trip(text_data, STREAM_TEST_SIZE, stream_levels[i], flush_modes[j], 5000, 7);
+			if (stream_len == 0) {
+				xcomp_free(text_data);
+				return -1;
+			}
+			printf("Level %2u streamed with flush %u from %u -> %u bytes.\n", stream_levels[i], flush_modes[j], STREAM_TEST_SIZE, stream_len);
+		}
+	}
+
+	// A single piece finished at once, through an output buffer larger than the whole stream
+	if (stream_round_trip(text_data, TEXT_TEST_SIZE, ZLIB_DEFAULT_COMPRESSION, ZLIB_FINISH, TEXT_TEST_SIZE, 2 * TEXT_TEST_SIZE) == 0) {
+		xcomp_free(text_data);
+		return -1;
+	}
+
+	// The text as a single gzip member, then split in two members compressed at different levels and concatenated
+	const unsigned char gzip_levels[] = { ZLIB_NO_COMPRESSION, ZLIB_BEST_SPEED, ZLIB_DEFAULT_COMPRESSION, ZLIB_BEST_COMPRESSION };
+	for (unsigned char i = 0; i < XCOMP_ARR_SIZE(gzip_levels); ++i) {
+		unsigned int member_len = 0;
+		unsigned char* member = gzip_member(text_data, TEXT_TEST_SIZE, gzip_levels[i], &member_len);
+		if (member == NULL || check_gzip_round_trip(member, member_len, text_data, TEXT_TEST_SIZE, gzip_levels[i]) == 0) {
+			xcomp_free(text_data);
+			return -1;
+		}
+		printf("Level %2u compressed as gzip from %u -> %u bytes.\n", gzip_levels[i], TEXT_TEST_SIZE, member_len);
+	}
+
+	const unsigned int gzip_members_len = gzip_members_round_trip(text_data, TEXT_TEST_SIZE, GZIP_TEST_SPLIT);
+	if (gzip_members_len == 0) {
+		xcomp_free(text_data);
+		return -1;
+	}
+	printf("Two gzip members compressed from %u -> %u bytes.\n", TEXT_TEST_SIZE, gzip_members_len);
+
+	// Text, then binary data, then text again within a single block, which the levels splitting blocks
+	// must encode with separate tables, ending up smaller than the same tokens encoded as one block
+	unsigned char* mixed_data = (unsigned char*) xcomp_calloc(MIXED_TEST_SIZE, sizeof(unsigned char));
+	if (mixed_data == NULL) {
+		xcomp_free(text_data);
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return -1;
+	}
+
+	mem_cpy(mixed_data, text_data, MIXED_TEST_SIZE / 3);
+	fill_binary(mixed_data + MIXED_TEST_SIZE / 3, MIXED_TEST_SIZE / 3, 2);
+	fill_text(mixed_data + 2 * (MIXED_TEST_SIZE / 3), MIXED_TEST_SIZE - 2 * (MIXED_TEST_SIZE / 3), 3);
+	xcomp_free(text_data);
+
+	for (unsigned char level = 4; level <= ZLIB_ULTRA_COMPRESSION; ++level) {
+		DeflateContext ctx = {0};
+		if ((err = init_deflate_context(&ctx, level)) < 0) {
+			printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "level %u: failed to initialize the deflate context.\n", zlib_errors_str[-err], level);
+			xcomp_free(mixed_data);
+			return -1;
+		}
+
+		const unsigned int split_len = round_trip_with_context(&ctx, mixed_data, MIXED_TEST_SIZE);
+		MatchFinderParams unsplit_params = *(ctx.params);
+		unsplit_params.split_blocks = FALSE;
+		ctx.params = &unsplit_params;
+		const unsigned int unsplit_len = round_trip_with_context(&ctx, mixed_data, MIXED_TEST_SIZE);
+		deallocate_deflate_context(&ctx);
+		
+		if (split_len == 0 || unsplit_len == 0 || split_len >= unsplit_len) {
+			printf(COLOR_STR("ERROR: ", RED) "level %u: expected the split blocks to be smaller, split: %u, unsplit: %u.\n", level, split_len, unsplit_len);
+			xcomp_free(mixed_data);
+			return -1;
+		}
+		printf("Level %2u compressed the mixed data from %u -> %u bytes, %u without splitting.\n", level, MIXED_TEST_SIZE, split_len, unsplit_len);
+	}
+
+	xcomp_free(mixed_data);
+
+	// Random bytes would be stored as they are, but once they repeat within the window every level must find the matches
+	unsigned char* repeated_data = (unsigned char*) xcomp_calloc(PERIODIC_TEST_SIZE, sizeof(unsigned char));
+	if (repeated_data == NULL) {
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return -1;
+	}
+
+	fill_random(repeated_data, PERIODIC_TEST_PERIOD, 5);
+	for (unsigned int i = PERIODIC_TEST_PERIOD; i < PERIODIC_TEST_SIZE; ++i) repeated_data[i] = repeated_data[i - PERIODIC_TEST_PERIOD];
+	
+	for (unsigned char level = ZLIB_BEST_SPEED; level <= ZLIB_ULTRA_COMPRESSION; ++level) {
+		const unsigned int compressed_len = round_trip(repeated_data, PERIODIC_TEST_SIZE, level);
+		if (compressed_len == 0 || compressed_len > PERIODIC_TEST_PERIOD + PERIODIC_TEST_PERIOD / 4) {
+			printf(COLOR_STR("ERROR: ", RED) "level %u: the repeated random data compressed to %u bytes.\n", level, compressed_len);
+			xcomp_free(repeated_data);
+			return -1;
+		}
+		printf("Level %2u compressed the repeated random data from %u -> %u bytes.\n", level, PERIODIC_TEST_SIZE, compressed_len);
+	}
+
+	xcomp_free(repeated_data);
+
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+	// The chunks compressed in parallel must join into a stream whose Adler-32 checks out, while each chunk
+	// primed by the window before it finds its first period there, staying as small as the single-threaded output
+	unsigned char* periodic_data = (unsigned char*) xcomp_calloc(PARALLEL_TEST_SIZE, sizeof(unsigned char));
+	if (periodic_data == NULL) {
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return -1;
+	}
+
+	fill_binary(periodic_data, PARALLEL_TEST_PERIOD, 4);
+	for (unsigned int i = PARALLEL_TEST_PERIOD; i < PARALLEL_TEST_SIZE; ++i) periodic_data[i] = periodic_data[i - PARALLEL_TEST_PERIOD];
+	
+	const unsigned char parallel_levels[] = { ZLIB_BEST_SPEED, ZLIB_DEFAULT_COMPRESSION, ZLIB_BEST_COMPRESSION };
+	for (unsigned char i = 0; i < XCOMP_ARR_SIZE(parallel_levels); ++i) {
+		const unsigned char level = parallel_levels[i];
+		const unsigned int serial_len = round_trip(periodic_data, PARALLEL_TEST_SIZE, level);
+		const unsigned int single_thread_len = parallel_round_trip(periodic_data, PARALLEL_TEST_SIZE, level, 1);
+		const unsigned int parallel_len = parallel_round_trip(periodic_data, PARALLEL_TEST_SIZE, level, 4);
+		if (serial_len == 0 || parallel_len == 0 || single_thread_len != parallel_len || parallel_len > serial_len + PARALLEL_TEST_PERIOD / 2) {
+			printf(COLOR_STR("ERROR: ", RED) "level %u: parallel round trip failed, serial: %u, single thread: %u, parallel: %u.\n", level, serial_len, single_thread_len, parallel_len);
+			xcomp_free(periodic_data);
+			return -1;
+		}
+		printf("Level %2u compressed the periodic data from %u -> %u bytes in parallel, %u serially.\n", level, PARALLEL_TEST_SIZE, parallel_len, serial_len);
+	}
+
+	xcomp_free(periodic_data);
+#endif //_XCOMP_PARALLEL_DEFLATE_
+
 	return 0;
 }
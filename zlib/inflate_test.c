@@ -32,6 +32,21 @@ const unsigned char zlib_compressed_data[] = {
 	0x18, 0xE2, 0xAA, 0x07, 0x00
 };
 
+// Two gzip members, the latter with all the optional header fields
+const unsigned char gzip_compressed_data[] = {
+	0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x0B, 0xC9,
+	0xC8, 0x2C, 0x56, 0x00, 0xA2, 0x44, 0x85, 0x92, 0xD4, 0xE2, 0x12, 0x85,
+	0xE2, 0x92, 0xA2, 0xCC, 0xBC, 0x74, 0x85, 0x92, 0x7C, 0x85, 0xE4, 0xFC,
+	0xDC, 0x82, 0xA2, 0xD4, 0xE2, 0x62, 0x00, 0x29, 0xA9, 0x8D, 0x5B, 0x21,
+	0x00, 0x00, 0x00, 0x1F, 0x8B, 0x08, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x03, 0x04, 0x00, 0x58, 0x43, 0x00, 0x00, 0x6E, 0x61, 0x6D, 0x65, 0x2E,
+	0x74, 0x78, 0x74, 0x00, 0x63, 0x6F, 0x6D, 0x6D, 0x65, 0x6E, 0x74, 0x00,
+	0x51, 0xFB, 0x53, 0x28, 0x2E, 0xC8, 0xC9, 0x2C, 0x51, 0x48, 0x4C, 0x2E,
+	0xCA, 0x2F, 0x2E, 0x56, 0x28, 0x29, 0xCF, 0x57, 0x48, 0xAF, 0xCA, 0x2C,
+	0x50, 0xC8, 0x4D, 0xCD, 0x4D, 0x4A, 0x2D, 0x2A, 0xD6, 0x03, 0x00, 0x0A,
+	0x31, 0xD5, 0x72, 0x1F, 0x00, 0x00, 0x00
+};
+
 int main(void) {
 	int err = 0;
 	
@@ -48,8 +63,74 @@ int main(void) {
 	
 	DEBUG_LOG("Zlib decompressed data: '%.*s'\n", zlib_decompressed_data_length, zlib_decompressed_data);
 
+	// Feed the same data to the streaming interface a byte at a time, draining it through a tiny output buffer
+	ZLIBInflateStream* stream = (ZLIBInflateStream*) xcomp_calloc(1, sizeof(ZLIBInflateStream));
+	unsigned char* streamed_data = (unsigned char*) xcomp_calloc(zlib_decompressed_data_length, sizeof(unsigned char));
+	if (stream == NULL || streamed_data == NULL) {
+		XCOMP_MULTI_FREE(stream, streamed_data, zlib_decompressed_data);
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return 1;
+	}
+
+	zlib_inflate_stream_init(stream, FALSE);
+	
+	unsigned int in_pos = 0;
+	unsigned int out_pos = 0;
+	unsigned char out_chunk[3] = {0};
+	int status = ZLIB_STREAM_CONTINUE;
+	while (status == ZLIB_STREAM_CONTINUE && out_pos <= zlib_decompressed_data_length) {
+		unsigned int consumed = 0;
+		unsigned int produced = 0;
+		status = zlib_inflate_stream(stream, zlib_compressed_data + in_pos, (in_pos < sizeof(zlib_compressed_data)), &consumed, out_chunk, sizeof(out_chunk), &produced);
+		if (out_pos + produced > zlib_decompressed_data_length) break;
+		mem_cpy(streamed_data + out_pos, out_chunk, produced);
+		in_pos += consumed;
+		out_pos += produced;
+	}
+	
+	zlib_inflate_stream_end(stream);
+	const int is_mismatch = (status != ZLIB_STREAM_END) || (out_pos != zlib_decompressed_data_length) || mem_n_cmp(streamed_data, zlib_decompressed_data, out_pos);
+	XCOMP_MULTI_FREE(stream, streamed_data);
+	if (is_mismatch) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "streamed data does not match, status: %d, length: %u\n", zlib_errors_str[ZLIB_CORRUPTED_DATA], status, out_pos);
+		xcomp_free(zlib_decompressed_data);
+		return 1;
+	}
+
+	DEBUG_LOG("Zlib streamed data matches.");
+
+	// Decode once more into a caller's buffer, first one byte short, then with the exact size
+	unsigned char* into_data = (unsigned char*) xcomp_calloc(zlib_decompressed_data_length, sizeof(unsigned char));
+	if (into_data == NULL) {
+		xcomp_free(zlib_decompressed_data);
+		printf(COLOR_STR("ZLIB_ERROR::%s\n", RED), zlib_errors_str[ZLIB_IO_ERROR]);
+		return 1;
+	}
+
+	const int short_len = deflate_inflate_into(zlib_compressed_data, sizeof(zlib_compressed_data), into_data, zlib_decompressed_data_length - 1);
+	const int into_len = deflate_inflate_into(zlib_compressed_data, sizeof(zlib_compressed_data), into_data, zlib_decompressed_data_length);
+	const int is_into_mismatch = (short_len != -ZLIB_NEED_MORE_OUTPUT) || (into_len != (int) zlib_decompressed_data_length) || mem_n_cmp(into_data, zlib_decompressed_data, zlib_decompressed_data_length);
+	xcomp_free(into_data);
+	if (is_into_mismatch) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "data decoded into the buffer does not match, short: %d, length: %d\n", zlib_errors_str[ZLIB_CORRUPTED_DATA], short_len, into_len);
+		xcomp_free(zlib_decompressed_data);
+		return 1;
+	}
+
+	DEBUG_LOG("Zlib data decoded into the buffer matches.");
+
 	xcomp_free(zlib_decompressed_data);
 
+	const char gzip_expected_data[] = "This is a test string to compress split across two gzip members.";
+	unsigned char gzip_decompressed_data[sizeof(gzip_expected_data)] = {0};
+	const int gzip_len = gzip_inflate_into(gzip_compressed_data, sizeof(gzip_compressed_data), gzip_decompressed_data, sizeof(gzip_decompressed_data));
+	if (gzip_len != sizeof(gzip_expected_data) - 1 || mem_n_cmp(gzip_decompressed_data, gzip_expected_data, gzip_len)) {
+		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "gzip data does not match, length: %d\n", zlib_errors_str[gzip_len < 0 ? -gzip_len : ZLIB_CORRUPTED_DATA], gzip_len);
+		return 1;
+	}
+
+	DEBUG_LOG("Gzip decompressed data: '%.*s'\n", gzip_len, gzip_decompressed_data);
+
 	return 0;
 }
 
@@ -23,12 +23,16 @@
 //  Enums
 // -------
 typedef enum {
-	WINDOW_SIZE      = 0x8000,
-	HF_LITERALS_SIZE = 286,
-	HF_DISTANCE_SIZE = 30,
-	HF_TABLE_SIZE    = 19,
-	BLOCK_DELIMITER  = 256,
-	MAX_HF_SIZE      = 288,
+	WINDOW_SIZE          = 0x8000,
+	HF_LITERALS_SIZE     = 286,
+	HF_DISTANCE_SIZE     = 30,
+	HF_TABLE_SIZE        = 19,
+	BLOCK_DELIMITER      = 256,
+	MAX_HF_SIZE          = 288,
+	MAX_HF_DISTANCE_SIZE = 32,
+	HF_MAX_BIT_LENGTH    = 15,
+	HF_TABLE_MAX_BIT_LENGTH = 7,
+	HF_PRIMARY_BITS      = 9,
 } ZLIBConstants;
 
 typedef enum PACKED_STRUCT ZlibError {
@@ -44,6 +48,12 @@ typedef enum PACKED_STRUCT ZlibError {
 	ZLIB_INVALID_WINDOW_SIZE,
 	ZLIB_DICTIONARY_NOT_SUPPORTED,
 	ZLIB_INVALID_CHECKSUM,
+	ZLIB_NEED_MORE_INPUT,
+	ZLIB_NEED_MORE_OUTPUT,
+	ZLIB_INVALID_GZIP_HEADER,
+	ZLIB_INVALID_CRC32_CHECKSUM,
+	ZLIB_INVALID_GZIP_LENGTH,
+	ZLIB_INVALID_COMPRESSION_LEVEL,
     ZLIB_TODO 
 } ZlibError;
 
@@ -60,9 +70,44 @@ static const char* zlib_errors_str[] = {
 	"ZLIB_INVALID_WINDOW_SIZE",
 	"ZLIB_DICTIONARY_NOT_SUPPORTED",
 	"ZLIB_INVALID_CHECKSUM",
+	"ZLIB_NEED_MORE_INPUT",
+	"ZLIB_NEED_MORE_OUTPUT",
+	"ZLIB_INVALID_GZIP_HEADER",
+	"ZLIB_INVALID_CRC32_CHECKSUM",
+	"ZLIB_INVALID_GZIP_LENGTH",
+	"ZLIB_INVALID_COMPRESSION_LEVEL",
     "ZLIB_TODO"
 };
 
+/// Positive status of the streaming functions, the errors are still returned negated
+typedef enum ZlibStreamStatus {
+	ZLIB_STREAM_CONTINUE = ZLIB_NO_ERROR,
+	ZLIB_STREAM_END
+} ZlibStreamStatus;
+
+/// Flush modes of the deflate stream:
+///  - no flush: the input is buffered until a whole block is ready.
+///  - sync flush: everything so far is compressed and byte aligned by an empty stored block.
+///  - full flush: as the sync one, also dropping the history, so that the decoding can restart from there.
+///  - finish: everything left is compressed into the final block, followed by the trailer.
+typedef enum ZlibFlushMode {
+	ZLIB_NO_FLUSH,
+	ZLIB_SYNC_FLUSH,
+	ZLIB_FULL_FLUSH,
+	ZLIB_FINISH
+} ZlibFlushMode;
+
+/// Compression levels accepted by the deflate functions, any value in between
+/// trades speed for ratio, see deflate_level_params for each of them.
+/// The ultra level goes beyond zlib ones, trading a lot of time for the smallest output.
+typedef enum ZlibCompressionLevel {
+	ZLIB_NO_COMPRESSION = 0,
+	ZLIB_BEST_SPEED = 1,
+	ZLIB_DEFAULT_COMPRESSION = 6,
+	ZLIB_BEST_COMPRESSION = 9,
+	ZLIB_ULTRA_COMPRESSION = 10
+} ZlibCompressionLevel;
+
 typedef enum PACKED_STRUCT BType { 
 	NO_COMPRESSION, 
 	COMPRESSED_FIXED_HF, 
@@ -82,7 +127,12 @@ static const char* btypes_str[] = {
 #	include "./zlib_bitstream.h"
 #endif //_XCOMP_BITSTREAM_
 
-/* #include "./zlib_compress.h" */
+#include "../common/huffman.h"
+#include "../common/lz_match.h"
+#include "./zlib_checksum.h"
+#include "./zlib_tables.h"
+#include "./zlib_compress.h"
 #include "./zlib_decompress.h"
+#include "./zlib_gzip.h"
 
 #endif // _XCOMP_ZLIB_H_
@@ -21,9 +21,50 @@
 // -------------------
 //  Macros Definition
 // -------------------
-#define CREATE_BIT_STREAM(data_stream, data_size) (BitStream) { .stream = data_stream, .size = data_size, .byte_pos = 0, .bit_pos = 0, .error = 0 }
+#define CREATE_BIT_STREAM(data_stream, data_size) (BitStream) { .stream = data_stream, .size = data_size, .byte_pos = 0, .bit_pos = 0, .error = 0, .bit_buffer = 0, .bit_buffer_len = 0, .capacity = data_size, .fixed_capacity = FALSE }
+#define CREATE_FIXED_BIT_STREAM(data_stream, data_capacity) (BitStream) { .stream = data_stream, .size = 0, .byte_pos = 0, .bit_pos = 0, .error = 0, .bit_buffer = 0, .bit_buffer_len = 0, .capacity = data_capacity, .fixed_capacity = TRUE }
 #define PRINT_BIT_STREAM_INFO(bit_stream) print_bit_stream_info(#bit_stream, __FILE__, __LINE__, bit_stream)
 
+#define SAFE_NEXT_BIT_WRITE(bit_stream, bit, ...) 									\
+	do {																			\
+		bitstream_write_next_bit((bit_stream), (bit));								\
+		if ((bit_stream) -> error) {												\
+	 	 	XCOMP_MULTI_FREE(__VA_ARGS__);											\
+		 	WARNING_LOG("An error occurred while writing to the bitstream.");		\
+		 	return -BITSTREAM_IO_ERROR;												\
+		 }																			\
+	} while (0)
+
+#define SAFE_BIT_WRITE(bit_stream, value, nb_bits, ...) 							\
+	do {																			\
+		bitstream_write_bits((bit_stream), (value), (nb_bits));						\
+		if ((bit_stream) -> error) {												\
+	 	 	__VA_ARGS__;															\
+		 	WARNING_LOG("An error occurred while writing to the bitstream.");		\
+		 	return -BITSTREAM_IO_ERROR;												\
+		 }																			\
+	} while (0)
+
+#define SAFE_REV_BIT_WRITE(bit_stream, value, nb_bits, ...) 						\
+	do {																			\
+		bitstream_write_bits_reversed((bit_stream), (value), (nb_bits));			\
+		if ((bit_stream) -> error) {												\
+	 	 	__VA_ARGS__;															\
+		 	WARNING_LOG("An error occurred while writing to the bitstream.");		\
+		 	return -BITSTREAM_IO_ERROR;												\
+		 }																			\
+	} while (0)
+
+#define SAFE_BYTE_WRITE(bit_stream, size, nmemb, var, ...) 							\
+	do {																			\
+		bitstream_write_bytes((bit_stream), (size), (nmemb), var);					\
+		 if ((bit_stream) -> error) {												\
+	 	 	XCOMP_MULTI_FREE(__VA_ARGS__);											\
+		 	WARNING_LOG("An error occurred while writing to the bitstream.");		\
+		 	return -BITSTREAM_IO_ERROR;												\
+		 }																			\
+	} while (0)
+
 /* ---------------------------------------------------------------------------------------------------------- */
 // ---------
 //  Structs
@@ -32,18 +73,46 @@ typedef enum {
    	BITSTREAM_IO_ERROR = 1
 } BitStreamError;
 
+/// The bit_buffer caches the next bit_buffer_len bits starting from
+/// (byte_pos, bit_pos), the position is always kept up to date so that the
+/// byte-aligned reads can keep working on it directly.
+/// When writing, bit_buffer holds the bit_pos pending bits of the current
+/// byte instead, and the stream grows up to capacity unless it is fixed.
 typedef struct PACKED_STRUCT BitStream {
 	unsigned char* stream;
 	unsigned int size;
 	unsigned int byte_pos;
 	unsigned char bit_pos;
 	unsigned char error;
+	unsigned long long int bit_buffer;
+	unsigned char bit_buffer_len;
+	unsigned int capacity;
+	unsigned char fixed_capacity;
 } BitStream;
 
 /* ---------------------------------------------------------------------------------------------------------- */
 // ------------------------
 //  Functions Declarations
 // ------------------------
+static void print_bit_stream_info(const char* name, const char* file, const int line, BitStream* bit_stream);
+static unsigned char bitstream_read_next_byte(BitStream* bit_stream);
+UNUSED_FUNCTION static void* bitstream_read_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb);
+static inline void bitstream_refill(BitStream* bit_stream);
+static inline unsigned long long int bitstream_available_bits(const BitStream* bit_stream);
+static inline unsigned long long int bitstream_peek_bits(BitStream* bit_stream, unsigned char n_bits);
+static inline unsigned char bitstream_consume_bits(BitStream* bit_stream, unsigned char n_bits);
+UNUSED_FUNCTION static unsigned char bitstream_read_next_bit(BitStream* bit_stream);
+static unsigned char bitstream_read_bits(BitStream* bit_stream, unsigned int n_bits, void* data);
+UNUSED_FUNCTION static void skip_to_next_byte(BitStream* bit_stream);
+static void resize_bit_stream(BitStream* bit_stream, unsigned int min_capacity);
+UNUSED_FUNCTION static void bitstream_write_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb, const void* src);
+static inline unsigned long long int bitstream_reverse_bits(unsigned long long int bits, unsigned char n_bits);
+static void bitstream_write_bits(BitStream* bit_stream, unsigned long long int bits, unsigned char n_bits);
+UNUSED_FUNCTION static void bitstream_write_next_bit(BitStream* bit_stream, unsigned char bit);
+UNUSED_FUNCTION static void bitstream_write_bits_reversed(BitStream* bit_stream, unsigned long long int bits, unsigned char n_bits);
+UNUSED_FUNCTION static void bitstream_bit_copy(BitStream* dest_bit_stream, BitStream* src_bit_stream);
+UNUSED_FUNCTION static void bitstream_truncate(BitStream* bit_stream, unsigned int byte_pos, unsigned char bit_pos);
+UNUSED_FUNCTION static void deallocate_bit_stream(BitStream* bit_stream);
 
 /* ---------------------------------------------------------------------------------------------------------- */
 
@@ -63,7 +132,8 @@ static void print_bit_stream_info(const char* name, const char* file, const int
 static unsigned char bitstream_read_next_byte(BitStream* bit_stream) {
 	if (bit_stream -> error) return 0;
 	
-   	bit_stream -> byte_pos += (bit_stream -> bit_pos > 0 && bit_stream -> bit_pos < 7);	
+   	bit_stream -> byte_pos += (bit_stream -> bit_pos > 0);	
+	bit_stream -> bit_buffer_len = 0;
 	if (bit_stream -> byte_pos >= bit_stream -> size) {
 		bit_stream -> error = 1;
 		WARNING_LOG("Bitstream out of bounds byte read");
@@ -78,11 +148,12 @@ static unsigned char bitstream_read_next_byte(BitStream* bit_stream) {
 	return *(bit_stream -> stream + old_pos);
 }
 
-static void* bitstream_read_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb) {
+UNUSED_FUNCTION static void* bitstream_read_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb) {
 	const unsigned int tot_size = size * nmemb;
 	if (bit_stream -> error) return NULL;
 	
-   	bit_stream -> byte_pos += (bit_stream -> bit_pos > 0 && bit_stream -> bit_pos < 7);	
+   	bit_stream -> byte_pos += (bit_stream -> bit_pos > 0);	
+	bit_stream -> bit_buffer_len = 0;
 	if (bit_stream -> byte_pos + tot_size > bit_stream -> size) {
 		bit_stream -> error = 1;
 		WARNING_LOG("Bitstream out of bounds bytes read, size: %u, nmemb: %u.", size, nmemb); 
@@ -97,20 +168,59 @@ static void* bitstream_read_bytes(BitStream* bit_stream, unsigned int size, unsi
 	return (bit_stream -> stream + old_pos);
 }
 
-static unsigned char bitstream_read_next_bit(BitStream* bit_stream) {
-    if (bit_stream -> error) return 0;
-	else if (bit_stream -> byte_pos >= bit_stream -> size) {
-		bit_stream -> error = 1;
-		WARNING_LOG("Bitstream out of bounds bit read");
-		PRINT_BIT_STREAM_INFO(bit_stream);
-		return 0;
+/// Load the next 64 bits (or whatever is left) starting from byte_pos, dropping
+/// the bit_pos bits of the current byte that were already consumed.
+static inline void bitstream_refill(BitStream* bit_stream) {
+	const unsigned int remaining = (bit_stream -> byte_pos < bit_stream -> size) ? bit_stream -> size - bit_stream -> byte_pos : 0;
+	unsigned long long int word = 0;
+	if (remaining >= sizeof(unsigned long long int)) {
+		word = xcomp_read_le64(bit_stream -> stream + bit_stream -> byte_pos);
+		bit_stream -> bit_buffer_len = 64 - bit_stream -> bit_pos;
+	} else {
+		for (unsigned int i = 0; i < remaining; ++i) word |= ((unsigned long long int) (bit_stream -> stream)[bit_stream -> byte_pos + i]) << (i * 8);
+		bit_stream -> bit_buffer_len = remaining ? remaining * 8 - bit_stream -> bit_pos : 0;
 	}
+	bit_stream -> bit_buffer = word >> bit_stream -> bit_pos;
+	return;
+}
 
-	unsigned char bit_value = ((bit_stream -> stream)[bit_stream -> byte_pos] >> (bit_stream -> bit_pos)) & 1;
-	(bit_stream -> bit_pos)++;
-	
-	if (bit_stream -> bit_pos > 7) bitstream_read_next_byte(bit_stream);
+/// Bits left to read from the current position.
+static inline unsigned long long int bitstream_available_bits(const BitStream* bit_stream) {
+	if (bit_stream -> byte_pos >= bit_stream -> size) return 0;
+	return (bit_stream -> size - bit_stream -> byte_pos) * 8ULL - bit_stream -> bit_pos;
+}
+
+/// Return the next n_bits (at most 56) without consuming them, the bits past
+/// the end of the stream are zeros, the error is raised only once consumed.
+static inline unsigned long long int bitstream_peek_bits(BitStream* bit_stream, unsigned char n_bits) {
+	if (bit_stream -> bit_buffer_len < n_bits) bitstream_refill(bit_stream);
+	return bit_stream -> bit_buffer & XCOMP_MASK_BITS_PRECEDING(n_bits);
+}
+
+static inline unsigned char bitstream_consume_bits(BitStream* bit_stream, unsigned char n_bits) {
+	if (bit_stream -> bit_buffer_len < n_bits) {
+		bitstream_refill(bit_stream);
+		if (bit_stream -> bit_buffer_len < n_bits) {
+			bit_stream -> error = 1;
+			WARNING_LOG("Bitstream out of bounds bits consume");
+			PRINT_BIT_STREAM_INFO(bit_stream);
+			return 1;
+		}
+	}
+
+	bit_stream -> bit_buffer >>= n_bits;
+	bit_stream -> bit_buffer_len -= n_bits;
+	bit_stream -> bit_pos += n_bits;
+	bit_stream -> byte_pos += bit_stream -> bit_pos >> 3;
+	bit_stream -> bit_pos &= 7;
 
+	return 0;
+}
+
+UNUSED_FUNCTION static unsigned char bitstream_read_next_bit(BitStream* bit_stream) {
+    if (bit_stream -> error) return 0;
+	const unsigned char bit_value = bitstream_peek_bits(bit_stream, 1);
+	if (bitstream_consume_bits(bit_stream, 1)) return 0;
     return bit_value;
 }
 
@@ -119,14 +229,19 @@ static unsigned char bitstream_read_bits(BitStream* bit_stream, unsigned int n_b
 		bit_stream -> error = 1;
 		WARNING_LOG("Tried to read more than %lu bits: %u", sizeof(unsigned long long int) * 8, n_bits);
 		return 1;
-	}
+	} else if (bit_stream -> error) return 1;
 
-    for (unsigned int i = 0, j = 0; i < n_bits; ++i) {
-    	j += (i % 8 == 0) && (i != 0); 
-		XCOMP_CAST_PTR(data, unsigned char)[j] += bitstream_read_next_bit(bit_stream) << (i % 8);
-		if (bit_stream -> error) return 1;
+	// A refill guarantees at least 57 bits, so the larger reads take two rounds
+	unsigned long long int bits = 0;
+	for (unsigned int read_bits = 0; read_bits < n_bits; ) {
+		const unsigned char chunk_bits = MIN(n_bits - read_bits, 32);
+		bits |= bitstream_peek_bits(bit_stream, chunk_bits) << read_bits;
+		if (bitstream_consume_bits(bit_stream, chunk_bits)) return 1;
+		read_bits += chunk_bits;
 	}
 
+	for (unsigned int j = 0; j < (n_bits + 7) / 8; ++j) XCOMP_CAST_PTR(data, unsigned char)[j] += (bits >> (j * 8)) & 0xFF;
+
     return 0;
 }
 
@@ -138,18 +253,169 @@ UNUSED_FUNCTION static void skip_to_next_byte(BitStream* bit_stream) {
 		return;
 	}
 
+	bit_stream -> bit_buffer_len = 0;
 	bit_stream -> bit_pos = 0;
 	(bit_stream -> byte_pos)++;
 
 	return;
 }
 
+/// Grow the stream geometrically so that it can hold at least min_capacity bytes.
+static void resize_bit_stream(BitStream* bit_stream, unsigned int min_capacity) {
+	if (bit_stream -> error) return;
+	else if (bit_stream -> fixed_capacity) {
+		bit_stream -> error = 1;
+		WARNING_LOG("Not enough capacity in the stream: %u, required: %u.", bit_stream -> capacity, min_capacity);
+		return;
+	}
+
+	const unsigned int old_capacity = bit_stream -> capacity;
+	bit_stream -> capacity = MAX(MAX(old_capacity * 2, min_capacity), 64U);
+	bit_stream -> stream = xcomp_realloc(bit_stream -> stream, bit_stream -> capacity * sizeof(unsigned char));
+	if (bit_stream -> stream == NULL) {
+		bit_stream -> error = 1;
+		WARNING_LOG("Failed to reallocate the stream to %u.", bit_stream -> capacity);
+		return;
+	}
+	
+	mem_set(bit_stream -> stream + old_capacity, 0, bit_stream -> capacity - old_capacity);
+
+	return;
+}
+
+UNUSED_FUNCTION static void bitstream_write_bytes(BitStream* bit_stream, unsigned int size, unsigned int nmemb, const void* src) {
+	if (bit_stream -> error) return;
+	
+	if (bit_stream -> bit_pos != 0) {
+		bit_stream -> bit_pos = 0;
+		bit_stream -> bit_buffer = 0;
+		(bit_stream -> byte_pos)++;
+	}
+
+	const unsigned int tot_size = size * nmemb;
+	if (bit_stream -> byte_pos + tot_size > bit_stream -> capacity) {
+		resize_bit_stream(bit_stream, bit_stream -> byte_pos + tot_size);
+		if (bit_stream -> error) return;
+	}
+
+	mem_cpy(bit_stream -> stream + bit_stream -> byte_pos, src, tot_size);
+	bit_stream -> byte_pos += tot_size;
+	bit_stream -> size = MAX(bit_stream -> size, bit_stream -> byte_pos);
+
+	return;
+}
+
+/// Mirror the lowest n_bits, used to emit the huffman codes starting from their most significant bit.
+static inline unsigned long long int bitstream_reverse_bits(unsigned long long int bits, unsigned char n_bits) {
+	if (n_bits == 0) return 0;
+	bits = ((bits >> 1) & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+	bits = ((bits >> 2) & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+	bits = ((bits >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((bits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return __builtin_bswap64(bits) >> (64 - n_bits);
+}
+
+/// The pending bits are merged in the 64-bit accumulator, which is then stored
+/// as a whole word, so that the stream is always up to date, while only the
+/// completed bytes are flushed out of it.
+static void bitstream_write_bits(BitStream* bit_stream, unsigned long long int bits, unsigned char n_bits) {
+	if (bit_stream -> error) return;
+	else if (n_bits > sizeof(unsigned long long int) * 8) {
+		bit_stream -> error = 1;
+		WARNING_LOG("Tried to write more than %lu bits: %u", sizeof(unsigned long long int) * 8, n_bits);
+		return;
+	} else if (n_bits == 0) return;
+
+	// At most 7 bits are pending, so split the larger writes to not overflow the accumulator
+	if (n_bits > 56) {
+		bitstream_write_bits(bit_stream, bits & 0xFFFFFFFF, 32);
+		bitstream_write_bits(bit_stream, bits >> 32, n_bits - 32);
+		return;
+	}
+
+	if (bit_stream -> byte_pos + sizeof(unsigned long long int) > bit_stream -> capacity) {
+		const unsigned int required = bit_stream -> byte_pos + ((bit_stream -> bit_pos + n_bits + 7) >> 3);
+		if (!(bit_stream -> fixed_capacity)) resize_bit_stream(bit_stream, bit_stream -> byte_pos + sizeof(unsigned long long int));
+		else if (required > bit_stream -> capacity) resize_bit_stream(bit_stream, required);
+		if (bit_stream -> error) return;
+	}
+
+	const unsigned long long int accumulator = bit_stream -> bit_buffer | ((bits & XCOMP_MASK_BITS_PRECEDING(n_bits)) << bit_stream -> bit_pos);
+	if (bit_stream -> byte_pos + sizeof(unsigned long long int) <= bit_stream -> capacity) xcomp_write_le64(bit_stream -> stream + bit_stream -> byte_pos, accumulator);
+	else {
+		for (unsigned int i = 0; i < bit_stream -> capacity - bit_stream -> byte_pos; ++i) (bit_stream -> stream)[bit_stream -> byte_pos + i] = accumulator >> (i * 8);
+	}
+
+	const unsigned char tot_bits = bit_stream -> bit_pos + n_bits;
+	bit_stream -> bit_buffer = accumulator >> (tot_bits & ~7);
+	bit_stream -> byte_pos += tot_bits >> 3;
+	bit_stream -> bit_pos = tot_bits & 7;
+	bit_stream -> size = MAX(bit_stream -> size, bit_stream -> byte_pos + (bit_stream -> bit_pos > 0));
+
+	return;
+}
+
+UNUSED_FUNCTION static void bitstream_write_next_bit(BitStream* bit_stream, unsigned char bit) {
+	bitstream_write_bits(bit_stream, bit & 1, 1);
+	return;
+}
+
+UNUSED_FUNCTION static void bitstream_write_bits_reversed(BitStream* bit_stream, unsigned long long int bits, unsigned char n_bits) {
+	if (n_bits > sizeof(unsigned long long int) * 8) {
+		bit_stream -> error = 1;
+		WARNING_LOG("Tried to write more than %lu bits: %u", sizeof(unsigned long long int) * 8, n_bits);
+		return;
+	}
+
+	bitstream_write_bits(bit_stream, bitstream_reverse_bits(bits, n_bits), n_bits);
+
+	return;
+}
+
+/// Append all the bits written in src_bit_stream, a plain copy if the
+/// destination is byte-aligned, otherwise 56 bits at a time shifted into the
+/// write accumulator.
+UNUSED_FUNCTION static void bitstream_bit_copy(BitStream* dest_bit_stream, BitStream* src_bit_stream) {
+	if (dest_bit_stream -> error || src_bit_stream -> error) {
+		WARNING_LOG("BitStream error bit copy.");
+		return;
+	}
+
+	const unsigned int full_bytes = src_bit_stream -> byte_pos;
+	const unsigned char tail_bits = src_bit_stream -> bit_pos;
+	if (dest_bit_stream -> bit_pos == 0) bitstream_write_bytes(dest_bit_stream, sizeof(unsigned char), full_bytes, src_bit_stream -> stream);
+	else {
+		if (dest_bit_stream -> byte_pos + full_bytes + sizeof(unsigned long long int) > dest_bit_stream -> capacity && !(dest_bit_stream -> fixed_capacity)) {
+			resize_bit_stream(dest_bit_stream, dest_bit_stream -> byte_pos + full_bytes + sizeof(unsigned long long int));
+		}
+
+		unsigned int i = 0;
+		for (; i + sizeof(unsigned long long int) <= full_bytes; i += 7) bitstream_write_bits(dest_bit_stream, xcomp_read_le64(src_bit_stream -> stream + i), 56);
+		for (; i < full_bytes; ++i) bitstream_write_bits(dest_bit_stream, (src_bit_stream -> stream)[i], 8);
+	}
+	
+	if (tail_bits) bitstream_write_bits(dest_bit_stream, (src_bit_stream -> stream)[full_bytes], tail_bits);
+	if (dest_bit_stream -> error) WARNING_LOG("BitStream gen error bit copy.");
+
+	return;
+}
+
+/// Drop everything written after the given position, so that it can be overwritten.
+UNUSED_FUNCTION static void bitstream_truncate(BitStream* bit_stream, unsigned int byte_pos, unsigned char bit_pos) {
+	if (bit_stream -> error || byte_pos + (bit_pos > 0) > bit_stream -> size) return;
+	bit_stream -> byte_pos = byte_pos;
+	bit_stream -> bit_pos = bit_pos;
+	bit_stream -> bit_buffer = bit_pos ? (bit_stream -> stream)[byte_pos] & XCOMP_MASK_BITS_PRECEDING(bit_pos) : 0;
+	bit_stream -> size = byte_pos + (bit_pos > 0);
+	return;
+}
+
 UNUSED_FUNCTION static void deallocate_bit_stream(BitStream* bit_stream) {
 	XCOMP_SAFE_FREE(bit_stream -> stream);
 	bit_stream -> stream   = NULL;
 	bit_stream -> byte_pos = 0;
 	bit_stream -> bit_pos  = 0;
 	bit_stream -> size     = 0;
+	bit_stream -> capacity = 0;
 	return;
 }
 
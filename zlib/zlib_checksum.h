@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2025 TheProgxy <theprogxy@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ZLIB_CHECKSUM_H_
+#define _ZLIB_CHECKSUM_H_
+
+// The vector and hardware kernels are picked at compile time, based on the
+// target of the build, unless _XCOMP_NO_SIMD_ is defined.
+#ifndef _XCOMP_NO_SIMD_
+#	if defined(__AVX2__)
+#		include <immintrin.h>
+#		define ADLER32_AVX2
+#	elif defined(__SSE2__)
+#		include <emmintrin.h>
+#		define ADLER32_SSE2
+#	elif defined(__ARM_NEON) && defined(__aarch64__)
+#		include <arm_neon.h>
+#		define ADLER32_NEON
+#	endif
+
+#	if defined(__PCLMUL__) && defined(__SSE4_1__)
+#		include <immintrin.h>
+#		define CRC32_PCLMUL
+#	elif defined(__ARM_FEATURE_CRC32)
+#		include <arm_acle.h>
+#		define CRC32_ARMV8
+#	endif
+#endif //_XCOMP_NO_SIMD_
+
+// -------
+//  Enums
+// -------
+typedef enum Adler32Constants {
+	ADLER32_BASE = 65521,
+	// Largest n such that 255 * n * (n + 1) / 2 + (n + 1) * (ADLER32_BASE - 1) fits
+	// in 32 bits, i.e. the most bytes that can be summed before reducing the sums
+	ADLER32_NMAX = 5552
+} Adler32Constants;
+
+// Reflected CRC-32 polynomial, as used by gzip
+#define CRC32_POLYNOMIAL 0xEDB88320U
+
+/* -------------------------------------------------------------------------------------------------------- */
+// ------------------
+//  Static Variables
+// ------------------
+// Slicing-by-8 tables, built on first use: the first one is the plain bytewise table,
+// while each following one advances the value of the previous one by a zero byte
+static unsigned int crc32_tables[8][256] = {0};
+static unsigned char crc32_tables_ready = FALSE;
+
+/* -------------------------------------------------------------------------------------------------------- */
+// ------------------------
+//  Functions Declarations
+// ------------------------
+
+/// Update the running adler32 checksum with the given data, the initial value being 1.
+UNUSED_FUNCTION static unsigned int xcomp_adler32(const unsigned char* data, unsigned int size, unsigned int adler);
+
+/// Combine the checksums of two consecutive chunks of data, given the length of the second one.
+UNUSED_FUNCTION static unsigned int xcomp_adler32_combine(unsigned int adler_a, unsigned int adler_b, unsigned long long int length_b);
+
+/// Update the running CRC-32 with the given data, the initial value being 0.
+UNUSED_FUNCTION static unsigned int xcomp_crc32(const unsigned char* data, unsigned int size, unsigned int crc);
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+#if defined(ADLER32_AVX2)
+#	define ADLER32_VECTOR_SIZE 32
+
+/// Sum the length bytes, a multiple of the vector size and at most ADLER32_NMAX,
+/// leaving the reduction to the caller.
+static inline void adler32_vector(const unsigned char* data, unsigned int length, unsigned int* low, unsigned int* high) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+
+	// Each vector adds its bytes to the low sum, and the previous low sum, times
+	// the vector size, plus the bytes weighted by their distance from the end, to the high one
+	__m256i low_sum = zero;
+	__m256i high_sum = zero;
+	__m256i prev_low_sum = zero;
+	for (unsigned int i = 0; i < length; i += ADLER32_VECTOR_SIZE) {
+		const __m256i bytes = _mm256_loadu_si256((const __m256i*) (data + i));
+		prev_low_sum = _mm256_add_epi32(prev_low_sum, low_sum);
+		low_sum = _mm256_add_epi32(low_sum, _mm256_sad_epu8(bytes, zero));
+		high_sum = _mm256_add_epi32(high_sum, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+	}
+	high_sum = _mm256_add_epi32(high_sum, _mm256_slli_epi32(prev_low_sum, 5));
+
+	__m128i low_128 = _mm_add_epi32(_mm256_castsi256_si128(low_sum), _mm256_extracti128_si256(low_sum, 1));
+	__m128i high_128 = _mm_add_epi32(_mm256_castsi256_si128(high_sum), _mm256_extracti128_si256(high_sum, 1));
+	low_128 = _mm_add_epi32(low_128, _mm_shuffle_epi32(low_128, 0x4E));
+	low_128 = _mm_add_epi32(low_128, _mm_shuffle_epi32(low_128, 0xB1));
+	high_128 = _mm_add_epi32(high_128, _mm_shuffle_epi32(high_128, 0x4E));
+	high_128 = _mm_add_epi32(high_128, _mm_shuffle_epi32(high_128, 0xB1));
+
+	*high += *low * length + (unsigned int) _mm_cvtsi128_si32(high_128);
+	*low += (unsigned int) _mm_cvtsi128_si32(low_128);
+
+	return;
+}
+
+#elif defined(ADLER32_SSE2)
+#	define ADLER32_VECTOR_SIZE 16
+
+/// Sum the length bytes, a multiple of the vector size and at most ADLER32_NMAX,
+/// leaving the reduction to the caller.
+static inline void adler32_vector(const unsigned char* data, unsigned int length, unsigned int* low, unsigned int* high) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+	const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+
+	// Each vector adds its bytes to the low sum, and the previous low sum, times
+	// the vector size, plus the bytes weighted by their distance from the end, to the high one
+	__m128i low_sum = zero;
+	__m128i high_sum = zero;
+	__m128i prev_low_sum = zero;
+	for (unsigned int i = 0; i < length; i += ADLER32_VECTOR_SIZE) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i*) (data + i));
+		prev_low_sum = _mm_add_epi32(prev_low_sum, low_sum);
+		low_sum = _mm_add_epi32(low_sum, _mm_sad_epu8(bytes, zero));
+		high_sum = _mm_add_epi32(high_sum, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weights_lo));
+		high_sum = _mm_add_epi32(high_sum, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weights_hi));
+	}
+	high_sum = _mm_add_epi32(high_sum, _mm_slli_epi32(prev_low_sum, 4));
+
+	low_sum = _mm_add_epi32(low_sum, _mm_shuffle_epi32(low_sum, 0x4E));
+	low_sum = _mm_add_epi32(low_sum, _mm_shuffle_epi32(low_sum, 0xB1));
+	high_sum = _mm_add_epi32(high_sum, _mm_shuffle_epi32(high_sum, 0x4E));
+	high_sum = _mm_add_epi32(high_sum, _mm_shuffle_epi32(high_sum, 0xB1));
+
+	*high += *low * length + (unsigned int) _mm_cvtsi128_si32(high_sum);
+	*low += (unsigned int) _mm_cvtsi128_si32(low_sum);
+
+	return;
+}
+
+#elif defined(ADLER32_NEON)
+#	define ADLER32_VECTOR_SIZE 16
+
+/// Sum the length bytes, a multiple of the vector size and at most ADLER32_NMAX,
+/// leaving the reduction to the caller.
+static inline void adler32_vector(const unsigned char* data, unsigned int length, unsigned int* low, unsigned int* high) {
+	static const unsigned char weights[ADLER32_VECTOR_SIZE] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+	const uint8x8_t weights_lo = vld1_u8(weights);
+	const uint8x8_t weights_hi = vld1_u8(weights + 8);
+
+	// Each vector adds its bytes to the low sum, and the previous low sum, times
+	// the vector size, plus the bytes weighted by their distance from the end, to the high one
+	uint32x4_t low_sum = vdupq_n_u32(0);
+	uint32x4_t high_sum = vdupq_n_u32(0);
+	uint32x4_t prev_low_sum = vdupq_n_u32(0);
+	for (unsigned int i = 0; i < length; i += ADLER32_VECTOR_SIZE) {
+		const uint8x16_t bytes = vld1q_u8(data + i);
+		prev_low_sum = vaddq_u32(prev_low_sum, low_sum);
+		low_sum = vpadalq_u16(low_sum, vpaddlq_u8(bytes));
+		const uint16x8_t weighted = vmlal_u8(vmull_u8(vget_low_u8(bytes), weights_lo), vget_high_u8(bytes), weights_hi);
+		high_sum = vpadalq_u16(high_sum, weighted);
+	}
+	high_sum = vaddq_u32(high_sum, vshlq_n_u32(prev_low_sum, 4));
+
+	*high += *low * length + vaddvq_u32(high_sum);
+	*low += vaddvq_u32(low_sum);
+
+	return;
+}
+
+#endif
+
+static unsigned int xcomp_adler32(const unsigned char* data, unsigned int size, unsigned int adler) {
+	unsigned int low = adler & 0xFFFF;
+	unsigned int high = (adler >> 16) & 0xFFFF;
+
+	// Defer the reduction to once every ADLER32_NMAX bytes, the most the sums can take
+	while (size > 0) {
+		unsigned int length = MIN(size, (unsigned int) ADLER32_NMAX);
+		size -= length;
+
+#ifdef ADLER32_VECTOR_SIZE
+		const unsigned int vector_length = length & ~(ADLER32_VECTOR_SIZE - 1);
+		if (vector_length > 0) adler32_vector(data, vector_length, &low, &high);
+		data += vector_length;
+		length -= vector_length;
+#endif //ADLER32_VECTOR_SIZE
+
+		for (; length >= 8; length -= 8, data += 8) {
+			low += data[0]; high += low;
+			low += data[1]; high += low;
+			low += data[2]; high += low;
+			low += data[3]; high += low;
+			low += data[4]; high += low;
+			low += data[5]; high += low;
+			low += data[6]; high += low;
+			low += data[7]; high += low;
+		}
+
+		for (; length > 0; --length, ++data) {
+			low += *data;
+			high += low;
+		}
+
+		low %= ADLER32_BASE;
+		high %= ADLER32_BASE;
+	}
+
+	return (high << 16) | low;
+}
+
+static unsigned int xcomp_adler32_combine(unsigned int adler_a, unsigned int adler_b, unsigned long long int length_b) {
+	// The low sum of the second chunk just adds up, while each of its bytes
+	// also carries the low sum of the first chunk into the high one.
+	const unsigned int remainder = length_b % ADLER32_BASE;
+	unsigned int low = adler_a & 0xFFFF;
+	unsigned int high = (remainder * low) % ADLER32_BASE;
+	low += (adler_b & 0xFFFF) + ADLER32_BASE - 1;
+	high += ((adler_a >> 16) & 0xFFFF) + ((adler_b >> 16) & 0xFFFF) + ADLER32_BASE - remainder;
+
+	if (low >= ADLER32_BASE) low -= ADLER32_BASE;
+	if (low >= ADLER32_BASE) low -= ADLER32_BASE;
+	if (high >= (ADLER32_BASE << 1)) high -= (ADLER32_BASE << 1);
+	if (high >= ADLER32_BASE) high -= ADLER32_BASE;
+
+	return (high << 16) | low;
+}
+
+// -------------------------------------------------------------------------------------------
+UNUSED_FUNCTION static void crc32_build_tables(void) {
+	for (unsigned int i = 0; i < 256; ++i) {
+		unsigned int value = i;
+		for (unsigned char k = 0; k < 8; ++k) value = (value & 1) ? (value >> 1) ^ CRC32_POLYNOMIAL : (value >> 1);
+		crc32_tables[0][i] = value;
+	}
+
+	for (unsigned int i = 0; i < 256; ++i) {
+		for (unsigned char k = 1; k < 8; ++k) crc32_tables[k][i] = (crc32_tables[k - 1][i] >> 8) ^ crc32_tables[0][crc32_tables[k - 1][i] & 0xFF];
+	}
+
+	crc32_tables_ready = TRUE;
+
+	return;
+}
+
+/// Process eight bytes per step, each one looked up in its own table,
+/// on the register already inverted by the caller.
+UNUSED_FUNCTION static unsigned int crc32_slice_by_8(const unsigned char* data, unsigned int size, unsigned int crc) {
+	if (!crc32_tables_ready) crc32_build_tables();
+
+	for (; size >= 8; size -= 8, data += 8) {
+		const unsigned long long int word = xcomp_read_le64(data) ^ crc;
+		const unsigned int low = word & 0xFFFFFFFF;
+		const unsigned int high = word >> 32;
+		crc = crc32_tables[7][low & 0xFF] ^ crc32_tables[6][(low >> 8) & 0xFF] ^ crc32_tables[5][(low >> 16) & 0xFF] ^ crc32_tables[4][low >> 24] ^
+			  crc32_tables[3][high & 0xFF] ^ crc32_tables[2][(high >> 8) & 0xFF] ^ crc32_tables[1][(high >> 16) & 0xFF] ^ crc32_tables[0][high >> 24];
+	}
+
+	for (; size > 0; --size, ++data) crc = (crc >> 8) ^ crc32_tables[0][(crc ^ *data) & 0xFF];
+
+	return crc;
+}
+
+#if defined(CRC32_PCLMUL)
+/// Fold four 128 bits lanes at a time through carry-less multiplications, reduce them
+/// to a single lane, and then to 32 bits with a Barrett reduction, following the
+/// "Fast CRC Computation Using PCLMULQDQ Instruction" paper by Intel.
+/// The length has to be a multiple of 16, and at least 64 bytes.
+static unsigned int crc32_pclmul(const unsigned char* data, unsigned int length, unsigned int crc) {
+	const __m128i k1_k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i k3_k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i k5_k0 = _mm_set_epi64x(0x0000000000, 0x0163CD6124);
+	const __m128i poly  = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i mask_32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) data), _mm_cvtsi32_si128(crc));
+	__m128i x2 = _mm_loadu_si128((const __m128i*) (data + 16));
+	__m128i x3 = _mm_loadu_si128((const __m128i*) (data + 32));
+	__m128i x4 = _mm_loadu_si128((const __m128i*) (data + 48));
+	data += 64;
+	length -= 64;
+
+	for (; length >= 64; length -= 64, data += 64) {
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1_k2, 0x00), _mm_clmulepi64_si128(x1, k1_k2, 0x11)), _mm_loadu_si128((const __m128i*) data));
+		x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1_k2, 0x00), _mm_clmulepi64_si128(x2, k1_k2, 0x11)), _mm_loadu_si128((const __m128i*) (data + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1_k2, 0x00), _mm_clmulepi64_si128(x3, k1_k2, 0x11)), _mm_loadu_si128((const __m128i*) (data + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1_k2, 0x00), _mm_clmulepi64_si128(x4, k1_k2, 0x11)), _mm_loadu_si128((const __m128i*) (data + 48)));
+	}
+
+	// Fold the four lanes into one, and then the remaining blocks of 16 bytes
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3_k4, 0x00), _mm_clmulepi64_si128(x1, k3_k4, 0x11)), x2);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3_k4, 0x00), _mm_clmulepi64_si128(x1, k3_k4, 0x11)), x3);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3_k4, 0x00), _mm_clmulepi64_si128(x1, k3_k4, 0x11)), x4);
+	for (; length >= 16; length -= 16, data += 16) {
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3_k4, 0x00), _mm_clmulepi64_si128(x1, k3_k4, 0x11)), _mm_loadu_si128((const __m128i*) data));
+	}
+
+	// Fold 128 bits to 64 bits
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3_k4, 0x10));
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask_32), k5_k0, 0x00), _mm_srli_si128(x1, 4));
+
+	// Barrett reduction to 32 bits
+	__m128i x2_reduced = _mm_clmulepi64_si128(_mm_and_si128(x1, mask_32), poly, 0x10);
+	x2_reduced = _mm_clmulepi64_si128(_mm_and_si128(x2_reduced, mask_32), poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2_reduced);
+
+	return (unsigned int) _mm_extract_epi32(x1, 1);
+}
+#endif //CRC32_PCLMUL
+
+static unsigned int xcomp_crc32(const unsigned char* data, unsigned int size, unsigned int crc) {
+	crc = ~crc;
+
+#if defined(CRC32_PCLMUL)
+	if (size >= 64) {
+		const unsigned int length = size & ~15U;
+		crc = crc32_pclmul(data, length, crc);
+		data += length;
+		size -= length;
+	}
+#elif defined(CRC32_ARMV8)
+	for (; size >= 8; size -= 8, data += 8) crc = __crc32d(crc, xcomp_read_le64(data));
+	for (; size > 0; --size, ++data) crc = __crc32b(crc, *data);
+#endif
+
+	crc = crc32_slice_by_8(data, size, crc);
+
+	return ~crc;
+}
+
+#endif //_ZLIB_CHECKSUM_H_
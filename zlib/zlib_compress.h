@@ -22,6 +22,11 @@
  * Resources: deflate <https://www.ietf.org/rfc/rfc1951.txt> *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+// The parallel deflate needs pthreads, so it's only built when _XCOMP_PARALLEL_DEFLATE_ is defined
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+#	include <pthread.h>
+#endif //_XCOMP_PARALLEL_DEFLATE_
+
 // TODO: Possibly create hf_tree struct to contain all the length - size
 //       couples, generally reduce the size of functions' declaration
 // TODO: Write better comments and error messages
@@ -40,6 +45,50 @@
 		__VA_ARGS__;		 \
 	} while (FALSE)
 
+// Match finder: the heads of the hash chains are indexed by the hash of the next
+// MIN_MATCH_LENGTH bytes, each position linking to the previous one with the same hash
+#define HASH_BITS        15
+#define HASH_SIZE        (1U << HASH_BITS)
+#define MIN_MATCH_LENGTH 3
+#define MAX_MATCH_LENGTH 258
+
+// The chains are kept across the blocks of a call, with a link for each position of the
+// window, so that the matches can reach up to WINDOW_SIZE bytes back regardless of the blocks
+#define WINDOW_MASK (WINDOW_SIZE - 1)
+
+// Bytes of input of each block, which is the most a stored block can hold
+#define DEFLATE_BLOCK_SIZE 0xFFFF
+
+// The window of the deflate stream grows up to DEFLATE_STREAM_HISTORY_SIZE bytes of history before sliding,
+// always by a multiple of WINDOW_SIZE, so that each position keeps its link while the chains are rebased
+#define DEFLATE_STREAM_HISTORY_SIZE (2 * WINDOW_SIZE)
+
+// Maximum rounds of optimal parsing of the ultra level
+#define ULTRA_ITERATIONS 15
+
+// Block splitting: the tokens are observed in windows of SPLIT_WINDOW_SIZE, classified in a handful of
+// types (literals by their top bits, short and long matches), and a window whose distribution drifts by
+// at least SPLIT_SHIFT_THRESHOLD / 512 from the one of the block so far is a candidate for a new block
+#define SPLIT_OBSERVATION_TYPES 10
+#define SPLIT_WINDOW_SIZE       512
+#define SPLIT_SHIFT_THRESHOLD   200
+#define MAX_BLOCK_SPLITS        (DEFLATE_BLOCK_SIZE / SPLIT_WINDOW_SIZE + 1)
+
+// Incompressible data detection: blocks of at least INCOMPRESSIBLE_MIN_SIZE bytes whose byte distribution is nearly
+// uniform and with hardly any 4 bytes sequence repeated within the window skip the match finding and go straight to a stored block.
+// The sequences probed every INCOMPRESSIBLE_PROBE_STEP bytes are looked up in the previous blocks through up to INCOMPRESSIBLE_MAX_CHAIN
+// links of the hash chains, and in the block itself among the ones sampled every INCOMPRESSIBLE_SAMPLE_STEP bytes,
+// hashed in (1 << INCOMPRESSIBLE_HASH_BITS) slots, the two steps being coprime
+#define INCOMPRESSIBLE_MIN_SIZE    4096
+#define INCOMPRESSIBLE_HASH_BITS   13
+#define INCOMPRESSIBLE_SAMPLE_STEP 4
+#define INCOMPRESSIBLE_PROBE_STEP  5
+#define INCOMPRESSIBLE_MAX_CHAIN   4
+
+// Bytes of input compressed by each job of the parallel deflate, primed by the window preceding them
+#define PARALLEL_CHUNK_SIZE (128 * 1024)
+
+
 /* -------------------------------------------------------------------------------------------------------- */
 // ------------------
 //  Static variables
@@ -108,6 +157,8 @@ static const unsigned char fixed_hf_literals_lengths[] = {
 	0x8, 0x8, 0x8
 };	
 
+static const unsigned char order_of_code_lengths[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
 #define FIXED_LITERALS_TREE(hf) 								\
 	hf.table = (unsigned short int*) fixed_hf_literals_table; 	\
 	hf.lengths = (unsigned char*) fixed_hf_literals_lengths;	\
@@ -124,17 +175,114 @@ static const unsigned char fixed_hf_literals_lengths[] = {
 // ---------
 //  Structs
 // ---------
+/// Packed in 32 bits, as the tokens of a whole block are walked by each pass of the encoder:
+/// the literal (or length code) takes 9 bits, the extra length 5, the distance code 5
+/// and the extra distance 13.
 typedef struct Match {
-	unsigned short int literal;
-	unsigned char distance;
-	unsigned char length_diff;
-	unsigned short int distance_diff;
+	unsigned int literal: 9;
+	unsigned int length_diff: 5;
+	unsigned int distance: 5;
+	unsigned int distance_diff: 13;
 } Match;
 
-typedef struct HFNode {
-    unsigned short int symbol;
-    unsigned int freq;
-} HFNode;
+typedef enum DeflateStrategy {
+	DEFLATE_STORED,
+	DEFLATE_GREEDY,
+	DEFLATE_LAZY,
+	DEFLATE_OPTIMAL
+} DeflateStrategy;
+
+/// max_chain: how many candidates are walked at most.
+/// nice_length: the length deemed good enough to stop the search early.
+/// max_lazy: lazy matching doesn't look for a better match once the current one reaches it,
+/// 		  while the greedy one doesn't insert in the chains the positions of longer matches.
+/// good_length: lazy matching only walks a quarter of the chain once the current match reaches it.
+/// split_blocks: whether the tokens of each block are split where a new dynamic table pays for itself.
+/// skip_incompressible: whether a block deemed incompressible goes straight to a stored block, a shortcut
+/// 					 the strongest levels don't take, as its estimate can still miss a few matches.
+typedef struct MatchFinderParams {
+	DeflateStrategy strategy;
+	unsigned short int max_chain;
+	unsigned short int nice_length;
+	unsigned short int max_lazy;
+	unsigned short int good_length;
+	unsigned char split_blocks;
+	unsigned char skip_incompressible;
+} MatchFinderParams;
+
+typedef struct MatchCandidate {
+	unsigned short int length;
+	unsigned short int distance;
+	unsigned char distance_code;
+} MatchCandidate;
+
+/// Cheapest cost found to reach each position, along with the step taken to get there:
+/// a literal when it's one, otherwise a match of that length at the given distance.
+typedef struct OptimalParseState {
+	unsigned int* costs;
+	unsigned short int* steps;
+	unsigned short int* distances;
+} OptimalParseState;
+
+/// Buffers of the compressor, sized once for the largest block and reused by each block,
+/// as well as by each call when the caller keeps the context around.
+/// The input is the one of the current call, which the hash chains refer to.
+/// The buffers of the optimal parsing are allocated only by the ultra level.
+typedef struct DeflateContext {
+	const MatchFinderParams* params;
+	unsigned char level;
+	const unsigned char* input;
+	unsigned int input_size;
+	Match* tokens;
+	unsigned int tokens_cnt;
+	unsigned int* hash_chains;
+	MatchCandidate* candidates;
+	unsigned int candidates_capacity;
+	unsigned int* candidates_offsets;
+	OptimalParseState optimal_state;
+	Match* optimal_tokens;
+} DeflateContext;
+
+/// Resumable deflate context: the input is buffered in a window holding at least the last WINDOW_SIZE bytes
+/// already compressed, as the history the matches can refer to, followed by up to DEFLATE_BLOCK_SIZE
+/// bytes still pending, while the output of each block is held until drained by the caller,
+/// so that its memory is bounded regardless of the size of the stream.
+/// The hash chains of the context are kept across the calls, hashed_len being the end of the positions
+/// already through the match finder, as the last ones of each call lack the bytes to be hashed.
+typedef struct ZLIBDeflateStream {
+	DeflateContext ctx;
+	unsigned char* window;
+	unsigned int history_len;
+	unsigned int pending_len;
+	unsigned int hashed_len;
+	BitStream output;
+	unsigned int output_pos;
+	unsigned int adler;
+	unsigned char is_flushed;
+	unsigned char is_finished;
+	unsigned char has_zlib_wrapper;
+} ZLIBDeflateStream;
+
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+/// Output of a chunk of the parallel deflate, which is a byte aligned piece of the deflate stream.
+typedef struct DeflateChunk {
+	BitStream compressed_bit_stream;
+	unsigned int adler;
+	unsigned int size;
+} DeflateChunk;
+
+/// Shared by the workers, which take the chunks in order through next_chunk,
+/// the first error stopping them all.
+typedef struct ParallelDeflateState {
+	const unsigned char* data_buffer;
+	unsigned char level;
+	DeflateChunk* chunks;
+	unsigned int chunks_cnt;
+	unsigned int next_chunk;
+	int err;
+	pthread_mutex_t lock;
+} ParallelDeflateState;
+#endif //_XCOMP_PARALLEL_DEFLATE_
 
 typedef struct RLEStream {
 	unsigned char value;
@@ -148,25 +296,133 @@ typedef struct HFTree {
 	unsigned char is_fixed;
 } HFTree;
 
+/// Occurrences of each literal/length and distance code within the tokens of a block,
+/// from which both the trees and the exact cost of each block type are derived.
+typedef struct BlockHistogram {
+	unsigned int literals[MAX_HF_SIZE];
+	unsigned int distances[MAX_HF_DISTANCE_SIZE];
+} BlockHistogram;
+
+/// Trees of a dynamic block, along with the run-length encoded code lengths which describe them.
+typedef struct DynamicHeader {
+	HFTree hf_literals;
+	HFTree hf_distances;
+	HFTree hf_code_lengths;
+	RLEStream* rle_encoded;
+	unsigned short int rle_encoded_size;
+	unsigned char order_size;
+} DynamicHeader;
+
+/// Parameters of each compression level, with the measured speed and ratio (compressed/original)
+/// on 1.1 MB of English text, with -O2 on x86-64, where the Huffman stages set the floor of the speed:
+///  level 0: stored blocks only,       ~650 MB/s, 100.0%
+///  level 1: single probe, greedy,     ~45 MB/s,  29.1%
+///  level 2: greedy,                   ~40 MB/s,  26.1%
+///  level 3: greedy,                   ~39 MB/s,  25.1%
+///  level 4: lazy, split blocks,       ~26 MB/s,  22.9%
+///  level 5: lazy,                     ~18 MB/s,  22.1%
+///  level 6: lazy (default),           ~15 MB/s,  21.7%
+///  level 7: lazy,                     ~13 MB/s,  21.7%
+///  level 8: lazy,                     ~11 MB/s,  21.6%
+///  level 9: lazy, longest chains,     ~10 MB/s,  21.6%
+///  level 10: optimal parsing (ultra), ~0.7 MB/s, 20.8%
+static const MatchFinderParams deflate_level_params[] = {
+	{ DEFLATE_STORED, 0,    0,   0,   0,   FALSE, FALSE },
+	{ DEFLATE_GREEDY, 1,    8,   4,   4,   FALSE, TRUE  },
+	{ DEFLATE_GREEDY, 4,    16,  5,   4,   FALSE, TRUE  },
+	{ DEFLATE_GREEDY, 8,    32,  6,   4,   FALSE, TRUE  },
+	{ DEFLATE_LAZY,   16,   16,  4,   4,   TRUE,  TRUE  },
+	{ DEFLATE_LAZY,   32,   32,  16,  8,   TRUE,  TRUE  },
+	{ DEFLATE_LAZY,   128,  128, 16,  8,   TRUE,  TRUE  },
+	{ DEFLATE_LAZY,   256,  128, 32,  8,   TRUE,  TRUE  },
+	{ DEFLATE_LAZY,   1024, 258, 128, 32,  TRUE,  TRUE  },
+	{ DEFLATE_LAZY,   4096, 258, 258, 32,  TRUE,  FALSE },
+	{ DEFLATE_OPTIMAL, 8192, 258, 258, 258, TRUE, FALSE }
+};
+
 /* -------------------------------------------------------------------------------------------------------- */
 // ------------------------
 //  Functions Declarations
 // ------------------------
-static int length_distance_encoding(const unsigned char* data_stream, unsigned int data_stream_size, Match** distance_encoding, unsigned int* distance_encoding_cnt);
-static void update_hf_nodes(HFNode new_node, HFNode* hf_nodes, unsigned int hf_nodes_cnt);
+static inline unsigned int hash_match_bytes(const unsigned char* data);
+static Match create_match(unsigned short int length, unsigned short int distance);
+static inline unsigned short int match_length(Match token);
+static unsigned short int longest_match(const unsigned char* data, unsigned int pos, unsigned int max_length, const unsigned int* head, const unsigned int* prev, unsigned short int max_chain, unsigned short int nice_length, unsigned short int* distance);
+static inline void insert_match_position(const unsigned char* data, unsigned int pos, unsigned int* head, unsigned int* prev);
+static int find_match_candidates(DeflateContext* ctx, unsigned int block_start, unsigned int block_end);
+static unsigned long long int tokens_cost(const Match* tokens, unsigned int tokens_cnt, const unsigned char* literal_costs, const unsigned char* distance_costs);
+static int update_symbol_costs(const Match* tokens, unsigned int tokens_cnt, unsigned char* literal_costs, unsigned char* distance_costs);
+static void optimal_parse(const unsigned char* data, unsigned int size, const MatchCandidate* candidates, const unsigned int* candidates_offsets, const unsigned char* literal_costs, const unsigned char* distance_costs, OptimalParseState* state, Match* tokens, unsigned int* tokens_cnt);
+static int optimal_length_distance_encoding(DeflateContext* ctx, unsigned int block_start, unsigned int block_end);
+static void length_distance_encoding(DeflateContext* ctx, unsigned int block_start, unsigned int block_end);
 static int build_hf_table(HFTree* hf_tree);
-static int generate_hf_tree(unsigned short int* data_stream, unsigned int data_stream_size, HFTree* hf_tree);
+static void compute_block_histogram(const Match* tokens, unsigned int tokens_cnt, BlockHistogram* histogram);
+static int generate_hf_tree(const unsigned int* frequencies, unsigned short int alphabet_size, HFTree* hf_tree, unsigned char max_bit_length);
 static int rle_encoding(RLEStream** rle_encoded, unsigned short int* rle_encoded_size, HFTree hf_literals, HFTree hf_distances);
-static int generate_hf_trees(Match* distance_encoded, unsigned int distance_encoded_size, BitStream* buffer, HFTree* hf_literals, HFTree* hf_distances);
-static int hf_encode_block(HFTree hf_literals, HFTree hf_distances, Match* distance_encoding, unsigned int distance_encoding_cnt, BitStream* buffer);
-static int encode_uncompressed_block(BitStream* compressed_bit_stream, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final) ;
-static int hf_compressed_block(BType method, BitStream* buffer, Match* distance_encoding, unsigned int distance_encoding_cnt, unsigned char is_final);
-static int compress_block(BitStream* compressed_bit_stream, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final);
+static void deallocate_dynamic_header(DynamicHeader* header);
+static int generate_dynamic_header(const BlockHistogram* histogram, DynamicHeader* header);
+static int write_dynamic_header(BitStream* buffer, const DynamicHeader* header);
+static unsigned long long int dynamic_header_bits(const DynamicHeader* header);
+static unsigned long long int hf_block_bits(const BlockHistogram* histogram, const HFTree* hf_literals, const HFTree* hf_distances);
+static int hf_encode_block(HFTree hf_literals, HFTree hf_distances, const Match* distance_encoding, unsigned int distance_encoding_cnt, BitStream* buffer);
+static int encode_uncompressed_block(BitStream* compressed_bit_stream, const unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final) ;
+static int hf_compressed_block(BType method, BitStream* buffer, const DynamicHeader* header, const Match* distance_encoding, unsigned int distance_encoding_cnt, unsigned char is_final);
+static int encode_tokens_block(BitStream* compressed_bit_stream, const Match* tokens, unsigned int tokens_cnt, const unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final);
+static void combine_block_histograms(BlockHistogram* result, const BlockHistogram* histogram, const BlockHistogram* other, int sign);
+static int estimate_block_bits(const BlockHistogram* histogram, unsigned long long int* block_bits);
+static int split_block_tokens(const Match* tokens, unsigned int tokens_cnt, unsigned int* splits, unsigned int* splits_cnt);
+static unsigned char is_block_incompressible(const DeflateContext* ctx, unsigned int block_start, unsigned int data_buffer_len);
+static int compress_block(DeflateContext* ctx, BitStream* compressed_bit_stream, unsigned int block_start, unsigned int data_buffer_len, unsigned char is_final);
+static int deflate_input_blocks(DeflateContext* ctx, BitStream* compressed_bit_stream, unsigned int buffer_offset, unsigned int data_buffer_len, unsigned char is_last, unsigned int* adler);
+static int deflate_chunk(DeflateContext* ctx, BitStream* compressed_bit_stream, const unsigned char* data_buffer, unsigned int history_len, unsigned int data_buffer_len, unsigned char is_last, unsigned int* adler);
+static int deflate_blocks(DeflateContext* ctx, BitStream* compressed_bit_stream, const unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* adler);
+static unsigned char* deflate_data_with_context(DeflateContext* ctx, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char has_zlib_wrapper, unsigned int* compressed_data_len, int* zlib_err);
+static unsigned char* deflate_data(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned char has_zlib_wrapper, unsigned int* compressed_data_len, int* zlib_err);
+static void zlib_header_bytes(unsigned char level, unsigned char* header);
+static void reset_deflate_stream_history(ZLIBDeflateStream* stream);
+static void slide_deflate_stream_window(ZLIBDeflateStream* stream);
+static int deflate_stream_pending(ZLIBDeflateStream* stream, unsigned char is_last);
+static void drain_deflate_stream(ZLIBDeflateStream* stream, unsigned char* out, unsigned int out_size, unsigned int* produced);
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+static void* parallel_deflate_worker(void* arg);
+#endif //_XCOMP_PARALLEL_DEFLATE_
+
+/// Allocate the buffers of the compressor for the given level, which goes from
+/// ZLIB_NO_COMPRESSION (0) to ZLIB_ULTRA_COMPRESSION (10).
+/// The context can be used by any number of calls, and must be released by deallocate_deflate_context.
+int init_deflate_context(DeflateContext* ctx, unsigned char level);
+void deallocate_deflate_context(DeflateContext* ctx);
 
 /// NOTE: the stream will be always deallocated both in case of failure and success.
 /// 	  Furthermore, the function allocates the returned stream of bytes, so that
 /// 	  once it's on the hand of the caller, it's responsible to manage that memory.
-unsigned char* zlib_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* compressed_data_len, int* zlib_err);	
+/// 	  The level goes from ZLIB_NO_COMPRESSION (0) to ZLIB_ULTRA_COMPRESSION (10).
+/// 	  deflate_deflate returns the raw deflate stream (RFC 1951), while zlib_deflate
+/// 	  wraps it in the zlib header and Adler-32 trailer (RFC 1950).
+unsigned char* deflate_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned int* compressed_data_len, int* zlib_err);
+unsigned char* zlib_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned int* compressed_data_len, int* zlib_err);	
+
+/// NOTE: same as deflate_deflate and zlib_deflate, but reusing the buffers of the given context,
+/// 	  which saves their allocation when compressing many streams.
+unsigned char* deflate_deflate_with_context(DeflateContext* ctx, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* compressed_data_len, int* zlib_err);
+unsigned char* zlib_deflate_with_context(DeflateContext* ctx, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* compressed_data_len, int* zlib_err);
+
+/// Streaming interface: the stream is fed with chunks of input, which are always consumed whole unless
+/// the output buffer fills up first, in which case the unused input must be passed again in the following call,
+/// along with the same flush mode until it's fully carried out, consumed and produced report how much was used.
+/// Returns ZLIB_STREAM_CONTINUE when more input or output space is needed, ZLIB_STREAM_END once the
+/// stream has been finished and drained, otherwise an error.
+int zlib_deflate_stream_init(ZLIBDeflateStream* stream, unsigned char level, unsigned char has_zlib_wrapper);
+int zlib_deflate_stream(ZLIBDeflateStream* stream, const unsigned char* data, unsigned int size, unsigned int* consumed, unsigned char* out, unsigned int out_size, unsigned int* produced, ZlibFlushMode flush);
+void zlib_deflate_stream_end(ZLIBDeflateStream* stream);
+
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+/// NOTE: the input is split in chunks of PARALLEL_CHUNK_SIZE, compressed by up to threads_cnt threads,
+/// 	  each chunk being primed by the window preceding it, and joined into a single zlib stream (RFC 1950),
+/// 	  with its header and Adler-32 trailer, as by zlib_deflate.
+/// 	  The stream is deallocated and the returned one is allocated, as by zlib_deflate.
+unsigned char* zlib_deflate_parallel(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned char threads_cnt, unsigned int* compressed_data_len, int* zlib_err);
+#endif //_XCOMP_PARALLEL_DEFLATE_
 
 /* -------------------------------------------------------------------------------------------------------- */
 
@@ -176,98 +432,319 @@ static void deallocate_hf_tree(HFTree* hf_tree) {
 	return;
 }
 
-static int length_distance_encoding(const unsigned char* data_stream, unsigned int data_stream_size, Match** distance_encoding, unsigned int* distance_encoding_cnt) {
-	*distance_encoding_cnt = MIN(data_stream_size, 3);
-	*distance_encoding = (Match*) xcomp_realloc(*distance_encoding, *distance_encoding_cnt * sizeof(Match));
-	if (*distance_encoding == NULL) {
-		WARNING_LOG("Failed to xcomp_reallocate buffer for distance_encoding.\n");
-		return -ZLIB_IO_ERROR;
+static inline unsigned int hash_match_bytes(const unsigned char* data) {
+	return ((data[0] | (data[1] << 8) | (data[2] << 16)) * 0x9E3779B1U) >> (32 - HASH_BITS);
+}
+
+/// Map the match on its length and distance codes, along with their extra values.
+static Match create_match(unsigned short int length, unsigned short int distance) {
+	const unsigned char len_ind = length_code(length);
+	const unsigned char dist_ind = distance_code(distance);
+	return (Match) {
+		.literal = 257 + len_ind,
+		.length_diff = length - length_base_values[len_ind],
+		.distance = dist_ind,
+		.distance_diff = distance - distance_base_values[dist_ind]
+	};
+}
+
+/// Number of input bytes the token stands for.
+static inline unsigned short int match_length(Match token) {
+	return (token.literal > 256) ? length_base_values[token.literal - 257] + token.length_diff : 1;
+}
+
+/// Walk at most max_chain candidates of the hash chain of pos, returning the length
+/// of the longest match found, which is shorter than MIN_MATCH_LENGTH if there is none.
+/// The chain links hold the position plus one, so that zero marks its end, and the walk
+/// stops at the first candidate farther than the window.
+static unsigned short int longest_match(const unsigned char* data, unsigned int pos, unsigned int max_length, const unsigned int* head, const unsigned int* prev, unsigned short int max_chain, unsigned short int nice_length, unsigned short int* distance) {
+	const unsigned char* current = data + pos;
+	unsigned int best_length = MIN_MATCH_LENGTH - 1;
+	unsigned int candidate = head[hash_match_bytes(current)];
+	for (unsigned short int chain = max_chain; candidate != 0 && chain > 0; --chain, candidate = prev[(candidate - 1) & WINDOW_MASK]) {
+		if (pos - (candidate - 1) > WINDOW_SIZE) break;
+		const unsigned char* match = data + candidate - 1;
+
+		// Cheap rejection: the byte which would make the match longer than the best one must match as well
+		if (match[best_length] != current[best_length] || match[0] != current[0] || match[1] != current[1]) continue;
+
+		const unsigned int length = 2 + lz_match_length(match + 2, current + 2, max_length - 2);
+		if (length > best_length) {
+			best_length = length;
+			*distance = current - match;
+			if (length >= nice_length || length == max_length) break;
+		}
 	}
 
-	for (unsigned char i = 0; i < *distance_encoding_cnt; ++i) (*distance_encoding)[i].literal = data_stream[i];
+	return best_length;
+}
+
+static inline void insert_match_position(const unsigned char* data, unsigned int pos, unsigned int* head, unsigned int* prev) {
+	const unsigned int hash = hash_match_bytes(data + pos);
+	prev[pos & WINDOW_MASK] = head[hash];
+	head[hash] = pos + 1;
+	return;
+}
+
+/// Write the tokens of the block [block_start, block_end) of the input into the context,
+/// followed by the block delimiter. The matches may reach back into the previous blocks.
+static void length_distance_encoding(DeflateContext* ctx, unsigned int block_start, unsigned int block_end) {
+	const MatchFinderParams* params = ctx -> params;
+	const unsigned char* data_stream = ctx -> input;
+	const unsigned int data_stream_size = ctx -> input_size;
+	unsigned int* head = ctx -> hash_chains;
+	unsigned int* prev = head + HASH_SIZE;
+	Match* tokens = ctx -> tokens;
+	ctx -> tokens_cnt = 0;
+
+	// Lazy matching defers the match found at the previous position, emitting it only
+	// if the one at the current position isn't longer, otherwise it becomes a literal
+	const unsigned char is_lazy = params -> strategy == DEFLATE_LAZY;
+	unsigned char has_pending = FALSE;
+	unsigned short int prev_length = 0;
+	unsigned short int prev_distance = 0;
 	
-	unsigned short int cur_len = 0;
-	for (long int i = 3; i < data_stream_size; i += cur_len) {
-		unsigned short int found = 0;
-		cur_len = 3;
-		
-		for (int j = 0; (j < i - cur_len) && (i < data_stream_size - cur_len); ++j) {
-			if (mem_n_cmp((const char*) (data_stream + i), (const char*) (data_stream + j), cur_len) == 0) {
-				cur_len++;
-				found = i - j;
-				if (cur_len == 259) break;
-				continue;	
+	// The matches don't cross the end of the block, while the positions are inserted as long as the input has bytes to hash
+	unsigned int i = block_start;
+	while (i < block_end) {
+		unsigned short int length = 0;
+		unsigned short int distance = 0;
+		if (i + MIN_MATCH_LENGTH <= block_end && (!has_pending || prev_length < params -> max_lazy)) {
+			const unsigned short int max_chain = (has_pending && prev_length >= params -> good_length) ? MAX(params -> max_chain >> 2, 1) : params -> max_chain;
+			length = longest_match(data_stream, i, MIN(block_end - i, (unsigned int) MAX_MATCH_LENGTH), head, prev, max_chain, params -> nice_length, &distance);
+		}
+		if (i + MIN_MATCH_LENGTH <= data_stream_size) insert_match_position(data_stream, i, head, prev);
+
+		if (has_pending) {
+			if (prev_length >= MIN_MATCH_LENGTH && length <= prev_length) {
+				tokens[(ctx -> tokens_cnt)++] = create_match(prev_length, prev_distance);
+				
+				// The match started at the previous position, and the current one is already in the chains
+				const unsigned int match_end = i - 1 + prev_length;
+				for (++i; i < match_end; ++i) {
+					if (i + MIN_MATCH_LENGTH <= data_stream_size) insert_match_position(data_stream, i, head, prev);
+				}
+				
+				has_pending = FALSE;
+				continue;
 			}
+
+			tokens[(ctx -> tokens_cnt)++] = (Match) { .literal = data_stream[i - 1] };
+			has_pending = FALSE;
 		}
 
-		cur_len--;
-		
-		*distance_encoding = (Match*) xcomp_realloc(*distance_encoding, sizeof(Match) * (++(*distance_encoding_cnt)));
-		if (*distance_encoding == NULL) {
-			WARNING_LOG("Failed to xcomp_reallocate buffer for distance_encoding.\n");
-			return -ZLIB_IO_ERROR;
+		if (is_lazy) {
+			prev_length = length;
+			prev_distance = distance;
+			has_pending = TRUE;
+			i++;
+			continue;
+		}
+
+		if (length < MIN_MATCH_LENGTH) {
+			tokens[(ctx -> tokens_cnt)++] = (Match) { .literal = data_stream[i] };
+			i++;
+			continue;
+		}
+
+		tokens[(ctx -> tokens_cnt)++] = create_match(length, distance);
+	
+		// Insert the positions covered by the match as well, so that the later ones can refer to them,
+		// unless the match is long enough that skipping them is worth the lost matches
+		const unsigned int match_end = i + length;
+		if (length > params -> max_lazy) {
+			i = match_end;
+			continue;
 		}
 		
-		(*distance_encoding)[*distance_encoding_cnt - 1] = (Match) {0};
-	
-		if (cur_len > 2) {
-			const unsigned short int length_base_values[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
-			unsigned char len_ind = 0;
-			for (; len_ind < 29; ++len_ind) { 
-				if (cur_len < length_base_values[len_ind]) {
-					--len_ind;
-					break;
-				} else if (cur_len == length_base_values[len_ind]) break;
-			}
+		for (++i; i < match_end; ++i) {
+			if (i + MIN_MATCH_LENGTH <= data_stream_size) insert_match_position(data_stream, i, head, prev);
+		}
+	}
+	
+	// The last position of the block can't start a match, as it would be too short
+	if (has_pending) tokens[(ctx -> tokens_cnt)++] = (Match) { .literal = data_stream[block_end - 1] };
 
-			(*distance_encoding)[*distance_encoding_cnt - 1].length_diff = cur_len - length_base_values[len_ind];
-			(*distance_encoding)[*distance_encoding_cnt - 1].literal = 257 + len_ind;
+	// Append the block delimiter
+	tokens[(ctx -> tokens_cnt)++] = (Match) { .literal = BLOCK_DELIMITER };
+
+	return;
+}
+
+/// Gather, for every position of the block, the matches of increasing length met walking its hash chain,
+/// so that the closest distance reaching each length is known to the optimal parsing.
+/// The candidates of position block_start + i are the ones in [candidates_offsets[i], candidates_offsets[i + 1]).
+static int find_match_candidates(DeflateContext* ctx, unsigned int block_start, unsigned int block_end) {
+	const MatchFinderParams* params = ctx -> params;
+	const unsigned char* data = ctx -> input;
+	unsigned int* head = ctx -> hash_chains;
+	unsigned int* prev = head + HASH_SIZE;
+
+	unsigned int* candidates_offsets = ctx -> candidates_offsets;
+	unsigned int candidates_cnt = 0;
+	for (unsigned int i = block_start; i < block_end; ++i) {
+		candidates_offsets[i - block_start] = candidates_cnt;
+		if (i + MIN_MATCH_LENGTH > ctx -> input_size) continue;
+		if (i + MIN_MATCH_LENGTH > block_end) {
+			insert_match_position(data, i, head, prev);
+			continue;
+		}
+
+		const unsigned char* current = data + i;
+		const unsigned int max_length = MIN(block_end - i, (unsigned int) MAX_MATCH_LENGTH);
+		unsigned int best_length = MIN_MATCH_LENGTH - 1;
+		unsigned int candidate = head[hash_match_bytes(current)];
+		for (unsigned short int chain = params -> max_chain; candidate != 0 && chain > 0; --chain, candidate = prev[(candidate - 1) & WINDOW_MASK]) {
+			if (i - (candidate - 1) > WINDOW_SIZE) break;
+			const unsigned char* match = data + candidate - 1;
+			if (match[best_length] != current[best_length] || match[0] != current[0] || match[1] != current[1]) continue;
+			
+			const unsigned int length = 2 + lz_match_length(match + 2, current + 2, max_length - 2);
+			if (length <= best_length) continue;
+			best_length = length;
 			
-			const unsigned short int dist_base_values[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
-			unsigned char dist_ind = 0;
-			for (; dist_ind < 30; ++dist_ind) {
-				if (found < dist_base_values[dist_ind]) {
-					--dist_ind;
-					break;
-				} else if (found == dist_base_values[dist_ind]) break;
+			if (candidates_cnt == ctx -> candidates_capacity) {
+				ctx -> candidates_capacity *= 2;
+				ctx -> candidates = (MatchCandidate*) xcomp_realloc(ctx -> candidates, ctx -> candidates_capacity * sizeof(MatchCandidate));
+				if (ctx -> candidates == NULL) {
+					WARNING_LOG("Failed to xcomp_reallocate buffer for the match candidates.\n");
+					return -ZLIB_IO_ERROR;
+				}
 			}
 			
-			dist_ind = MIN(dist_ind, 29);
-
-			(*distance_encoding)[*distance_encoding_cnt - 1].distance_diff = found - dist_base_values[dist_ind];
-			(*distance_encoding)[*distance_encoding_cnt - 1].distance = dist_ind;
-		} else {
-			(*distance_encoding)[*distance_encoding_cnt - 1].literal = data_stream[i];
-			cur_len = 1;
+			const unsigned short int distance = current - match;
+			(ctx -> candidates)[candidates_cnt++] = (MatchCandidate) { .length = length, .distance = distance, .distance_code = create_match(length, distance).distance };
+			if (length >= params -> nice_length || length == max_length) break;
 		}
+
+		insert_match_position(data, i, head, prev);
 	}
 	
-	// Append the block delimiter
-	*distance_encoding = (Match*) xcomp_realloc(*distance_encoding, sizeof(Match) * (++(*distance_encoding_cnt)));
-	if (*distance_encoding == NULL) {
-		WARNING_LOG("Failed to xcomp_reallocate buffer for distance_encoding.\n");
-		return -ZLIB_IO_ERROR;
+	candidates_offsets[block_end - block_start] = candidates_cnt;
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Cost in bits of the tokens, including the extra bits of the matches.
+static unsigned long long int tokens_cost(const Match* tokens, unsigned int tokens_cnt, const unsigned char* literal_costs, const unsigned char* distance_costs) {
+
+	unsigned long long int cost = 0;
+	for (unsigned int i = 0; i < tokens_cnt; ++i) {
+		cost += literal_costs[tokens[i].literal];
+		if (tokens[i].literal > 256) cost += length_extra_bits[tokens[i].literal - 257] + distance_costs[tokens[i].distance] + distance_extra_bits[tokens[i].distance];
+	}
+
+	return cost;
+}
+
+/// Derive the cost of each symbol from the Huffman code lengths of the tokens, the unused
+/// symbols get the longest length allowed, as their code would be at least that long.
+static int update_symbol_costs(const Match* tokens, unsigned int tokens_cnt, unsigned char* literal_costs, unsigned char* distance_costs) {
+	BlockHistogram histogram = {0};
+	compute_block_histogram(tokens, tokens_cnt, &histogram);
+
+	int err = 0;
+	HFTree hf_literals = {0};
+	HFTree hf_distances = {0};
+	if ((err = generate_hf_tree(histogram.literals, MAX_HF_SIZE, &hf_literals, HF_MAX_BIT_LENGTH)) < 0 || (err = generate_hf_tree(histogram.distances, MAX_HF_DISTANCE_SIZE, &hf_distances, HF_MAX_BIT_LENGTH)) < 0) {
+		deallocate_hf_tree(&hf_literals);
+		WARNING_LOG("An error occurred while generating the hf_trees for the symbol costs.\n");
+		return err;
 	}
+
+	for (unsigned short int i = 0; i < MAX_HF_SIZE; ++i) literal_costs[i] = (i < hf_literals.size && (hf_literals.lengths)[i]) ? (hf_literals.lengths)[i] : HF_MAX_BIT_LENGTH;
+	for (unsigned short int i = 0; i < MAX_HF_DISTANCE_SIZE; ++i) distance_costs[i] = (i < hf_distances.size && (hf_distances.lengths)[i]) ? (hf_distances.lengths)[i] : HF_MAX_BIT_LENGTH;
 	
-	(*distance_encoding)[*distance_encoding_cnt - 1] = (Match) {0};
-	(*distance_encoding)[*distance_encoding_cnt - 1].literal = BLOCK_DELIMITER;
+	DEALLOCATE_TREES(&hf_literals, &hf_distances);
 
 	return ZLIB_NO_ERROR;
 }
 
-static void update_hf_nodes(HFNode new_node, HFNode* hf_nodes, unsigned int hf_nodes_cnt) {
-	for (unsigned short int i = 0; i < hf_nodes_cnt - 1; ++i) {
-		if ((hf_nodes[i].freq > new_node.freq) || (hf_nodes[i].freq == new_node.freq && hf_nodes[i].symbol > new_node.symbol)) {
-			// Move one to the left the others and insert it
-			mem_move(hf_nodes + i + 1, hf_nodes + i, (hf_nodes_cnt - 1 - i) * sizeof(HFNode));
-			hf_nodes[i] = new_node;	
-			return;
+/// Find the cheapest parsing of the block under the given costs, as a shortest path where each
+/// position is reached either by a literal or by any length up to the one of a candidate match.
+/// The tokens are terminated by the block delimiter.
+static void optimal_parse(const unsigned char* data, unsigned int size, const MatchCandidate* candidates, const unsigned int* candidates_offsets, const unsigned char* literal_costs, const unsigned char* distance_costs, OptimalParseState* state, Match* tokens, unsigned int* tokens_cnt) {
+	
+	unsigned int length_costs[MAX_MATCH_LENGTH + 1] = {0};
+	for (unsigned short int length = MIN_MATCH_LENGTH; length <= MAX_MATCH_LENGTH; ++length) {
+		const unsigned short int literal = create_match(length, 1).literal;
+		length_costs[length] = literal_costs[literal] + length_extra_bits[literal - 257];
+	}
+
+	(state -> costs)[0] = 0;
+	for (unsigned int i = 1; i <= size; ++i) (state -> costs)[i] = 0xFFFFFFFF;
+
+	for (unsigned int i = 0; i < size; ++i) {
+		const unsigned int cost = (state -> costs)[i];
+		if (cost + literal_costs[data[i]] < (state -> costs)[i + 1]) {
+			(state -> costs)[i + 1] = cost + literal_costs[data[i]];
+			(state -> steps)[i + 1] = 1;
 		}
+
+		// Each length is reached with the closest candidate long enough, as the candidates grow in length
+		unsigned short int length = MIN_MATCH_LENGTH;
+		for (unsigned int k = candidates_offsets[i]; k < candidates_offsets[i + 1]; ++k) {
+			const MatchCandidate candidate = candidates[k];
+			const unsigned int distance_cost = cost + distance_costs[candidate.distance_code] + distance_extra_bits[candidate.distance_code];
+			for (; length <= candidate.length; ++length) {
+				const unsigned int match_cost = distance_cost + length_costs[length];
+				if (match_cost >= (state -> costs)[i + length]) continue;
+				(state -> costs)[i + length] = match_cost;
+				(state -> steps)[i + length] = length;
+				(state -> distances)[i + length] = candidate.distance;
+			}
+		}
+	}
+
+	// Walk back the cheapest path, writing the tokens from the end
+	*tokens_cnt = 0;
+	for (unsigned int pos = size; pos > 0; pos -= (state -> steps)[pos]) (*tokens_cnt)++;
+	
+	unsigned int token_ind = *tokens_cnt;
+	for (unsigned int pos = size; pos > 0; pos -= (state -> steps)[pos]) {
+		const unsigned short int step = (state -> steps)[pos];
+		if (step == 1) tokens[--token_ind] = (Match) { .literal = data[pos - 1] };
+		else tokens[--token_ind] = create_match(step, (state -> distances)[pos]);
 	}
-	hf_nodes[hf_nodes_cnt - 1] = new_node;
+
+	tokens[(*tokens_cnt)++] = (Match) { .literal = BLOCK_DELIMITER };
+
 	return;
 }
 
+/// Iterate the optimal parsing, starting from the costs of the fixed codes and feeding each round
+/// the code lengths of the Huffman trees built on the previous parsing, until the cost of the
+/// block stops decreasing, or up to ULTRA_ITERATIONS times.
+static int optimal_length_distance_encoding(DeflateContext* ctx, unsigned int block_start, unsigned int block_end) {
+	int err = 0;
+	if ((err = find_match_candidates(ctx, block_start, block_end)) < 0) {
+		WARNING_LOG("An error occurred while finding the match candidates.\n");
+		return err;
+	}
+
+	unsigned char literal_costs[MAX_HF_SIZE] = {0};
+	unsigned char distance_costs[MAX_HF_DISTANCE_SIZE] = {0};
+	mem_cpy(literal_costs, fixed_hf_literals_lengths, sizeof(literal_costs));
+	mem_cpy(distance_costs, fixed_hf_distances_lengths, sizeof(distance_costs));
+	
+	// Each round parses into the scratch tokens, which are kept only if cheaper than the best so far
+	unsigned long long int best_cost = 0xFFFFFFFFFFFFFFFFULL;
+	for (unsigned char iteration = 0; iteration < ULTRA_ITERATIONS; ++iteration) {
+		unsigned int tokens_cnt = 0;
+		optimal_parse(ctx -> input + block_start, block_end - block_start, ctx -> candidates, ctx -> candidates_offsets, literal_costs, distance_costs, &(ctx -> optimal_state), ctx -> optimal_tokens, &tokens_cnt);
+		if ((err = update_symbol_costs(ctx -> optimal_tokens, tokens_cnt, literal_costs, distance_costs)) < 0) return err;
+		
+		const unsigned long long int cost = tokens_cost(ctx -> optimal_tokens, tokens_cnt, literal_costs, distance_costs);
+		if (cost >= best_cost) break;
+
+		best_cost = cost;
+		mem_cpy(ctx -> tokens, ctx -> optimal_tokens, tokens_cnt * sizeof(Match));
+		ctx -> tokens_cnt = tokens_cnt;
+	}
+	
+	return ZLIB_NO_ERROR;
+}
+
 static int build_hf_table(HFTree* hf_tree) {
 	hf_tree -> table = (unsigned short int*) xcomp_calloc(hf_tree -> size, sizeof(unsigned short int));
 	if (hf_tree -> table == NULL) {
@@ -286,17 +763,23 @@ static int build_hf_table(HFTree* hf_tree) {
 	return ZLIB_NO_ERROR;
 }
 
-// Compute Huffman code lengths from a frequency table
-static int generate_hf_tree(unsigned short int* data_stream, unsigned int data_stream_size, HFTree* hf_tree) {
-	unsigned int frequencies[MAX_HF_SIZE] = {0};
-	for (unsigned int i = 0; i < data_stream_size; ++i) frequencies[data_stream[i]]++;
+static void compute_block_histogram(const Match* tokens, unsigned int tokens_cnt, BlockHistogram* histogram) {
+	mem_set(histogram, 0, sizeof(BlockHistogram));
+	for (unsigned int i = 0; i < tokens_cnt; ++i) {
+		(histogram -> literals)[tokens[i].literal]++;
+		if (tokens[i].literal > 256) (histogram -> distances)[tokens[i].distance]++;
+	}
+	return;
+}
 
-	HFNode hf_nodes[MAX_HF_SIZE] = {0};  // Heap for building the tree
-	unsigned short int hf_nodes_cnt = 0;
-	for (unsigned short int i = 0; i < MAX_HF_SIZE; ++i) {
+// Compute the length-limited Huffman code lengths from the frequencies of the symbols
+static int generate_hf_tree(const unsigned int* frequencies, unsigned short int alphabet_size, HFTree* hf_tree, unsigned char max_bit_length) {
+	unsigned short int symbols_cnt = 0;
+	unsigned short int last_symbol = 0;
+	for (unsigned short int i = 0; i < alphabet_size; ++i) {
 		if (frequencies[i]) {
-			HFNode new_node = (HFNode) { .symbol = i, .freq = frequencies[i] };
-			update_hf_nodes(new_node, hf_nodes, ++hf_nodes_cnt);
+			symbols_cnt++;
+			last_symbol = i;
 			hf_tree -> size = MAX(hf_tree -> size, i + 1);
 		}
 	}
@@ -307,56 +790,22 @@ static int generate_hf_tree(unsigned short int* data_stream, unsigned int data_s
 		return ZLIB_NO_ERROR;
 	}
 
-    // Build Huffman tree (iterative method)
-	unsigned int parent_size = hf_tree -> size;
-	unsigned int* parent = (unsigned int*) xcomp_calloc(parent_size, sizeof(unsigned int));
-	if (parent == NULL) {
-		WARNING_LOG("Failed to allocate buffer for parent.\n");
-		return -ZLIB_IO_ERROR;
-	}
-
-    while (hf_nodes_cnt > 1) {
-        // Take two smallest nodes
-        HFNode left = hf_nodes[0];
-        HFNode right = hf_nodes[1];
-
-        // Remove them from heap
-        mem_move(hf_nodes, hf_nodes + 2, (hf_nodes_cnt - 2) * sizeof(HFNode));
-        hf_nodes_cnt--;
-
-        // Create a new merged node
-        HFNode new_node = (HFNode) { .symbol = parent_size++, .freq = left.freq + right.freq};
-		parent = (unsigned int*) xcomp_realloc(parent, sizeof(unsigned int) * parent_size);
-		if (parent == NULL) {
-			WARNING_LOG("Failed to xcomp_reallocate buffer for parent.\n");
-			return -ZLIB_IO_ERROR;
-		}
-
-		parent[parent_size - 1] = 0;
-
-        // Assign parents for tree traversal
-        parent[left.symbol] = new_node.symbol;
-        parent[right.symbol] = new_node.symbol;
+	// A single symbol gets a one bit code, pair it with another one so that the code is complete
+	if (symbols_cnt == 1) hf_tree -> size = MAX(hf_tree -> size, 2);
 
-		update_hf_nodes(new_node, hf_nodes, hf_nodes_cnt);
-    }
-
-    // Assign bit-lengths from depths
-    hf_tree -> lengths = (unsigned char*) xcomp_calloc(hf_tree -> size, sizeof(unsigned char));
+	hf_tree -> lengths = (unsigned char*) xcomp_calloc(hf_tree -> size, sizeof(unsigned char));
 	if (hf_tree -> lengths == NULL) {
 		WARNING_LOG("Failed to allocate buffer for hf_lengths.\n");
 		return -ZLIB_IO_ERROR;
 	}
 	
-	for (unsigned short int i = 0; i < hf_tree -> size; i++) {
-        unsigned int node = i;
-        while (parent[node]) {
-			((hf_tree -> lengths)[i])++;
-            node = parent[node];
-        }
-    }
-
-	XCOMP_SAFE_FREE(parent);
+	if (huffman_code_lengths(frequencies, hf_tree -> size, max_bit_length, hf_tree -> lengths) < 0) {
+		XCOMP_SAFE_FREE(hf_tree -> lengths);
+		WARNING_LOG("An error occurred while computing the hf code lengths.\n");
+		return -ZLIB_IO_ERROR;
+	}
+	
+	if (symbols_cnt == 1) (hf_tree -> lengths)[last_symbol == 0 ? 1 : 0] = 1;
 
 	int err = 0;
 	if ((err = build_hf_table(hf_tree)) < 0) {
@@ -447,156 +896,152 @@ static int rle_encoding(RLEStream** rle_encoded, unsigned short int* rle_encoded
 	return ZLIB_NO_ERROR;
 }
 
-static int generate_hf_trees(Match* distance_encoded, unsigned int distance_encoded_size, BitStream* buffer, HFTree* hf_literals, HFTree* hf_distances) {
-	unsigned int distance_size = 0;
-	unsigned short int* literals_data = (unsigned short int*) xcomp_calloc(distance_encoded_size, sizeof(unsigned short int));
-	if (literals_data == NULL) {
-		WARNING_LOG("Failed to allocate buffer for literals_data.\n");
-		return -ZLIB_IO_ERROR;
-	}
-
-	unsigned short int* distance_data = (unsigned short int*) xcomp_calloc(distance_encoded_size, sizeof(unsigned short int));
-	if (distance_data == NULL) {
-		XCOMP_SAFE_FREE(literals_data);
-		WARNING_LOG("Failed to allocate buffer for distance_data.\n");
-		return -ZLIB_IO_ERROR;
-	}
+static void deallocate_dynamic_header(DynamicHeader* header) {
+	DEALLOCATE_TREES(&(header -> hf_literals), &(header -> hf_distances), &(header -> hf_code_lengths));
+	XCOMP_SAFE_FREE(header -> rle_encoded);
+	return;
+}
 
-	for (unsigned int i = 0; i < distance_encoded_size; ++i) {
-		literals_data[i] = distance_encoded[i].literal;
-		if (literals_data[i] > 256) distance_data[distance_size++] = distance_encoded[i].distance;
-	}
+/// Build the trees of a dynamic block, without writing anything, so that its cost can be
+/// weighed against the other block types before committing to it.
+static int generate_dynamic_header(const BlockHistogram* histogram, DynamicHeader* header) {
+	mem_set(header, 0, sizeof(DynamicHeader));
 
-	if (distance_size == 0) XCOMP_SAFE_FREE(distance_data);
-	else {
-		distance_data = (unsigned short int*) xcomp_realloc(distance_data, distance_size * sizeof(unsigned short int));
-		if (distance_data == NULL) {
-			XCOMP_SAFE_FREE(literals_data);
-			WARNING_LOG("Failed to xcomp_reallocate buffer for distance_data.\n");
-			return -ZLIB_IO_ERROR;
-		}
-	}
+	// Without any match the distance tree would be empty, so describe it by a complete code of one bit, as zlib does
+	unsigned int distances[MAX_HF_DISTANCE_SIZE] = {0};
+	mem_cpy(distances, histogram -> distances, sizeof(distances));
+	unsigned char has_distances = FALSE;
+	for (unsigned char i = 0; i < MAX_HF_DISTANCE_SIZE && !has_distances; ++i) has_distances = distances[i] > 0;
+	if (!has_distances) distances[0] = 1;
 
-	// Generate the tables
 	int err = 0;
-	if ((err = generate_hf_tree(literals_data, distance_encoded_size, hf_literals)) < 0) {
-		XCOMP_MULTI_FREE(literals_data, distance_data);
+	if ((err = generate_hf_tree(histogram -> literals, MAX_HF_SIZE, &(header -> hf_literals), HF_MAX_BIT_LENGTH)) < 0) {
 		WARNING_LOG("An error occurred while generating the hf_tree for literals.\n");
 		return err;
 	}
 
-	if ((err = generate_hf_tree(distance_data, distance_size, hf_distances)) < 0) {
-		deallocate_hf_tree(hf_literals);
-		XCOMP_MULTI_FREE(literals_data, distance_data);
+	if ((err = generate_hf_tree(distances, MAX_HF_DISTANCE_SIZE, &(header -> hf_distances), HF_MAX_BIT_LENGTH)) < 0) {
+		deallocate_dynamic_header(header);
 		WARNING_LOG("An error occurred while generating the hf_tree for distances.\n");
 		return err;
 	}
 	
-	XCOMP_MULTI_FREE(literals_data, distance_data);
-	
-	RLEStream* rle_encoded = NULL;
-	unsigned short int rle_encoded_size = 0;
-	if ((err = rle_encoding(&rle_encoded, &rle_encoded_size, *hf_literals, *hf_distances)) < 0) {
-		DEALLOCATE_TREES(hf_literals, hf_distances);
+	if ((err = rle_encoding(&(header -> rle_encoded), &(header -> rle_encoded_size), header -> hf_literals, header -> hf_distances)) < 0) {
+		deallocate_dynamic_header(header);
 		WARNING_LOG("An error occurred while rle_encoding.\n");
 		return err;
 	}
 
-	unsigned short int* rle_encoded_data = (unsigned short int*) xcomp_calloc(rle_encoded_size, sizeof(unsigned short int));
-	if (rle_encoded_data == NULL) {
-		DEALLOCATE_TREES(hf_literals, hf_distances);
-		XCOMP_SAFE_FREE(rle_encoded);
-		WARNING_LOG("Failed to allocate buffer for rle_encoded_data.\n");
-		return -ZLIB_IO_ERROR;
-	}
-
-	for (unsigned short int i = 0; i < rle_encoded_size; ++i) rle_encoded_data[i] = rle_encoded[i].value;
+	unsigned int code_lengths_frequencies[HF_TABLE_SIZE] = {0};
+	for (unsigned short int i = 0; i < header -> rle_encoded_size; ++i) code_lengths_frequencies[(header -> rle_encoded)[i].value]++;
 
-	HFTree hf_tree = { .size = HF_TABLE_SIZE };
-	if ((err = generate_hf_tree(rle_encoded_data, rle_encoded_size, &hf_tree)) < 0) {
-		DEALLOCATE_TREES(hf_literals, hf_distances);
-		XCOMP_MULTI_FREE(rle_encoded, rle_encoded_data);
+	header -> hf_code_lengths.size = HF_TABLE_SIZE;
+	if ((err = generate_hf_tree(code_lengths_frequencies, HF_TABLE_SIZE, &(header -> hf_code_lengths), HF_TABLE_MAX_BIT_LENGTH)) < 0) {
+		deallocate_dynamic_header(header);
 		WARNING_LOG("An error occurred while generating the hf_tree for the previous hf.\n");
 		return err;
 	}
 
-	XCOMP_SAFE_FREE(rle_encoded_data);
+	header -> order_size = 18;
+	for (; header -> order_size > 3; --(header -> order_size)) if ((header -> hf_code_lengths.lengths)[order_of_code_lengths[header -> order_size]] > 0) break;
 
-	SAFE_BIT_WRITE(buffer, MAX(257, hf_literals -> size) - 257, 5, CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
-	SAFE_BIT_WRITE(buffer, MAX(1, hf_distances -> size) - 1, 5, CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
+	return ZLIB_NO_ERROR;
+}
 
-	const unsigned char order_of_code_lengths[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-	unsigned char order_size = 18;
-	for (; order_size > 3; --order_size) if ((hf_tree.lengths)[order_of_code_lengths[order_size]] > 0) break;
-	SAFE_BIT_WRITE(buffer, (order_size + 1) - 4, 4, CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
+static int write_dynamic_header(BitStream* buffer, const DynamicHeader* header) {
+	const HFTree* hf_tree = &(header -> hf_code_lengths);
+	SAFE_BIT_WRITE(buffer, MAX(257, header -> hf_literals.size) - 257, 5);
+	SAFE_BIT_WRITE(buffer, MAX(1, header -> hf_distances.size) - 1, 5);
+	SAFE_BIT_WRITE(buffer, (header -> order_size + 1) - 4, 4);
 
-	for (unsigned char i = 0; i <= order_size; ++i) SAFE_BIT_WRITE(buffer, (hf_tree.lengths)[order_of_code_lengths[i]], 3, CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
+	for (unsigned char i = 0; i <= header -> order_size; ++i) SAFE_BIT_WRITE(buffer, (hf_tree -> lengths)[order_of_code_lengths[i]], 3);
 
-	for (unsigned short int i = 0; i < rle_encoded_size; ++i) {
-		unsigned char value = rle_encoded[i].value;
-		unsigned char repeat_cnt = rle_encoded[i].repeat_cnt;
-		SAFE_REV_BIT_WRITE(buffer, (hf_tree.table)[value], (hf_tree.lengths)[value], CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
+	for (unsigned short int i = 0; i < header -> rle_encoded_size; ++i) {
+		unsigned char value = (header -> rle_encoded)[i].value;
+		unsigned char repeat_cnt = (header -> rle_encoded)[i].repeat_cnt;
+		SAFE_REV_BIT_WRITE(buffer, (hf_tree -> table)[value], (hf_tree -> lengths)[value]);
 		if (repeat_cnt) {
-			if (value == 16) SAFE_BIT_WRITE(buffer, repeat_cnt - 3, 2, CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
-			else if (value == 17) SAFE_BIT_WRITE(buffer, repeat_cnt - 3, 3,CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
-			else SAFE_BIT_WRITE(buffer, repeat_cnt - 11, 7, CREATE_CALLBACK(DEALLOCATE_TREES(&hf_tree, hf_literals, hf_distances); XCOMP_SAFE_FREE(rle_encoded)));
+			if (value == 16) SAFE_BIT_WRITE(buffer, repeat_cnt - 3, 2);
+			else if (value == 17) SAFE_BIT_WRITE(buffer, repeat_cnt - 3, 3);
+			else SAFE_BIT_WRITE(buffer, repeat_cnt - 11, 7);
 		} 
 	}
 
-	deallocate_hf_tree(&hf_tree);
-	XCOMP_SAFE_FREE(rle_encoded);
-
 	return ZLIB_NO_ERROR;
 }
 
-static int hf_encode_block(HFTree hf_literals, HFTree hf_distances, Match* distance_encoding, unsigned int distance_encoding_cnt, BitStream* buffer) {
-    const unsigned char lenghts_extra_bits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
-    const unsigned char distances_extra_bits[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+/// Size in bits of what write_dynamic_header would write.
+static unsigned long long int dynamic_header_bits(const DynamicHeader* header) {
+	unsigned long long int bits = 5 + 5 + 4 + 3 * (header -> order_size + 1ULL);
+	for (unsigned short int i = 0; i < header -> rle_encoded_size; ++i) {
+		const RLEStream rle = (header -> rle_encoded)[i];
+		bits += (header -> hf_code_lengths.lengths)[rle.value];
+		if (rle.repeat_cnt) bits += (rle.value == 16) ? 2 : (rle.value == 17) ? 3 : 7;
+	}
+	return bits;
+}
+
+/// Size in bits of the tokens of the histogram encoded through the given trees, extra bits included.
+static unsigned long long int hf_block_bits(const BlockHistogram* histogram, const HFTree* hf_literals, const HFTree* hf_distances) {
+
+	unsigned long long int bits = 0;
+	for (unsigned short int i = 0; i < hf_literals -> size; ++i) {
+		bits += (unsigned long long int) (histogram -> literals)[i] * (hf_literals -> lengths)[i];
+		if (i > 256) bits += (unsigned long long int) (histogram -> literals)[i] * length_extra_bits[i - 257];
+	}
+
+	for (unsigned short int i = 0; i < MIN(hf_distances -> size, HF_DISTANCE_SIZE); ++i) {
+		bits += (unsigned long long int) (histogram -> distances)[i] * ((hf_distances -> lengths)[i] + distance_extra_bits[i]);
+	}
+
+	return bits;
+}
+
+static int hf_encode_block(HFTree hf_literals, HFTree hf_distances, const Match* distance_encoding, unsigned int distance_encoding_cnt, BitStream* buffer) {
 
 	for (unsigned int i = 0; i < distance_encoding_cnt; ++i) {
 		unsigned short int literal = distance_encoding[i].literal;
 		SAFE_REV_BIT_WRITE(buffer, (hf_literals.table)[literal], (hf_literals.lengths)[literal]);
 		if (literal > 256) {
 			unsigned char distance = distance_encoding[i].distance;
-			SAFE_BIT_WRITE(buffer, distance_encoding[i].length_diff, lenghts_extra_bits[literal - 257]);
+			SAFE_BIT_WRITE(buffer, distance_encoding[i].length_diff, length_extra_bits[literal - 257]);
 			SAFE_REV_BIT_WRITE(buffer, (hf_distances.table)[distance], (hf_distances.lengths)[distance]);
-			SAFE_BIT_WRITE(buffer, distance_encoding[i].distance_diff, distances_extra_bits[distance]);
+			SAFE_BIT_WRITE(buffer, distance_encoding[i].distance_diff, distance_extra_bits[distance]);
 		}
 	}
 
 	return ZLIB_NO_ERROR;
 }
 
-static int encode_uncompressed_block(BitStream* compressed_bit_stream, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final) {	
+static int encode_uncompressed_block(BitStream* compressed_bit_stream, const unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final) {	
 	SAFE_BIT_WRITE(compressed_bit_stream, is_final, 3);
 	
-	unsigned short int buffer_len = data_buffer_len & 0xFFFF;
-	XCOMP_BE_CONVERT(&buffer_len, sizeof(unsigned short int));
+	// LEN and NLEN are stored little-endian, as every other deflate field
+	unsigned char buffer_len[4] = { data_buffer_len & 0xFF, (data_buffer_len >> 8) & 0xFF, ~data_buffer_len & 0xFF, (~data_buffer_len >> 8) & 0xFF };
+	SAFE_BYTE_WRITE(compressed_bit_stream, sizeof(unsigned char), 4, buffer_len);
 	
-	SAFE_BYTE_WRITE(compressed_bit_stream, sizeof(unsigned short int), 1, &buffer_len);
-	buffer_len = ~buffer_len;
-	SAFE_BYTE_WRITE(compressed_bit_stream, sizeof(unsigned short int), 1, &buffer_len);
-	
-	XCOMP_BE_CONVERT(data_buffer, data_buffer_len);
 	SAFE_BYTE_WRITE(compressed_bit_stream, sizeof(unsigned char), data_buffer_len, data_buffer);
 	
 	return ZLIB_NO_ERROR;
 }
 
-static int hf_compressed_block(BType method, BitStream* buffer, Match* distance_encoding, unsigned int distance_encoding_cnt, unsigned char is_final) {
+/// The header is the one built by generate_dynamic_header, and it's only used by dynamic blocks.
+/// The tokens are the ones of the block without its delimiter, which is appended here.
+static int hf_compressed_block(BType method, BitStream* buffer, const DynamicHeader* header, const Match* distance_encoding, unsigned int distance_encoding_cnt, unsigned char is_final) {
 	int err = 0;
 
-	// Calculate the Huffman Tree/Table
-	SAFE_NEXT_BIT_WRITE(buffer, is_final, distance_encoding);         		
-	SAFE_BIT_WRITE(buffer, method, 2, XCOMP_SAFE_FREE(distance_encoding));			
+	SAFE_NEXT_BIT_WRITE(buffer, is_final);         		
+	SAFE_BIT_WRITE(buffer, method, 2);			
 
 	HFTree hf_literals = {0};
 	HFTree hf_distances = {0};
 	if (method == COMPRESSED_DYNAMIC_HF) {
-		if ((err = generate_hf_trees(distance_encoding, distance_encoding_cnt, buffer, &hf_literals, &hf_distances)) < 0) {
-			WARNING_LOG("An error occurred while generating hf_tables.\n");
+		if ((err = write_dynamic_header(buffer, header)) < 0) {
+			WARNING_LOG("An error occurred while writing the dynamic header.\n");
 			return err;
 		}
+		hf_literals = header -> hf_literals;
+		hf_distances = header -> hf_distances;
 	} else {
 		FIXED_LITERALS_TREE(hf_literals);
 		FIXED_DISTANCE_TREE(hf_distances);
@@ -604,49 +1049,154 @@ static int hf_compressed_block(BType method, BitStream* buffer, Match* distance_
 
 	// Huffman encode the block, encapsulating it into a DEFLATE block (append block header, encoded data plus the encoded '256' to signal the end of the block)
 	if ((err = hf_encode_block(hf_literals, hf_distances, distance_encoding, distance_encoding_cnt, buffer)) < 0) {
-		if (!hf_literals.is_fixed)  DEALLOCATE_TREES(&hf_literals, &hf_distances);
 		WARNING_LOG("An error occurred while encoding the block.\n");
 		return err;
 	} 
 
-	if (!hf_literals.is_fixed) DEALLOCATE_TREES(&hf_literals, &hf_distances);
+	SAFE_REV_BIT_WRITE(buffer, (hf_literals.table)[BLOCK_DELIMITER], (hf_literals.lengths)[BLOCK_DELIMITER]);
 
 	return ZLIB_NO_ERROR;
 }
 
-static int compress_block(BitStream* compressed_bit_stream, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final) {
+/// Cheap check, linear in the size of the block, of whether it's worth the match finding.
+/// First the collision entropy of the bytes, a lower bound of the Shannon one, must be at least 7.9 bits,
+/// so that the Huffman codes of the literals couldn't save more than 1.25%, then the 4 bytes sequences at the probed
+/// positions must be found again within the window for less than 1/64 of them. The previous blocks are searched through
+/// the hash chains, which hold their positions, while the sampled positions of the block are hashed in a table of its own,
+/// probed at the last sampled position with the same hash. As the steps are coprime, a repetition at any distance lines up
+/// with a sampled position at one probe out of INCOMPRESSIBLE_SAMPLE_STEP, and WINDOW_SIZE bytes back it still survives
+/// in the table about once in e, well above the threshold for data repeating throughout the block.
+static unsigned char is_block_incompressible(const DeflateContext* ctx, unsigned int block_start, unsigned int data_buffer_len) {
+	if (data_buffer_len < INCOMPRESSIBLE_MIN_SIZE) return FALSE;
+
+	// The sampling rejects most of the compressible blocks at a fraction of the cost,
+	// as the repeated sequences would catch anyway a distribution skewed only off the samples
+	const unsigned char* data_buffer = ctx -> input + block_start;
+	unsigned int frequencies[256] = {0};
+	unsigned int samples_cnt = 0;
+	for (unsigned int i = 0; i < data_buffer_len; i += INCOMPRESSIBLE_SAMPLE_STEP, ++samples_cnt) frequencies[data_buffer[i]]++;
+
+	// The sum of the squared frequencies minus the samples is the unbiased estimate of n^2 * sum(p^2),
+	// while a collision entropy of 7.9 bits means 256 * sum(p^2) <= 2^0.1, which is about 1.072
+	unsigned long long int squares_sum = 0;
+	for (unsigned short int i = 0; i < 256; ++i) squares_sum += (unsigned long long int) frequencies[i] * frequencies[i];
+	if ((squares_sum - samples_cnt) * 256 * 1000 > 1072ULL * samples_cnt * samples_cnt) return FALSE;
+
+	const unsigned int* head = ctx -> hash_chains;
+	const unsigned int* prev = head + HASH_SIZE;
+	unsigned short int last_positions[1 << INCOMPRESSIBLE_HASH_BITS] = {0};
+	unsigned int repeats_cnt = 0;
+	unsigned int next_sample = 0;
+	for (unsigned int i = 0; i + sizeof(unsigned long long int) <= data_buffer_len; i += INCOMPRESSIBLE_PROBE_STEP) {
+		// Only the sampled positions before the probed one are hashed, so that it never finds itself
+		for (; next_sample < i; next_sample += INCOMPRESSIBLE_SAMPLE_STEP) {
+			const unsigned int sample_bytes = (unsigned int) xcomp_read_le64(data_buffer + next_sample);
+			last_positions[(sample_bytes * 0x9E3779B1U) >> (32 - INCOMPRESSIBLE_HASH_BITS)] = next_sample;
+		}
+
+		const unsigned int bytes = (unsigned int) xcomp_read_le64(data_buffer + i);
+		const unsigned int last_position = last_positions[(bytes * 0x9E3779B1U) >> (32 - INCOMPRESSIBLE_HASH_BITS)];
+		if (last_position < i && i - last_position <= WINDOW_SIZE && (unsigned int) xcomp_read_le64(data_buffer + last_position) == bytes) {
+			repeats_cnt++;
+			continue;
+		}
+
+		// The chains only hold the positions before the block, as the ones of the block are inserted later on
+		const unsigned int pos = block_start + i;
+		unsigned int candidate = head[hash_match_bytes(data_buffer + i)];
+		for (unsigned char chain = INCOMPRESSIBLE_MAX_CHAIN; candidate != 0 && chain > 0; --chain, candidate = prev[(candidate - 1) & WINDOW_MASK]) {
+			if (pos - (candidate - 1) > WINDOW_SIZE) break;
+			if ((unsigned int) xcomp_read_le64(ctx -> input + candidate - 1) == bytes) {
+				repeats_cnt++;
+				break;
+			}
+		}
+	}
+
+	return repeats_cnt * 64 * INCOMPRESSIBLE_PROBE_STEP < data_buffer_len;
+}
+
+static int compress_block(DeflateContext* ctx, BitStream* compressed_bit_stream, unsigned int block_start, unsigned int data_buffer_len, unsigned char is_final) {
+	const unsigned char* data_buffer = ctx -> input + block_start;
 	int err = 0;
-	Match* distance_encoding = NULL;
-	unsigned int distance_encoding_cnt = 0;
-	if ((err = length_distance_encoding(data_buffer, data_buffer_len, &distance_encoding, &distance_encoding_cnt)) < 0) {
-		WARNING_LOG("An error occurred while performing the length-distance encoding.\n");
-		return err; 
-	}
-	
-	// Static compression
-	BitStream fixed_block_bit_stream = CREATE_BIT_STREAM(NULL, 0);
-	if ((err = hf_compressed_block(COMPRESSED_FIXED_HF, &fixed_block_bit_stream, distance_encoding, distance_encoding_cnt, is_final)) < 0) {
-		XCOMP_SAFE_FREE(distance_encoding);
-		WARNING_LOG("An error occurred while compressing the block using FIXED_HF.\n");
-		return err;
+	
+	// The last WINDOW_SIZE positions of an incompressible block are still inserted in the hash chains, so that the following
+	// blocks can refer to it, while the ones before are already out of their reach
+	if (ctx -> params -> strategy == DEFLATE_STORED || (ctx -> params -> skip_incompressible && is_block_incompressible(ctx, block_start, data_buffer_len))) {
+		if ((err = encode_uncompressed_block(compressed_bit_stream, data_buffer, data_buffer_len, is_final)) < 0) {
+			WARNING_LOG("An error occurred while encoding the uncompressed block.\n");
+			return err;
+		}
+		
+		if (ctx -> hash_chains == NULL) return ZLIB_NO_ERROR;
+		// The bounds are read once, as the stores to the chains could otherwise alias the input size, at least INCOMPRESSIBLE_MIN_SIZE here
+		const unsigned int block_end = MIN(block_start + data_buffer_len, ctx -> input_size - MIN_MATCH_LENGTH + 1);
+		const unsigned char* input = ctx -> input;
+		unsigned int* head = ctx -> hash_chains;
+		for (unsigned int i = block_start + data_buffer_len - MIN(data_buffer_len, (unsigned int) WINDOW_SIZE); i < block_end; ++i) insert_match_position(input, i, head, head + HASH_SIZE);
+		
+		return ZLIB_NO_ERROR;
 	}
+
+	if (ctx -> params -> strategy == DEFLATE_OPTIMAL) {
+		if ((err = optimal_length_distance_encoding(ctx, block_start, block_start + data_buffer_len)) < 0) {
+			WARNING_LOG("An error occurred while performing the optimal parsing.\n");
+			return err; 
+		}
+	} else length_distance_encoding(ctx, block_start, block_start + data_buffer_len);
 	
-	// Dynamic compression
-	BitStream dynamic_block_bit_stream = CREATE_BIT_STREAM(NULL, 0);
-	if ((err = hf_compressed_block(COMPRESSED_DYNAMIC_HF, &dynamic_block_bit_stream, distance_encoding, distance_encoding_cnt, is_final)) < 0) {
-		XCOMP_SAFE_FREE(distance_encoding);
-		deallocate_bit_stream(&fixed_block_bit_stream);
-		WARNING_LOG("An error occurred while compressing the block using DYNAMIC_HF.\n");
+	// The block delimiter is written by each of the blocks the tokens are split into
+	const unsigned int tokens_cnt = ctx -> tokens_cnt - 1;
+	if (!ctx -> params -> split_blocks) return encode_tokens_block(compressed_bit_stream, ctx -> tokens, tokens_cnt, data_buffer, data_buffer_len, is_final);
+
+	unsigned int splits[MAX_BLOCK_SPLITS] = {0};
+	unsigned int splits_cnt = 0;
+	if ((err = split_block_tokens(ctx -> tokens, tokens_cnt, splits, &splits_cnt)) < 0) {
+		WARNING_LOG("An error occurred while splitting the block.\n");
 		return err;
 	}
 
-	XCOMP_SAFE_FREE(distance_encoding);
-	
+	unsigned int split_start = 0;
+	unsigned int split_offset = 0;
+	for (unsigned int i = 0; i < splits_cnt; ++i) {
+		unsigned int split_len = 0;
+		for (unsigned int j = split_start; j < splits[i]; ++j) split_len += match_length((ctx -> tokens)[j]);
+		if ((err = encode_tokens_block(compressed_bit_stream, ctx -> tokens + split_start, splits[i] - split_start, data_buffer + split_offset, split_len, is_final && i == splits_cnt - 1)) < 0) return err;
+		split_start = splits[i];
+		split_offset += split_len;
+	}
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Encode the tokens as the smallest among a stored, fixed or dynamic block, the data being the bytes they stand for.
+static int encode_tokens_block(BitStream* compressed_bit_stream, const Match* tokens, unsigned int tokens_cnt, const unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char is_final) {
+	int err = 0;
+	// Weigh the exact size of each block type from the histogram, so that only the smallest one gets encoded
+	BlockHistogram histogram = {0};
+	compute_block_histogram(tokens, tokens_cnt, &histogram);
+	(histogram.literals)[BLOCK_DELIMITER]++;
+
+	DynamicHeader header = {0};
+	if ((err = generate_dynamic_header(&histogram, &header)) < 0) {
+		WARNING_LOG("An error occurred while generating the dynamic header.\n");
+		return err;
+	}
+
+	HFTree fixed_literals = {0};
+	HFTree fixed_distances = {0};
+	FIXED_LITERALS_TREE(fixed_literals);
+	FIXED_DISTANCE_TREE(fixed_distances);
+
+	const unsigned char block_bit_pos = compressed_bit_stream -> bit_pos;
+	const unsigned long long int fixed_block_bits = 3 + hf_block_bits(&histogram, &fixed_literals, &fixed_distances);
+	const unsigned long long int dynamic_block_bits = 3 + dynamic_header_bits(&header) + hf_block_bits(&histogram, &(header.hf_literals), &(header.hf_distances));
+	const unsigned long long int stored_block_bits = 3 + ((8 - ((block_bit_pos + 3) & 7)) & 7) + 32 + data_buffer_len * 8ULL;
+
 	// Fallback no compression
-	if (fixed_block_bit_stream.size > data_buffer_len + 5 && dynamic_block_bit_stream.size > data_buffer_len + 5) {
-		deallocate_bit_stream(&fixed_block_bit_stream);
-		deallocate_bit_stream(&dynamic_block_bit_stream);
-		printf("compression_method: '%s', decompressed_size: %u\n", btypes_str[NO_COMPRESSION], data_buffer_len);
+	if (fixed_block_bits > stored_block_bits && dynamic_block_bits > stored_block_bits) {
+		deallocate_dynamic_header(&header);
+		DEBUG_LOG("compression_method: '%s', decompressed_size: %u", btypes_str[NO_COMPRESSION], data_buffer_len);
 		if ((err = encode_uncompressed_block(compressed_bit_stream, data_buffer, data_buffer_len, is_final)) < 0) {
 			WARNING_LOG("An error occurred while encoding the uncompressed block.\n");
 			return err;
@@ -654,62 +1204,558 @@ static int compress_block(BitStream* compressed_bit_stream, unsigned char* data_
 		return ZLIB_NO_ERROR;
 	}
 
-	unsigned char is_fixed_better = fixed_block_bit_stream.size <= dynamic_block_bit_stream.size;
-	printf("compression_method: '%s', decompressed_size: %u\n", btypes_str[is_fixed_better ? COMPRESSED_FIXED_HF : COMPRESSED_DYNAMIC_HF], data_buffer_len);
-	BitStream block_bit_stream = is_fixed_better ? fixed_block_bit_stream : dynamic_block_bit_stream;
-	if (is_fixed_better) deallocate_bit_stream(&dynamic_block_bit_stream);
-	else deallocate_bit_stream(&fixed_block_bit_stream);
+	const BType method = (fixed_block_bits <= dynamic_block_bits) ? COMPRESSED_FIXED_HF : COMPRESSED_DYNAMIC_HF;
+	DEBUG_LOG("compression_method: '%s', decompressed_size: %u", btypes_str[method], data_buffer_len);
+	if ((err = hf_compressed_block(method, compressed_bit_stream, &header, tokens, tokens_cnt, is_final)) < 0) {
+		deallocate_dynamic_header(&header);
+		WARNING_LOG("An error occurred while compressing the block using %s.\n", btypes_str[method]);
+		return err;
+	}
 	
-	bitstream_bit_copy(compressed_bit_stream, &block_bit_stream);
-	if (compressed_bit_stream -> error) {
-		if (!is_fixed_better) deallocate_bit_stream(&dynamic_block_bit_stream);
-		else deallocate_bit_stream(&fixed_block_bit_stream);
-		WARNING_LOG("Failed to bit copy the block bitstream into the compressed bitstream.\n");
+	deallocate_dynamic_header(&header);
+
+	return ZLIB_NO_ERROR;
+}
+
+static void combine_block_histograms(BlockHistogram* result, const BlockHistogram* histogram, const BlockHistogram* other, int sign) {
+	for (unsigned short int i = 0; i < MAX_HF_SIZE; ++i) (result -> literals)[i] = (histogram -> literals)[i] + sign * (other -> literals)[i];
+	for (unsigned char i = 0; i < MAX_HF_DISTANCE_SIZE; ++i) (result -> distances)[i] = (histogram -> distances)[i] + sign * (other -> distances)[i];
+	return;
+}
+
+/// Size in bits of the tokens of the histogram as the smaller between a fixed and a dynamic block,
+/// the histogram lacking the block delimiter, which gets counted here.
+static int estimate_block_bits(const BlockHistogram* histogram, unsigned long long int* block_bits) {
+	BlockHistogram block_histogram = *histogram;
+	(block_histogram.literals)[BLOCK_DELIMITER]++;
+
+	int err = 0;
+	DynamicHeader header = {0};
+	if ((err = generate_dynamic_header(&block_histogram, &header)) < 0) return err;
+
+	HFTree fixed_literals = {0};
+	HFTree fixed_distances = {0};
+	FIXED_LITERALS_TREE(fixed_literals);
+	FIXED_DISTANCE_TREE(fixed_distances);
+
+	const unsigned long long int fixed_block_bits = 3 + hf_block_bits(&block_histogram, &fixed_literals, &fixed_distances);
+	const unsigned long long int dynamic_block_bits = 3 + dynamic_header_bits(&header) + hf_block_bits(&block_histogram, &(header.hf_literals), &(header.hf_distances));
+	*block_bits = MIN(fixed_block_bits, dynamic_block_bits);
+	
+	deallocate_dynamic_header(&header);
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Find where the tokens are better encoded by separate blocks, each split being the index of the token ending a block,
+/// the last one being tokens_cnt. A window whose statistics drift from the ones of the current block is the candidate
+/// start of a new block, which is taken only when the two halves cost less than the tokens left encoded as a whole.
+static int split_block_tokens(const Match* tokens, unsigned int tokens_cnt, unsigned int* splits, unsigned int* splits_cnt) {
+	*splits_cnt = 0;
+
+	BlockHistogram total = {0};
+	compute_block_histogram(tokens, tokens_cnt, &total);
+
+	// consumed: the tokens of the blocks already split, current: the ones of the block up to the window
+	BlockHistogram consumed = {0};
+	BlockHistogram current = {0};
+	BlockHistogram window = {0};
+	unsigned int observations[SPLIT_OBSERVATION_TYPES] = {0};
+	unsigned int new_observations[SPLIT_OBSERVATION_TYPES] = {0};
+	unsigned int observations_cnt = 0;
+	unsigned int new_observations_cnt = 0;
+	
+	// The cost of the tokens left as a whole only changes once a split is taken
+	unsigned long long int remaining_bits = 0;
+	unsigned char is_remaining_estimated = FALSE;
+
+	for (unsigned int i = 0; i < tokens_cnt; ++i) {
+		const unsigned short int literal = tokens[i].literal;
+		new_observations[(literal < 256) ? (literal >> 5) : 8 + (literal >= 265)]++;
+		new_observations_cnt++;
+		(window.literals)[literal]++;
+		if (literal > 256) (window.distances)[tokens[i].distance]++;
+		
+		if (new_observations_cnt < SPLIT_WINDOW_SIZE || i + 1 == tokens_cnt) continue;
+		
+		unsigned long long int total_delta = 0;
+		for (unsigned char j = 0; j < SPLIT_OBSERVATION_TYPES; ++j) {
+			const unsigned long long int expected = (unsigned long long int) observations[j] * new_observations_cnt;
+			const unsigned long long int actual = (unsigned long long int) new_observations[j] * observations_cnt;
+			total_delta += (actual > expected) ? actual - expected : expected - actual;
+		}
+
+		unsigned char is_split = FALSE;
+		if (observations_cnt > 0 && total_delta * 512 >= (unsigned long long int) SPLIT_SHIFT_THRESHOLD * new_observations_cnt * observations_cnt) {
+			BlockHistogram remaining = {0};
+			BlockHistogram rest = {0};
+			combine_block_histograms(&remaining, &total, &consumed, -1);
+			combine_block_histograms(&rest, &remaining, &current, -1);
+			
+			int err = 0;
+			unsigned long long int current_bits = 0;
+			unsigned long long int rest_bits = 0;
+			if ((err = estimate_block_bits(&current, &current_bits)) < 0 || (err = estimate_block_bits(&rest, &rest_bits)) < 0 || (!is_remaining_estimated && (err = estimate_block_bits(&remaining, &remaining_bits)) < 0)) {
+				WARNING_LOG("An error occurred while estimating the size of the blocks.\n");
+				return err;
+			}
+			
+			is_remaining_estimated = TRUE;
+			is_split = current_bits + rest_bits < remaining_bits;
+		}
+
+		if (is_split) {
+			splits[(*splits_cnt)++] = i + 1 - new_observations_cnt;
+			is_remaining_estimated = FALSE;
+			combine_block_histograms(&consumed, &consumed, &current, 1);
+			current = window;
+			mem_cpy(observations, new_observations, sizeof(observations));
+			observations_cnt = new_observations_cnt;
+		} else {
+			combine_block_histograms(&current, &current, &window, 1);
+			for (unsigned char j = 0; j < SPLIT_OBSERVATION_TYPES; ++j) observations[j] += new_observations[j];
+			observations_cnt += new_observations_cnt;
+		}
+		
+		mem_set(&window, 0, sizeof(BlockHistogram));
+		mem_set(new_observations, 0, sizeof(new_observations));
+		new_observations_cnt = 0;
+	}
+
+	splits[(*splits_cnt)++] = tokens_cnt;
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Split [buffer_offset, buffer_offset + data_buffer_len) of the input of the context in blocks of DEFLATE_BLOCK_SIZE,
+/// compressing each of them into the raw deflate stream, where the chains already hold the positions before them.
+/// The last block is marked as final only if is_last is set.
+/// The Adler-32 of the data, unless NULL, is updated block by block, while each of them is still in cache.
+static int deflate_input_blocks(DeflateContext* ctx, BitStream* compressed_bit_stream, unsigned int buffer_offset, unsigned int data_buffer_len, unsigned char is_last, unsigned int* adler) {
+	int err = 0;
+#ifdef _DEBUG
+	unsigned int block_cnt = 0;
+#endif //_DEBUG
+	while (data_buffer_len > 0) {
+		const unsigned int block_len = MIN(data_buffer_len, (unsigned int) DEFLATE_BLOCK_SIZE);
+		const unsigned char is_final = is_last && data_buffer_len == block_len;
+		DEBUG_LOG("Block %u: is_final: %u, ", ++block_cnt, is_final);
+		if ((err = compress_block(ctx, compressed_bit_stream, buffer_offset, block_len, is_final)) < 0) return err;
+		if (adler != NULL) *adler = xcomp_adler32(ctx -> input + buffer_offset, block_len, *adler);
+		data_buffer_len -= block_len;
+		buffer_offset += block_len;
+	}
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Compress the data into the raw deflate stream, while the matches can refer to the whole window preceding them,
+/// including the history_len bytes before the data, which are only used as a dictionary.
+/// The last block is marked as final only if is_last is set, and the Adler-32 updated as by deflate_input_blocks.
+static int deflate_chunk(DeflateContext* ctx, BitStream* compressed_bit_stream, const unsigned char* data_buffer, unsigned int history_len, unsigned int data_buffer_len, unsigned char is_last, unsigned int* adler) {
+	// An empty input still needs a final block: a fixed one with just the end of block code
+	if (data_buffer_len == 0) {
+		SAFE_BIT_WRITE(compressed_bit_stream, (COMPRESSED_FIXED_HF << 1) | (is_last != FALSE), 3);
+		SAFE_BIT_WRITE(compressed_bit_stream, 0, 7);
+		return ZLIB_NO_ERROR;
+	}
+
+	// The history starts with each call, and only the heads need to be cleared, as a link is always written before being followed
+	ctx -> input = data_buffer - history_len;
+	ctx -> input_size = history_len + data_buffer_len;
+	if (ctx -> hash_chains != NULL) {
+		mem_set(ctx -> hash_chains, 0, HASH_SIZE * sizeof(unsigned int));
+		for (unsigned int i = 0; i < history_len && i + MIN_MATCH_LENGTH <= ctx -> input_size; ++i) insert_match_position(ctx -> input, i, ctx -> hash_chains, ctx -> hash_chains + HASH_SIZE);
+	}
+
+	return deflate_input_blocks(ctx, compressed_bit_stream, history_len, data_buffer_len, is_last, adler);
+}
+
+static int deflate_blocks(DeflateContext* ctx, BitStream* compressed_bit_stream, const unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* adler) {
+	return deflate_chunk(ctx, compressed_bit_stream, data_buffer, 0, data_buffer_len, TRUE, adler);
+}
+
+/// CMF and FLG of the zlib stream: deflate with a 32K window, and the level hinted by FLEVEL,
+/// while FCHECK makes the two bytes, read as a big-endian number, a multiple of 31.
+static void zlib_header_bytes(unsigned char level, unsigned char* header) {
+	const unsigned char flevel = (level <= ZLIB_BEST_SPEED) ? 0 : (level < ZLIB_DEFAULT_COMPRESSION) ? 1 : (level == ZLIB_DEFAULT_COMPRESSION) ? 2 : 3;
+	header[0] = 0x78;
+	header[1] = flevel << 6;
+	header[1] |= 31 - ((header[0] * 256 + header[1]) % 31);
+	return;
+}
+
+int init_deflate_context(DeflateContext* ctx, unsigned char level) {
+	mem_set(ctx, 0, sizeof(DeflateContext));
+	if (level > ZLIB_ULTRA_COMPRESSION) {
+		WARNING_LOG("Invalid compression level %u, expected at most %u.\n", level, ZLIB_ULTRA_COMPRESSION);
+		return -ZLIB_INVALID_COMPRESSION_LEVEL;
+	}
+	
+	ctx -> params = deflate_level_params + level;
+	ctx -> level = level;
+	if (ctx -> params -> strategy == DEFLATE_STORED) return ZLIB_NO_ERROR;
+
+	// The worst case of a block is a literal per byte, plus the block delimiter,
+	// while the chains hold the heads followed by a link for each position of the window
+	ctx -> tokens = (Match*) xcomp_calloc(DEFLATE_BLOCK_SIZE + 1, sizeof(Match));
+	ctx -> hash_chains = (unsigned int*) xcomp_calloc(HASH_SIZE + WINDOW_SIZE, sizeof(unsigned int));
+	if (ctx -> tokens == NULL || ctx -> hash_chains == NULL) {
+		deallocate_deflate_context(ctx);
+		WARNING_LOG("Failed to allocate the buffers of the deflate context.\n");
 		return -ZLIB_IO_ERROR;
 	}
 
-	// Deallocate the one the bit_stream actually used
-	if (!is_fixed_better) deallocate_bit_stream(&dynamic_block_bit_stream);
-	else deallocate_bit_stream(&fixed_block_bit_stream);
+	if (ctx -> params -> strategy != DEFLATE_OPTIMAL) return ZLIB_NO_ERROR;
+	
+	ctx -> candidates_capacity = DEFLATE_BLOCK_SIZE + 1;
+	ctx -> candidates = (MatchCandidate*) xcomp_calloc(ctx -> candidates_capacity, sizeof(MatchCandidate));
+	ctx -> candidates_offsets = (unsigned int*) xcomp_calloc(DEFLATE_BLOCK_SIZE + 1, sizeof(unsigned int));
+	ctx -> optimal_state.costs = (unsigned int*) xcomp_calloc(DEFLATE_BLOCK_SIZE + 1, sizeof(unsigned int));
+	ctx -> optimal_state.steps = (unsigned short int*) xcomp_calloc(DEFLATE_BLOCK_SIZE + 1, sizeof(unsigned short int));
+	ctx -> optimal_state.distances = (unsigned short int*) xcomp_calloc(DEFLATE_BLOCK_SIZE + 1, sizeof(unsigned short int));
+	ctx -> optimal_tokens = (Match*) xcomp_calloc(DEFLATE_BLOCK_SIZE + 1, sizeof(Match));
+	if (ctx -> candidates == NULL || ctx -> candidates_offsets == NULL || ctx -> optimal_state.costs == NULL || ctx -> optimal_state.steps == NULL || ctx -> optimal_state.distances == NULL || ctx -> optimal_tokens == NULL) {
+		deallocate_deflate_context(ctx);
+		WARNING_LOG("Failed to allocate the optimal parsing buffers of the deflate context.\n");
+		return -ZLIB_IO_ERROR;
+	}
 
 	return ZLIB_NO_ERROR;
 }
 
-// TODO: Rename the following to deflate_deflate and create the zlib_deflate function following RFC 1950
-unsigned char* zlib_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* compressed_data_len, int* zlib_err) {
+void deallocate_deflate_context(DeflateContext* ctx) {
+	XCOMP_MULTI_FREE(ctx -> tokens, ctx -> hash_chains, ctx -> candidates, ctx -> candidates_offsets, ctx -> optimal_state.costs, ctx -> optimal_state.steps, ctx -> optimal_state.distances, ctx -> optimal_tokens);
+	mem_set(ctx, 0, sizeof(DeflateContext));
+	return;
+}
+
+static unsigned char* deflate_data_with_context(DeflateContext* ctx, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char has_zlib_wrapper, unsigned int* compressed_data_len, int* zlib_err) {
 	*compressed_data_len = 0;
 	BitStream compressed_bit_stream = CREATE_BIT_STREAM(NULL, 0);
-	*zlib_err = -ZLIB_NO_ERROR;
 	
-	// Fragment the data in block of WINDOW_SIZE
-	unsigned int buffer_offset = 0;
-#ifdef _DEBUG
-	unsigned int block_cnt = 0;
-#endif //_DEBUG
-	while (data_buffer_len >= WINDOW_SIZE) {
-		DEBUG_LOG("Block %u: is_final: %u, ", ++block_cnt, data_buffer_len == WINDOW_SIZE);
-		if ((*zlib_err = compress_block(&compressed_bit_stream, data_buffer + buffer_offset, WINDOW_SIZE, data_buffer_len == WINDOW_SIZE)) < 0) {
-			XCOMP_SAFE_FREE(data_buffer);
-			deallocate_bit_stream(&compressed_bit_stream);
-			return ((unsigned char*) "An error occurred while compressing the block.\n");
-		}
-		data_buffer_len -= WINDOW_SIZE;
-		buffer_offset += WINDOW_SIZE;
+	unsigned char header[2] = {0};
+	zlib_header_bytes(ctx -> level, header);
+	if (has_zlib_wrapper) bitstream_write_bytes(&compressed_bit_stream, sizeof(unsigned char), 2, header);
+	
+	unsigned int adler = 1;
+	if (compressed_bit_stream.error || (*zlib_err = deflate_blocks(ctx, &compressed_bit_stream, data_buffer, data_buffer_len, has_zlib_wrapper ? &adler : NULL)) < 0) {
+		XCOMP_SAFE_FREE(data_buffer);
+		deallocate_bit_stream(&compressed_bit_stream);
+		if (compressed_bit_stream.error) *zlib_err = -ZLIB_IO_ERROR;
+		return ((unsigned char*) "An error occurred while compressing the block.\n");
+	}
+
+	XCOMP_SAFE_FREE(data_buffer);
+	
+	const unsigned char trailer[4] = { (adler >> 24) & 0xFF, (adler >> 16) & 0xFF, (adler >> 8) & 0xFF, adler & 0xFF };
+	if (has_zlib_wrapper) bitstream_write_bytes(&compressed_bit_stream, sizeof(unsigned char), 4, trailer);
+	if (compressed_bit_stream.error) {
+		deallocate_bit_stream(&compressed_bit_stream);
+		*zlib_err = -ZLIB_IO_ERROR;
+		return ((unsigned char*) "An error occurred while writing the zlib trailer.\n");
 	}
 	
-	if (data_buffer_len > 0) {
-		DEBUG_LOG("Block %u: is_final: 1, ", ++block_cnt);
-		if ((*zlib_err = compress_block(&compressed_bit_stream, data_buffer + buffer_offset, data_buffer_len, TRUE)) < 0) {
-			XCOMP_SAFE_FREE(data_buffer);
-			deallocate_bit_stream(&compressed_bit_stream);
-			return ((unsigned char*) "An error occurred while compressing the block.\n");
+	*compressed_data_len = compressed_bit_stream.size;
+	return compressed_bit_stream.stream;
+}
+
+static unsigned char* deflate_data(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned char has_zlib_wrapper, unsigned int* compressed_data_len, int* zlib_err) {
+	*compressed_data_len = 0;
+	DeflateContext ctx = {0};
+	if ((*zlib_err = init_deflate_context(&ctx, level)) < 0) {
+		XCOMP_SAFE_FREE(data_buffer);
+		return ((unsigned char*) "An error occurred while initializing the deflate context.\n");
+	}
+
+	unsigned char* compressed_data = deflate_data_with_context(&ctx, data_buffer, data_buffer_len, has_zlib_wrapper, compressed_data_len, zlib_err);
+	deallocate_deflate_context(&ctx);
+	
+	return compressed_data;
+}
+
+unsigned char* deflate_deflate_with_context(DeflateContext* ctx, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* compressed_data_len, int* zlib_err) {
+	return deflate_data_with_context(ctx, data_buffer, data_buffer_len, FALSE, compressed_data_len, zlib_err);
+}
+
+unsigned char* zlib_deflate_with_context(DeflateContext* ctx, unsigned char* data_buffer, unsigned int data_buffer_len, unsigned int* compressed_data_len, int* zlib_err) {
+	return deflate_data_with_context(ctx, data_buffer, data_buffer_len, TRUE, compressed_data_len, zlib_err);
+}
+
+unsigned char* deflate_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned int* compressed_data_len, int* zlib_err) {
+	return deflate_data(data_buffer, data_buffer_len, level, FALSE, compressed_data_len, zlib_err);
+}
+
+unsigned char* zlib_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned int* compressed_data_len, int* zlib_err) {
+	return deflate_data(data_buffer, data_buffer_len, level, TRUE, compressed_data_len, zlib_err);
+}
+
+/// Forget the history of the stream, for a full flush, where only the heads of the chains need to be cleared.
+static void reset_deflate_stream_history(ZLIBDeflateStream* stream) {
+	if (stream -> ctx.hash_chains != NULL) mem_set(stream -> ctx.hash_chains, 0, HASH_SIZE * sizeof(unsigned int));
+	stream -> history_len = 0;
+	stream -> hashed_len = 0;
+	return;
+}
+
+/// Once the history outgrows DEFLATE_STREAM_HISTORY_SIZE, move its last bytes back to the start of the window,
+/// by a multiple of WINDOW_SIZE, rebasing the positions of the chains and dropping the ones left behind.
+static void slide_deflate_stream_window(ZLIBDeflateStream* stream) {
+	if (stream -> history_len <= DEFLATE_STREAM_HISTORY_SIZE) return;
+	
+	const unsigned int offset = (stream -> history_len - WINDOW_SIZE) & ~WINDOW_MASK;
+	mem_move(stream -> window, stream -> window + offset, stream -> history_len - offset);
+	stream -> history_len -= offset;
+	stream -> hashed_len -= offset;
+	
+	unsigned int* hash_chains = stream -> ctx.hash_chains;
+	if (hash_chains == NULL) return;
+	for (unsigned int i = 0; i < HASH_SIZE + WINDOW_SIZE; ++i) hash_chains[i] = (hash_chains[i] > offset) ? hash_chains[i] - offset : 0;
+
+	return;
+}
+
+/// Compress the pending bytes of the window, which become part of its history, the chains already
+/// holding the positions of the previous calls, but the last ones which could not be hashed back then.
+static int deflate_stream_pending(ZLIBDeflateStream* stream, unsigned char is_last) {
+	DeflateContext* ctx = &(stream -> ctx);
+	if (stream -> pending_len == 0) return is_last ? deflate_chunk(ctx, &(stream -> output), stream -> window, 0, 0, TRUE, NULL) : ZLIB_NO_ERROR;
+	
+	ctx -> input = stream -> window;
+	ctx -> input_size = stream -> history_len + stream -> pending_len;
+	if (ctx -> hash_chains != NULL) {
+		for (unsigned int i = stream -> hashed_len; i < stream -> history_len && i + MIN_MATCH_LENGTH <= ctx -> input_size; ++i) insert_match_position(ctx -> input, i, ctx -> hash_chains, ctx -> hash_chains + HASH_SIZE);
+	}
+	
+	int err = 0;
+	if ((err = deflate_input_blocks(ctx, &(stream -> output), stream -> history_len, stream -> pending_len, is_last, stream -> has_zlib_wrapper ? &(stream -> adler) : NULL)) < 0) {
+		WARNING_LOG("An error occurred while compressing the pending data of the stream.\n");
+		return err;
+	}
+
+	stream -> history_len = ctx -> input_size;
+	stream -> hashed_len = ctx -> input_size - MIN(ctx -> input_size, (unsigned int) (MIN_MATCH_LENGTH - 1));
+	stream -> pending_len = 0;
+	slide_deflate_stream_window(stream);
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Copy out the completed bytes of the output, and the last partial one once the stream is finished,
+/// then move the pending bits back to the start of the output once everything before them is drained.
+static void drain_deflate_stream(ZLIBDeflateStream* stream, unsigned char* out, unsigned int out_size, unsigned int* produced) {
+	BitStream* output = &(stream -> output);
+	const unsigned int completed = stream -> is_finished ? output -> size : output -> byte_pos;
+	const unsigned int drained = MIN(completed - stream -> output_pos, out_size - *produced);
+	mem_cpy(out + *produced, output -> stream + stream -> output_pos, drained);
+	stream -> output_pos += drained;
+	*produced += drained;
+	
+	if (stream -> is_finished || stream -> output_pos < output -> byte_pos) return;
+	
+	if (output -> bit_pos > 0) (output -> stream)[0] = (output -> stream)[output -> byte_pos];
+	output -> byte_pos = 0;
+	output -> size = (output -> bit_pos > 0);
+	stream -> output_pos = 0;
+
+	return;
+}
+
+int zlib_deflate_stream_init(ZLIBDeflateStream* stream, unsigned char level, unsigned char has_zlib_wrapper) {
+	mem_set(stream, 0, sizeof(ZLIBDeflateStream));
+	
+	int err = 0;
+	if ((err = init_deflate_context(&(stream -> ctx), level)) < 0) return err;
+
+	stream -> window = (unsigned char*) xcomp_calloc(DEFLATE_STREAM_HISTORY_SIZE + DEFLATE_BLOCK_SIZE, sizeof(unsigned char));
+	if (stream -> window == NULL) {
+		deallocate_deflate_context(&(stream -> ctx));
+		WARNING_LOG("Failed to allocate the window of the deflate stream.\n");
+		return -ZLIB_IO_ERROR;
+	}
+
+	stream -> output = CREATE_BIT_STREAM(NULL, 0);
+	stream -> adler = 1;
+	stream -> has_zlib_wrapper = has_zlib_wrapper;
+	
+	if (has_zlib_wrapper) {
+		unsigned char header[2] = {0};
+		zlib_header_bytes(level, header);
+		bitstream_write_bytes(&(stream -> output), sizeof(unsigned char), 2, header);
+		if (stream -> output.error) {
+			zlib_deflate_stream_end(stream);
+			WARNING_LOG("Failed to write the zlib header of the deflate stream.\n");
+			return -ZLIB_IO_ERROR;
 		}
 	}
 
-	XCOMP_SAFE_FREE(data_buffer);
+	return ZLIB_NO_ERROR;
+}
+
+void zlib_deflate_stream_end(ZLIBDeflateStream* stream) {
+	deallocate_deflate_context(&(stream -> ctx));
+	deallocate_bit_stream(&(stream -> output));
+	XCOMP_SAFE_FREE(stream -> window);
+	stream -> history_len = 0;
+	stream -> pending_len = 0;
+	stream -> hashed_len = 0;
+	stream -> output_pos = 0;
+	return;
+}
+
+int zlib_deflate_stream(ZLIBDeflateStream* stream, const unsigned char* data, unsigned int size, unsigned int* consumed, unsigned char* out, unsigned int out_size, unsigned int* produced, ZlibFlushMode flush) {
+	*consumed = 0;
+	*produced = 0;
+	if (stream -> window == NULL) {
+		WARNING_LOG("The deflate stream is not initialized.\n");
+		return -ZLIB_IO_ERROR;
+	}
+
+	// A new block is compressed only once the output of the previous ones is drained,
+	// so that at most the output of a single block is ever held by the stream
+	int err = 0;
+	drain_deflate_stream(stream, out, out_size, produced);
+	while (!(stream -> is_finished) && stream -> output_pos == stream -> output.byte_pos) {
+		const unsigned int taken = MIN(size - *consumed, DEFLATE_BLOCK_SIZE - stream -> pending_len);
+		if (taken > 0) {
+			mem_cpy(stream -> window + stream -> history_len + stream -> pending_len, data + *consumed, taken);
+			stream -> pending_len += taken;
+			*consumed += taken;
+			stream -> is_flushed = FALSE;
+		}
+		
+		// A full window is compressed only when more input follows, so that the final block can still take it
+		if (*consumed < size) {
+			if ((err = deflate_stream_pending(stream, FALSE)) < 0) return err;
+		} else if (flush == ZLIB_FINISH) {
+			if ((err = deflate_stream_pending(stream, TRUE)) < 0) return err;
+			if (stream -> has_zlib_wrapper) {
+				const unsigned char trailer[4] = { (stream -> adler >> 24) & 0xFF, (stream -> adler >> 16) & 0xFF, (stream -> adler >> 8) & 0xFF, stream -> adler & 0xFF };
+				SAFE_BYTE_WRITE(&(stream -> output), sizeof(unsigned char), 4, trailer);
+			}
+			stream -> is_finished = TRUE;
+		} else if (flush != ZLIB_NO_FLUSH) {
+			// An empty stored block brings the output to a byte boundary, once per flush
+			if (!(stream -> is_flushed)) {
+				if ((err = deflate_stream_pending(stream, FALSE)) < 0 || (err = encode_uncompressed_block(&(stream -> output), stream -> window, 0, FALSE)) < 0) return err;
+				stream -> is_flushed = TRUE;
+			}
+			
+			if (flush == ZLIB_FULL_FLUSH && stream -> history_len > 0) reset_deflate_stream_history(stream);
+			drain_deflate_stream(stream, out, out_size, produced);
+			break;
+		} else break;
+
+		drain_deflate_stream(stream, out, out_size, produced);
+	}
+
+	if (stream -> is_finished && stream -> output_pos == stream -> output.size) return ZLIB_STREAM_END;
+
+	return ZLIB_STREAM_CONTINUE;
+}
+
+#ifdef _XCOMP_PARALLEL_DEFLATE_
+static void* parallel_deflate_worker(void* arg) {
+	ParallelDeflateState* state = (ParallelDeflateState*) arg;
+	
+	DeflateContext ctx = {0};
+	int err = init_deflate_context(&ctx, state -> level);
+	while (err == ZLIB_NO_ERROR) {
+		pthread_mutex_lock(&(state -> lock));
+		const unsigned int chunk_index = (state -> next_chunk)++;
+		const unsigned char has_failed = state -> err < 0;
+		pthread_mutex_unlock(&(state -> lock));
+		if (has_failed || chunk_index >= state -> chunks_cnt) break;
+
+		DeflateChunk* chunk = state -> chunks + chunk_index;
+		const unsigned char* chunk_data = state -> data_buffer + chunk_index * PARALLEL_CHUNK_SIZE;
+		const unsigned int history_len = MIN(chunk_index * PARALLEL_CHUNK_SIZE, (unsigned int) WINDOW_SIZE);
+		const unsigned char is_last = chunk_index == state -> chunks_cnt - 1;
+		if ((err = deflate_chunk(&ctx, &(chunk -> compressed_bit_stream), chunk_data, history_len, chunk -> size, is_last, &(chunk -> adler))) < 0) break;
+		
+		// An empty stored block brings the chunk to a byte boundary, so that the next one can just follow it
+		if (!is_last && (err = encode_uncompressed_block(&(chunk -> compressed_bit_stream), chunk_data, 0, FALSE)) < 0) break;
+	}
+
+	deallocate_deflate_context(&ctx);
+
+	if (err < 0) {
+		pthread_mutex_lock(&(state -> lock));
+		if (state -> err == ZLIB_NO_ERROR) state -> err = err;
+		pthread_mutex_unlock(&(state -> lock));
+	}
+
+	return NULL;
+}
+
+unsigned char* zlib_deflate_parallel(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned char threads_cnt, unsigned int* compressed_data_len, int* zlib_err) {
+	*compressed_data_len = 0;
+	if (level > ZLIB_ULTRA_COMPRESSION) {
+		XCOMP_SAFE_FREE(data_buffer);
+		WARNING_LOG("Invalid compression level %u, expected at most %u.\n", level, ZLIB_ULTRA_COMPRESSION);
+		*zlib_err = -ZLIB_INVALID_COMPRESSION_LEVEL;
+		return ((unsigned char*) "An error occurred while initializing the deflate context.\n");
+	}
+
+	ParallelDeflateState state = { .data_buffer = data_buffer, .level = level, .chunks_cnt = MAX((data_buffer_len + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE, 1U) };
+	state.chunks = (DeflateChunk*) xcomp_calloc(state.chunks_cnt, sizeof(DeflateChunk));
+	pthread_t* threads = (pthread_t*) xcomp_calloc(MAX(threads_cnt, 1), sizeof(pthread_t));
+	if (state.chunks == NULL || threads == NULL) {
+		XCOMP_MULTI_FREE(data_buffer, state.chunks, threads);
+		*zlib_err = -ZLIB_IO_ERROR;
+		return ((unsigned char*) "Failed to allocate the buffers of the parallel deflate.\n");
+	}
+
+	for (unsigned int i = 0; i < state.chunks_cnt; ++i) {
+		(state.chunks)[i].compressed_bit_stream = CREATE_BIT_STREAM(NULL, 0);
+		(state.chunks)[i].adler = 1;
+		(state.chunks)[i].size = MIN(data_buffer_len - i * PARALLEL_CHUNK_SIZE, (unsigned int) PARALLEL_CHUNK_SIZE);
+	}
+
+	pthread_mutex_init(&(state.lock), NULL);
 	
+	// Any thread which fails to start just leaves its share of the chunks to the others
+	unsigned char started_cnt = 0;
+	const unsigned char workers_cnt = MIN(MAX(threads_cnt, 1), state.chunks_cnt);
+	for (unsigned char i = 0; i < workers_cnt; ++i) {
+		if (pthread_create(threads + started_cnt, NULL, parallel_deflate_worker, &state) == 0) started_cnt++;
+	}
+
+	if (started_cnt == 0) parallel_deflate_worker(&state);
+	for (unsigned char i = 0; i < started_cnt; ++i) pthread_join(threads[i], NULL);
+	
+	pthread_mutex_destroy(&(state.lock));
+	XCOMP_MULTI_FREE(data_buffer, threads);
+
+	// Join the chunks between the zlib header and the Adler-32 of the whole data, combined from the ones of the chunks
+	unsigned char header[2] = {0};
+	zlib_header_bytes(level, header);
+	BitStream compressed_bit_stream = CREATE_BIT_STREAM(NULL, 0);
+	bitstream_write_bytes(&compressed_bit_stream, sizeof(unsigned char), 2, header);
+	
+	unsigned int adler = 1;
+	for (unsigned int i = 0; i < state.chunks_cnt; ++i) {
+		const DeflateChunk* chunk = state.chunks + i;
+		if (state.err == ZLIB_NO_ERROR) bitstream_write_bytes(&compressed_bit_stream, sizeof(unsigned char), chunk -> compressed_bit_stream.size, chunk -> compressed_bit_stream.stream);
+		adler = xcomp_adler32_combine(adler, chunk -> adler, chunk -> size);
+		deallocate_bit_stream(&((state.chunks)[i].compressed_bit_stream));
+	}
+
+	XCOMP_SAFE_FREE(state.chunks);
+
+	const unsigned char trailer[4] = { (adler >> 24) & 0xFF, (adler >> 16) & 0xFF, (adler >> 8) & 0xFF, adler & 0xFF };
+	bitstream_write_bytes(&compressed_bit_stream, sizeof(unsigned char), 4, trailer);
+	
+	if (state.err < 0 || compressed_bit_stream.error) {
+		deallocate_bit_stream(&compressed_bit_stream);
+		*zlib_err = (state.err < 0) ? state.err : -ZLIB_IO_ERROR;
+		return ((unsigned char*) "An error occurred while compressing the chunks.\n");
+	}
+
+	*zlib_err = ZLIB_NO_ERROR;
 	*compressed_data_len = compressed_bit_stream.size;
 	return compressed_bit_stream.stream;
 }
+#endif //_XCOMP_PARALLEL_DEFLATE_
 
 #endif
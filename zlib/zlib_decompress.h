@@ -32,15 +32,37 @@
 		deallocate_hf_table(hf_b);      \
 	} while (FALSE)      		
 
+// The fast loop refills its bit buffer with a whole word, and copies the
+// matches in wide chunks, which may spill a few bytes past their length.
+#define FAST_INPUT_SLACK  sizeof(unsigned long long int)
+#define FAST_OUTPUT_SLACK (258 + 2 * sizeof(unsigned long long int))
+
+// A header split across two input chunks is carried over, the largest one
+// (a dynamic block header) takes less than 600 bytes, and the chunk topping
+// it up must fit as well.
+#define INFLATE_PENDING_SIZE 2048
+
+#define NEED_BITS(bit_stream, n_bits) 															\
+	do {																						\
+		if (bitstream_available_bits(bit_stream) < (unsigned long long int) (n_bits)) return -ZLIB_NEED_MORE_INPUT;	\
+	} while (FALSE)
+
 /* ---------------------------------------------------------------------------------------------------------- */
 // ---------
 //  Structs
 // ---------
+/// A table entry either holds a decoded symbol with the length of its code, or,
+/// when sub_bits is set, the offset of the sub-table indexed by the next sub_bits bits.
+typedef struct HFEntry {
+	unsigned short int value;
+	unsigned char length;
+	unsigned char sub_bits;
+} HFEntry;
+
 typedef struct HFTable {
-	unsigned short int** values;
-    unsigned short int* min_codes;
-    unsigned short int* max_codes;
-    unsigned char max_bit_length;
+	HFEntry* entries;
+	unsigned char primary_bits;
+	unsigned char max_bit_length;
 	unsigned char is_fixed_hf;
 } HFTable;
 
@@ -54,6 +76,7 @@ typedef struct {
 	unsigned char* data;
 	unsigned int size;
 	unsigned int pos;
+	unsigned int checked_pos;
 } ZLIBBuffer; 
 
 typedef struct {
@@ -69,42 +92,121 @@ typedef struct {
     unsigned char compression_level;
 } zlib_header_t;
 
+typedef enum PACKED_STRUCT InflateState {
+	INFLATE_ZLIB_HEADER,
+	INFLATE_BLOCK_HEADER,
+	INFLATE_STORED_HEADER,
+	INFLATE_STORED_DATA,
+	INFLATE_COMPRESSED_DATA,
+	INFLATE_ZLIB_TRAILER,
+	INFLATE_DONE
+} InflateState;
+
+/// Resumable inflate context, it only keeps the last WINDOW_SIZE bytes of
+/// output, as the history the matches can refer to, and the bytes of a header
+/// left incomplete by the end of an input chunk, so that its memory is
+/// constant regardless of the size of the stream.
+typedef struct ZLIBInflateStream {
+	unsigned char window[WINDOW_SIZE];
+	unsigned int window_pos;
+	unsigned int window_len;
+	unsigned char pending[INFLATE_PENDING_SIZE];
+	unsigned int pending_len;
+	unsigned char bit_pos;
+	HFTable literals_hf;
+	HFTable distance_hf;
+	unsigned int stored_length;
+	unsigned short int match_length;
+	unsigned short int match_distance;
+	unsigned int adler;
+	InflateState state;
+	unsigned char is_final;
+	unsigned char has_zlib_wrapper;
+} ZLIBInflateStream;
+
 /* -------------------------------------------------------------------------------------------------------- */
 // ------------------
 //  Static Variables
 // ------------------
-// Fixed huffman literal/lengths codes
-static const unsigned short int fixed_val_ptr[]          = {0, 256, 0, 280, 144};
-static const unsigned short int fixed_mins[]             = {0, 0x00, 0x30, 0xC0, 0x190};
-static const unsigned short int fixed_maxs[]             = {0, 0x18, 0xC0, 0xC8, 0x200};
-static const unsigned short int fixed_distance_val_ptr[] = {0, 0x00};
-static const unsigned short int fixed_distance_mins[]    = {0, 0x00};
-static const unsigned short int fixed_distance_maxs[]    = {0, 0x20};
-
-#define IS_FIXED_LITERALS 2
-static void fixed_literals_hf(HFTable* hf) {
-	unsigned short int* literals_val_ptr = (unsigned short int*) fixed_val_ptr; 
-	*hf = (HFTable) {	 														
-		.values = &literals_val_ptr, 											
-		.min_codes = (unsigned short int*) fixed_mins, 							
-		.max_codes = (unsigned short int*) fixed_maxs, 							
-		.max_bit_length = 4, 													
-		.is_fixed_hf = IS_FIXED_LITERALS 										
-	};
-	return;
-}
+// Fixed huffman literal/lengths and distance tables, precomputed from the code lengths of RFC 1951 section 3.2.6,
+// as read-only data they are shared by every stream without any initialization, and flagged as fixed so never freed
+static const HFEntry fixed_literals_entries[512] = {
+	{256, 7, 0}, { 80, 8, 0}, { 16, 8, 0}, {280, 8, 0}, {272, 7, 0}, {112, 8, 0}, { 48, 8, 0}, {192, 9, 0},
+	{264, 7, 0}, { 96, 8, 0}, { 32, 8, 0}, {160, 9, 0}, {  0, 8, 0}, {128, 8, 0}, { 64, 8, 0}, {224, 9, 0},
+	{260, 7, 0}, { 88, 8, 0}, { 24, 8, 0}, {144, 9, 0}, {276, 7, 0}, {120, 8, 0}, { 56, 8, 0}, {208, 9, 0},
+	{268, 7, 0}, {104, 8, 0}, { 40, 8, 0}, {176, 9, 0}, {  8, 8, 0}, {136, 8, 0}, { 72, 8, 0}, {240, 9, 0},
+	{258, 7, 0}, { 84, 8, 0}, { 20, 8, 0}, {284, 8, 0}, {274, 7, 0}, {116, 8, 0}, { 52, 8, 0}, {200, 9, 0},
+	{266, 7, 0}, {100, 8, 0}, { 36, 8, 0}, {168, 9, 0}, {  4, 8, 0}, {132, 8, 0}, { 68, 8, 0}, {232, 9, 0},
+	{262, 7, 0}, { 92, 8, 0}, { 28, 8, 0}, {152, 9, 0}, {278, 7, 0}, {124, 8, 0}, { 60, 8, 0}, {216, 9, 0},
+	{270, 7, 0}, {108, 8, 0}, { 44, 8, 0}, {184, 9, 0}, { 12, 8, 0}, {140, 8, 0}, { 76, 8, 0}, {248, 9, 0},
+	{257, 7, 0}, { 82, 8, 0}, { 18, 8, 0}, {282, 8, 0}, {273, 7, 0}, {114, 8, 0}, { 50, 8, 0}, {196, 9, 0},
+	{265, 7, 0}, { 98, 8, 0}, { 34, 8, 0}, {164, 9, 0}, {  2, 8, 0}, {130, 8, 0}, { 66, 8, 0}, {228, 9, 0},
+	{261, 7, 0}, { 90, 8, 0}, { 26, 8, 0}, {148, 9, 0}, {277, 7, 0}, {122, 8, 0}, { 58, 8, 0}, {212, 9, 0},
+	{269, 7, 0}, {106, 8, 0}, { 42, 8, 0}, {180, 9, 0}, { 10, 8, 0}, {138, 8, 0}, { 74, 8, 0}, {244, 9, 0},
+	{259, 7, 0}, { 86, 8, 0}, { 22, 8, 0}, {286, 8, 0}, {275, 7, 0}, {118, 8, 0}, { 54, 8, 0}, {204, 9, 0},
+	{267, 7, 0}, {102, 8, 0}, { 38, 8, 0}, {172, 9, 0}, {  6, 8, 0}, {134, 8, 0}, { 70, 8, 0}, {236, 9, 0},
+	{263, 7, 0}, { 94, 8, 0}, { 30, 8, 0}, {156, 9, 0}, {279, 7, 0}, {126, 8, 0}, { 62, 8, 0}, {220, 9, 0},
+	{271, 7, 0}, {110, 8, 0}, { 46, 8, 0}, {188, 9, 0}, { 14, 8, 0}, {142, 8, 0}, { 78, 8, 0}, {252, 9, 0},
+	{256, 7, 0}, { 81, 8, 0}, { 17, 8, 0}, {281, 8, 0}, {272, 7, 0}, {113, 8, 0}, { 49, 8, 0}, {194, 9, 0},
+	{264, 7, 0}, { 97, 8, 0}, { 33, 8, 0}, {162, 9, 0}, {  1, 8, 0}, {129, 8, 0}, { 65, 8, 0}, {226, 9, 0},
+	{260, 7, 0}, { 89, 8, 0}, { 25, 8, 0}, {146, 9, 0}, {276, 7, 0}, {121, 8, 0}, { 57, 8, 0}, {210, 9, 0},
+	{268, 7, 0}, {105, 8, 0}, { 41, 8, 0}, {178, 9, 0}, {  9, 8, 0}, {137, 8, 0}, { 73, 8, 0}, {242, 9, 0},
+	{258, 7, 0}, { 85, 8, 0}, { 21, 8, 0}, {285, 8, 0}, {274, 7, 0}, {117, 8, 0}, { 53, 8, 0}, {202, 9, 0},
+	{266, 7, 0}, {101, 8, 0}, { 37, 8, 0}, {170, 9, 0}, {  5, 8, 0}, {133, 8, 0}, { 69, 8, 0}, {234, 9, 0},
+	{262, 7, 0}, { 93, 8, 0}, { 29, 8, 0}, {154, 9, 0}, {278, 7, 0}, {125, 8, 0}, { 61, 8, 0}, {218, 9, 0},
+	{270, 7, 0}, {109, 8, 0}, { 45, 8, 0}, {186, 9, 0}, { 13, 8, 0}, {141, 8, 0}, { 77, 8, 0}, {250, 9, 0},
+	{257, 7, 0}, { 83, 8, 0}, { 19, 8, 0}, {283, 8, 0}, {273, 7, 0}, {115, 8, 0}, { 51, 8, 0}, {198, 9, 0},
+	{265, 7, 0}, { 99, 8, 0}, { 35, 8, 0}, {166, 9, 0}, {  3, 8, 0}, {131, 8, 0}, { 67, 8, 0}, {230, 9, 0},
+	{261, 7, 0}, { 91, 8, 0}, { 27, 8, 0}, {150, 9, 0}, {277, 7, 0}, {123, 8, 0}, { 59, 8, 0}, {214, 9, 0},
+	{269, 7, 0}, {107, 8, 0}, { 43, 8, 0}, {182, 9, 0}, { 11, 8, 0}, {139, 8, 0}, { 75, 8, 0}, {246, 9, 0},
+	{259, 7, 0}, { 87, 8, 0}, { 23, 8, 0}, {287, 8, 0}, {275, 7, 0}, {119, 8, 0}, { 55, 8, 0}, {206, 9, 0},
+	{267, 7, 0}, {103, 8, 0}, { 39, 8, 0}, {174, 9, 0}, {  7, 8, 0}, {135, 8, 0}, { 71, 8, 0}, {238, 9, 0},
+	{263, 7, 0}, { 95, 8, 0}, { 31, 8, 0}, {158, 9, 0}, {279, 7, 0}, {127, 8, 0}, { 63, 8, 0}, {222, 9, 0},
+	{271, 7, 0}, {111, 8, 0}, { 47, 8, 0}, {190, 9, 0}, { 15, 8, 0}, {143, 8, 0}, { 79, 8, 0}, {254, 9, 0},
+	{256, 7, 0}, { 80, 8, 0}, { 16, 8, 0}, {280, 8, 0}, {272, 7, 0}, {112, 8, 0}, { 48, 8, 0}, {193, 9, 0},
+	{264, 7, 0}, { 96, 8, 0}, { 32, 8, 0}, {161, 9, 0}, {  0, 8, 0}, {128, 8, 0}, { 64, 8, 0}, {225, 9, 0},
+	{260, 7, 0}, { 88, 8, 0}, { 24, 8, 0}, {145, 9, 0}, {276, 7, 0}, {120, 8, 0}, { 56, 8, 0}, {209, 9, 0},
+	{268, 7, 0}, {104, 8, 0}, { 40, 8, 0}, {177, 9, 0}, {  8, 8, 0}, {136, 8, 0}, { 72, 8, 0}, {241, 9, 0},
+	{258, 7, 0}, { 84, 8, 0}, { 20, 8, 0}, {284, 8, 0}, {274, 7, 0}, {116, 8, 0}, { 52, 8, 0}, {201, 9, 0},
+	{266, 7, 0}, {100, 8, 0}, { 36, 8, 0}, {169, 9, 0}, {  4, 8, 0}, {132, 8, 0}, { 68, 8, 0}, {233, 9, 0},
+	{262, 7, 0}, { 92, 8, 0}, { 28, 8, 0}, {153, 9, 0}, {278, 7, 0}, {124, 8, 0}, { 60, 8, 0}, {217, 9, 0},
+	{270, 7, 0}, {108, 8, 0}, { 44, 8, 0}, {185, 9, 0}, { 12, 8, 0}, {140, 8, 0}, { 76, 8, 0}, {249, 9, 0},
+	{257, 7, 0}, { 82, 8, 0}, { 18, 8, 0}, {282, 8, 0}, {273, 7, 0}, {114, 8, 0}, { 50, 8, 0}, {197, 9, 0},
+	{265, 7, 0}, { 98, 8, 0}, { 34, 8, 0}, {165, 9, 0}, {  2, 8, 0}, {130, 8, 0}, { 66, 8, 0}, {229, 9, 0},
+	{261, 7, 0}, { 90, 8, 0}, { 26, 8, 0}, {149, 9, 0}, {277, 7, 0}, {122, 8, 0}, { 58, 8, 0}, {213, 9, 0},
+	{269, 7, 0}, {106, 8, 0}, { 42, 8, 0}, {181, 9, 0}, { 10, 8, 0}, {138, 8, 0}, { 74, 8, 0}, {245, 9, 0},
+	{259, 7, 0}, { 86, 8, 0}, { 22, 8, 0}, {286, 8, 0}, {275, 7, 0}, {118, 8, 0}, { 54, 8, 0}, {205, 9, 0},
+	{267, 7, 0}, {102, 8, 0}, { 38, 8, 0}, {173, 9, 0}, {  6, 8, 0}, {134, 8, 0}, { 70, 8, 0}, {237, 9, 0},
+	{263, 7, 0}, { 94, 8, 0}, { 30, 8, 0}, {157, 9, 0}, {279, 7, 0}, {126, 8, 0}, { 62, 8, 0}, {221, 9, 0},
+	{271, 7, 0}, {110, 8, 0}, { 46, 8, 0}, {189, 9, 0}, { 14, 8, 0}, {142, 8, 0}, { 78, 8, 0}, {253, 9, 0},
+	{256, 7, 0}, { 81, 8, 0}, { 17, 8, 0}, {281, 8, 0}, {272, 7, 0}, {113, 8, 0}, { 49, 8, 0}, {195, 9, 0},
+	{264, 7, 0}, { 97, 8, 0}, { 33, 8, 0}, {163, 9, 0}, {  1, 8, 0}, {129, 8, 0}, { 65, 8, 0}, {227, 9, 0},
+	{260, 7, 0}, { 89, 8, 0}, { 25, 8, 0}, {147, 9, 0}, {276, 7, 0}, {121, 8, 0}, { 57, 8, 0}, {211, 9, 0},
+	{268, 7, 0}, {105, 8, 0}, { 41, 8, 0}, {179, 9, 0}, {  9, 8, 0}, {137, 8, 0}, { 73, 8, 0}, {243, 9, 0},
+	{258, 7, 0}, { 85, 8, 0}, { 21, 8, 0}, {285, 8, 0}, {274, 7, 0}, {117, 8, 0}, { 53, 8, 0}, {203, 9, 0},
+	{266, 7, 0}, {101, 8, 0}, { 37, 8, 0}, {171, 9, 0}, {  5, 8, 0}, {133, 8, 0}, { 69, 8, 0}, {235, 9, 0},
+	{262, 7, 0}, { 93, 8, 0}, { 29, 8, 0}, {155, 9, 0}, {278, 7, 0}, {125, 8, 0}, { 61, 8, 0}, {219, 9, 0},
+	{270, 7, 0}, {109, 8, 0}, { 45, 8, 0}, {187, 9, 0}, { 13, 8, 0}, {141, 8, 0}, { 77, 8, 0}, {251, 9, 0},
+	{257, 7, 0}, { 83, 8, 0}, { 19, 8, 0}, {283, 8, 0}, {273, 7, 0}, {115, 8, 0}, { 51, 8, 0}, {199, 9, 0},
+	{265, 7, 0}, { 99, 8, 0}, { 35, 8, 0}, {167, 9, 0}, {  3, 8, 0}, {131, 8, 0}, { 67, 8, 0}, {231, 9, 0},
+	{261, 7, 0}, { 91, 8, 0}, { 27, 8, 0}, {151, 9, 0}, {277, 7, 0}, {123, 8, 0}, { 59, 8, 0}, {215, 9, 0},
+	{269, 7, 0}, {107, 8, 0}, { 43, 8, 0}, {183, 9, 0}, { 11, 8, 0}, {139, 8, 0}, { 75, 8, 0}, {247, 9, 0},
+	{259, 7, 0}, { 87, 8, 0}, { 23, 8, 0}, {287, 8, 0}, {275, 7, 0}, {119, 8, 0}, { 55, 8, 0}, {207, 9, 0},
+	{267, 7, 0}, {103, 8, 0}, { 39, 8, 0}, {175, 9, 0}, {  7, 8, 0}, {135, 8, 0}, { 71, 8, 0}, {239, 9, 0},
+	{263, 7, 0}, { 95, 8, 0}, { 31, 8, 0}, {159, 9, 0}, {279, 7, 0}, {127, 8, 0}, { 63, 8, 0}, {223, 9, 0},
+	{271, 7, 0}, {111, 8, 0}, { 47, 8, 0}, {191, 9, 0}, { 15, 8, 0}, {143, 8, 0}, { 79, 8, 0}, {255, 9, 0}
+};
+
+static const HFEntry fixed_distance_entries[32] = {
+	{  0, 5, 0}, { 16, 5, 0}, {  8, 5, 0}, { 24, 5, 0}, {  4, 5, 0}, { 20, 5, 0}, { 12, 5, 0}, { 28, 5, 0},
+	{  2, 5, 0}, { 18, 5, 0}, { 10, 5, 0}, { 26, 5, 0}, {  6, 5, 0}, { 22, 5, 0}, { 14, 5, 0}, { 30, 5, 0},
+	{  1, 5, 0}, { 17, 5, 0}, {  9, 5, 0}, { 25, 5, 0}, {  5, 5, 0}, { 21, 5, 0}, { 13, 5, 0}, { 29, 5, 0},
+	{  3, 5, 0}, { 19, 5, 0}, { 11, 5, 0}, { 27, 5, 0}, {  7, 5, 0}, { 23, 5, 0}, { 15, 5, 0}, { 31, 5, 0}
+};
+
+static const HFTable fixed_literals_table = { .entries = (HFEntry*) fixed_literals_entries, .primary_bits = 9, .max_bit_length = 9, .is_fixed_hf = TRUE };
+static const HFTable fixed_distance_table = { .entries = (HFEntry*) fixed_distance_entries, .primary_bits = 5, .max_bit_length = 5, .is_fixed_hf = TRUE };
 
-static void fixed_distance_hf(HFTable* hf) {
-	unsigned short int* distance_val_ptr = (unsigned short int*) fixed_distance_val_ptr; 	
-	*hf = (HFTable) { 																		
-		.values = &distance_val_ptr, 														
-		.min_codes = (unsigned short int*) fixed_distance_mins, 							
-		.max_codes = (unsigned short int*) fixed_distance_maxs, 							
-		.max_bit_length = 1, 																
-		.is_fixed_hf = TRUE 																
-	}; 																						
-	return;
-}
 	
 /* ---------------------------------------------------------------------------------------------------------- */
 // ------------------------
@@ -117,24 +219,42 @@ static void fixed_distance_hf(HFTable* hf) {
 unsigned char* deflate_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zlib_err);
 unsigned char* zlib_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zlib_err);
 
+/// NOTE: the stream is only read, and it's never deallocated, while the data is
+/// 	  decompressed straight into the caller's buffer of out_size bytes.
+/// 	  Returns the length of the decompressed data, -ZLIB_NEED_MORE_OUTPUT if it
+/// 	  doesn't fit in the buffer, or another negative ZlibError on failure.
+int deflate_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size);
+int zlib_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size);
+
+/// Streaming interface: the stream is fed with chunks of input and drains the
+/// output in the given buffer, consumed and produced report how much of both
+/// was used, the unused input must be passed again in the following call.
+/// Returns ZLIB_STREAM_CONTINUE when more input or output space is needed,
+/// ZLIB_STREAM_END once the whole stream has been decoded, otherwise an error.
+void zlib_inflate_stream_init(ZLIBInflateStream* stream, unsigned char has_zlib_wrapper);
+int zlib_inflate_stream(ZLIBInflateStream* stream, const unsigned char* data, unsigned int size, unsigned int* consumed, unsigned char* out, unsigned int out_size, unsigned int* produced);
+void zlib_inflate_stream_end(ZLIBInflateStream* stream);
+
 /* ---------------------------------------------------------------------------------------------------------- */
 
 static void deallocate_hf_table(HFTable* hf) {
 	if (hf -> is_fixed_hf) return;
-	for (unsigned int i = 1; i <= hf -> max_bit_length; ++i) XCOMP_SAFE_FREE((hf -> values)[i]);
-    XCOMP_SAFE_FREE(hf -> values);
-    XCOMP_SAFE_FREE(hf -> min_codes);
-    XCOMP_SAFE_FREE(hf -> max_codes);
+	XCOMP_SAFE_FREE(hf -> entries);
     return;
 }
 
-UNUSED_FUNCTION static void print_hf_table(HFTable* hf, unsigned char* size) {
+UNUSED_FUNCTION static void print_hf_table(HFTable* hf) {
 	printf("\n-------------------\n");
-	for (unsigned int i = 1; i <= hf -> max_bit_length; ++i) {
-		if (size[i] == 0) continue;
-		printf("%u: min_code: 0x%X, max_code: 0x%X, values: ", i, (hf -> min_codes)[i], (hf -> max_codes)[i]); 
-		for (unsigned int j = 0; j < size[i]; ++j) {
-			printf("0x%X ", (hf -> values)[i][j]);
+	for (unsigned int i = 0; i < (1U << hf -> primary_bits); ++i) {
+		const HFEntry entry = (hf -> entries)[i];
+		if (entry.sub_bits == 0) {
+			printf("0x%03X: value: 0x%X, length: %u\n", i, entry.value, entry.length);
+			continue;
+		}
+		
+		printf("0x%03X: sub-table of %u bits: ", i, entry.sub_bits);
+		for (unsigned int j = 0; j < (1U << entry.sub_bits); ++j) {
+			printf("0x%X/%u ", (hf -> entries)[entry.value + j].value, (hf -> entries)[entry.value + j].length);
 		}
 		printf("\n");
 	}
@@ -147,183 +267,185 @@ static inline int max_value(unsigned char* arr, unsigned int size) {
 	return max;
 }
 
-/// Generate huffman table (values, min_codes, max_codes) starting from given lengths
+/// Generate the lookup table of the canonical huffman codes with the given lengths.
+/// The primary table is indexed by the next primary_bits of the stream, while the
+/// codes longer than that are resolved through a sub-table, linked by their prefix.
 /// Should also be responsible for the eventual deallocation of the hf table
 static int generate_hf(HFTable* hf, unsigned char* lengths, unsigned int size) {
-	unsigned char bl_count[16] = {0};
+	hf -> entries = NULL;
+	hf -> is_fixed_hf = FALSE;
+	
+	unsigned short int bl_count[HF_MAX_BIT_LENGTH + 1] = {0};
 	for (unsigned short int i = 0; i < size; ++i) (bl_count[lengths[i]])++;
+	bl_count[0] = 0;
+
+	// An over-subscribed set of lengths would produce codes that do not fit in their length
+	int left = 1;
+	for (unsigned int bits = 1; bits <= HF_MAX_BIT_LENGTH; ++bits) {
+		left = (left << 1) - bl_count[bits];
+		if (left < 0) {
+			WARNING_LOG("Over-subscribed huffman code lengths.");
+			return -ZLIB_CORRUPTED_DATA;
+		}
+	}
     
 	hf -> max_bit_length = max_value(lengths, size);
-	hf -> values    = xcomp_calloc(hf -> max_bit_length + 1, sizeof(unsigned short int*));
-    hf -> min_codes = xcomp_calloc(hf -> max_bit_length + 1, sizeof(unsigned short int));
-	hf -> max_codes = xcomp_calloc(hf -> max_bit_length + 1, sizeof(unsigned short int));
-    if ((hf -> min_codes == NULL) || (hf -> max_codes == NULL) || (hf -> values == NULL)) {
-		WARNING_LOG("Failed to allocate buffers.");
-		return -ZLIB_IO_ERROR;
-	}
+	hf -> primary_bits   = MIN(hf -> max_bit_length, HF_PRIMARY_BITS);
 	
-	for (unsigned int i = 1; i <= hf -> max_bit_length; ++i) {
-        (hf -> values)[i] = (unsigned short int*) xcomp_calloc(bl_count[i], sizeof(unsigned short int));
-		if ((hf -> values)[i] == NULL) {
-			WARNING_LOG("Failed to allocate buffer for hf -> values[%u].", i);
-			return -ZLIB_IO_ERROR;
-		}
+	// Find the first code of each bit_length, then assign the codes in
+	// lexicographical order, storing them mirrored, as the bitstream delivers
+	// the huffman codes starting from their most significant bit.
+	unsigned short int next_code[HF_MAX_BIT_LENGTH + 1] = {0};
+	for (unsigned int bits = 1; bits <= HF_MAX_BIT_LENGTH; ++bits) next_code[bits] = (next_code[bits - 1] + bl_count[bits - 1]) << 1;
+
+	unsigned short int codes[MAX_HF_SIZE] = {0};
+	for (unsigned int i = 0; i < size; ++i) {
+		if (lengths[i] != 0) codes[i] = bitstream_reverse_bits(next_code[lengths[i]]++, lengths[i]);
 	}
 
-	// Find the minimum and maximum code values for each bit_length 
-	bl_count[0] = 0;
-    for (unsigned int bits = 1; bits <= hf -> max_bit_length; ++bits) {
-        (hf -> min_codes)[bits] = ((hf -> min_codes)[bits - 1] + bl_count[bits - 1]) << 1;
-        (hf -> max_codes)[bits] = (hf -> min_codes)[bits];
-    }
-	
-	// Compute the code for each entry, and update the max_code each time accordingly.
-	// In this way we sort of allocate a code for each entry in order (as
-	// lexicographical order is required), as we already know the base for each
-	// bit_length (min_code).
-	unsigned char* values_index = xcomp_calloc(hf -> max_bit_length + 1, sizeof(unsigned char));
-    if (values_index == NULL) {
-		WARNING_LOG("Failed to allocate buffer for values_index.");
+	// Each primary slot shared by longer codes gets a sub-table wide enough for the longest of them
+	const unsigned int primary_size = 1U << hf -> primary_bits;
+	const unsigned int primary_mask = primary_size - 1;
+	unsigned char sub_bits[1 << HF_PRIMARY_BITS] = {0};
+	for (unsigned int i = 0; i < size; ++i) {
+		if (lengths[i] <= hf -> primary_bits) continue;
+		const unsigned int slot = codes[i] & primary_mask;
+		sub_bits[slot] = MAX(sub_bits[slot], lengths[i] - hf -> primary_bits);
+	}
+
+	unsigned int entries_count = primary_size;
+	for (unsigned int slot = 0; slot < primary_size; ++slot) {
+		if (sub_bits[slot]) entries_count += 1U << sub_bits[slot];
+	}
+
+	hf -> entries = xcomp_calloc(entries_count, sizeof(HFEntry));
+	if (hf -> entries == NULL) {
+		WARNING_LOG("Failed to allocate buffer for hf -> entries.");
 		return -ZLIB_IO_ERROR;
 	}
-	
+
+	unsigned int offset = primary_size;
+	for (unsigned int slot = 0; slot < primary_size; ++slot) {
+		if (sub_bits[slot] == 0) continue;
+		(hf -> entries)[slot] = (HFEntry) { .value = offset, .length = hf -> primary_bits, .sub_bits = sub_bits[slot] };
+		offset += 1U << sub_bits[slot];
+	}
+
+	// Replicate each entry in every slot whose low bits match its code, the
+	// unused slots are left with a zero length, so that they are rejected.
 	for (unsigned int i = 0; i < size; ++i) {
-        if (lengths[i] != 0) {
-            unsigned char value_bit_len = lengths[i];
-            ((hf -> max_codes)[value_bit_len])++;
-            (hf -> values)[value_bit_len][values_index[value_bit_len]++] = i;
+		const unsigned char length = lengths[i];
+		if (length == 0) continue;
+		
+		const HFEntry entry = { .value = i, .length = length, .sub_bits = 0 };
+		if (length <= hf -> primary_bits) {
+			for (unsigned int idx = codes[i]; idx < primary_size; idx += 1U << length) (hf -> entries)[idx] = entry;
+			continue;
 		}
-    }
 
-    XCOMP_SAFE_FREE(values_index);
+		const HFEntry link = (hf -> entries)[codes[i] & primary_mask];
+		const unsigned char sub_length = length - hf -> primary_bits;
+		for (unsigned int idx = codes[i] >> hf -> primary_bits; idx < (1U << link.sub_bits); idx += 1U << sub_length) {
+			(hf -> entries)[link.value + idx] = entry;
+		}
+	}
 
-	/* print_hf_table(hf, bl_count); */
+	/* print_hf_table(hf); */
 
     return ZLIB_NO_ERROR;
 }
 
-static int decode_hf(BitStream* bit_stream, unsigned short int code, HFTable hf, int* err) {
-	if (hf.is_fixed_hf) {
-		// Read the first n common first bits, if bit_length is 4 means that is
-		// the literals hf so the base is 6 common bits, otherwise is 4 for
-		// distance hf
-		for (unsigned char i = 0; i < ((hf.max_bit_length == 4) ? 6 : 4); ++i) {
-			code = (code << 1) + bitstream_read_next_bit(bit_stream);
-			if (bit_stream -> error) {
-				*err = -ZLIB_IO_ERROR;
-				return *err;
-			}
-		}
-	}
-	
-	for (unsigned char i = 1; i <= hf.max_bit_length; ++i) {
-		/* DEBUG_LOG("%u: code: 0x%X", i, code); */
-		// Check if the code is inside this bit_length group, by checking if
-		// it's less than the maximum code for this bit_length.
-		if (hf.max_codes[i] > code) { 
-			// Return the corresponding decoded value from the hf tree,
-			// subtracting the min code for this bit length to get the offset
-			// of the entry.
-			if (hf.is_fixed_hf) return (code - hf.min_codes[i] + (hf.values)[0][i]);
-			else                return ((hf.values)[i][code - hf.min_codes[i]]); 
-        }
-		
-		// If the code does not match, then add a bit and check with the next bit_length
-		// If the hf used is the literals fixed one, then we need to do the
-		// following as the 8 bit-length group is divided in two sub-groups (0 - 143) 
-		// and (280 - 287), preventing it to read the next_bit and skip
-		// the length
-        if (i != 2 || hf.is_fixed_hf != IS_FIXED_LITERALS) { 
-			code = (code << 1) + bitstream_read_next_bit(bit_stream);
-		}
+static int fixed_hf_tables(HFTable* literals_hf, HFTable* distance_hf) {
+	*literals_hf = fixed_literals_table;
+	*distance_hf = fixed_distance_table;
+	return ZLIB_NO_ERROR;
+}
 
-        if (bit_stream -> error) break;
-    }
-	
-	// Return max value to signal error during operation.
-	*err = -ZLIB_INVALID_DECODED_VALUE; 
-    return *err;
+static inline HFEntry hf_lookup(const HFTable* hf, unsigned long long int bits) {
+	HFEntry entry = (hf -> entries)[bits & XCOMP_MASK_BITS_PRECEDING(hf -> primary_bits)];
+	if (entry.sub_bits) entry = (hf -> entries)[entry.value + ((bits >> hf -> primary_bits) & XCOMP_MASK_BITS_PRECEDING(entry.sub_bits))];
+	return entry;
 }
 
-static int decode_dhf_lengths(BitStream* bit_stream, HFTable decoder_hf, unsigned char* lengths, unsigned int size) {
-	int err = 0;
-    unsigned int i = 0; 
+/// Decode the next symbol with at most two table lookups, consuming only the bits of its code.
+/// A code running past the end of the input is reported as ZLIB_NEED_MORE_INPUT, and left unread.
+static inline int decode_hf(BitStream* bit_stream, const HFTable* hf) {
+	const unsigned long long int available = bitstream_available_bits(bit_stream);
+	const HFEntry entry = hf_lookup(hf, bitstream_peek_bits(bit_stream, hf -> max_bit_length));
+	if (entry.length == 0 || entry.length > available) return (available < hf -> max_bit_length) ? -ZLIB_NEED_MORE_INPUT : -ZLIB_INVALID_DECODED_VALUE;
+	bitstream_consume_bits(bit_stream, entry.length);
+	return entry.value;
+}
+
+static int decode_dhf_lengths(BitStream* bit_stream, const HFTable* decoder_hf, unsigned char* lengths, unsigned int size) {
+	const unsigned char bit_sizes[] = { 2, 3, 7 };
+	const unsigned char cnt_base[]  = { 3, 3, 11 };
+
+	unsigned int i = 0;
 	while (i < size) {
-        int value = decode_hf(bit_stream, bitstream_read_next_bit(bit_stream), decoder_hf, &err);
-		if (value < 0 || value > 18) {
-			WARNING_LOG("Corrupted encoded lengths.");
-			break;
+        const int value = decode_hf(bit_stream, decoder_hf);
+		if (value < 0) {
+			if (value != -ZLIB_NEED_MORE_INPUT) WARNING_LOG("Corrupted encoded lengths.");
+			return value;
 		}
 
 		// 0 - 15: Represent code lengths of 0 - 15.
         if (value < 16) {
 			lengths[i++] = value;
 			continue;
-        } 
-		
-		const unsigned char bit_sizes[] = { 2, 3, 7 };
-		const unsigned char cnt_base[]  = { 3, 3, 11 };
+        }
+
+		NEED_BITS(bit_stream, bit_sizes[value - 16]);
 		unsigned char count = 0;
 		bitstream_read_bits(bit_stream, bit_sizes[value - 16], &count);
 		count += cnt_base[value - 16];
-		if (bit_stream -> error) {
-			err = -ZLIB_IO_ERROR;
-			break;
+
+		if ((value == 16 && i == 0) || (i + count > size)) {
+			WARNING_LOG("Corrupted repeat code: %d, count: %u, at %u/%u.", value, count, i, size);
+			return -ZLIB_CORRUPTED_DATA;
 		}
 
 		// 16: Copy the previous code length 3 - 6 times.
 		// 17: Repeat a code length of 0 for 3 - 10 times. (3 bits of length).
 		// 18: Repeat a code length of 0 for 11 - 138 times (7 bits of length).
-		const unsigned char copy_value = (value == 16) * lengths[i - 1];
+		const unsigned char copy_value = (value == 16) ? lengths[i - 1] : 0;
 		for (unsigned int idx = 0; idx < count; ++i, ++idx) lengths[i] = copy_value;
 	}
-	
-	if (err < 0) {
-		deallocate_hf_table(&decoder_hf);
-		XCOMP_SAFE_FREE(lengths);
-	}
 
-    return err;
+    return ZLIB_NO_ERROR;
 }
 
-// Parse the dynamic huffman table header 
+// Parse the dynamic huffman table header
 static int parse_decoder_hf(BitStream* bit_stream, HFTable* decoder_hf, dhf_header_t* dhf_header) {
+	NEED_BITS(bit_stream, 14);
 	bitstream_read_bits(bit_stream, 5, &(dhf_header -> hlit));
 	bitstream_read_bits(bit_stream, 5, &(dhf_header -> hdist));
 	bitstream_read_bits(bit_stream, 4, &(dhf_header -> hclen));
-    if (bit_stream -> error) return -ZLIB_IO_ERROR;
-	
+
 	dhf_header -> hlit  += 257;
 	dhf_header -> hdist += 1;
 	dhf_header -> hclen += 4;
+	if (dhf_header -> hlit > HF_LITERALS_SIZE || dhf_header -> hdist > HF_DISTANCE_SIZE) {
+		WARNING_LOG("Invalid dynamic header, hlit: %u, hdist: %u.", dhf_header -> hlit, dhf_header -> hdist);
+		return -ZLIB_CORRUPTED_DATA;
+	}
 
 	DEBUG_LOG("hlit: %u, hdist: %u, hclen: %u", dhf_header -> hlit, dhf_header -> hdist, dhf_header -> hclen);
 
     // Retrieve the length to build the huffman tree to decode the other two huffman trees (Literals and Distance)
     const unsigned char order_of_code_lengths[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-    unsigned char* lengths = xcomp_calloc(HF_TABLE_SIZE, sizeof(unsigned char));
-	if (lengths == NULL) {
-		WARNING_LOG("Failed to allocate buffer for decoder_hf lengths.");
-		return -ZLIB_IO_ERROR;
-	}
+    unsigned char lengths[HF_TABLE_SIZE] = {0};
 
 	// Retrieve the length of each code, using the array to match the fixed
 	// order of the codes. Furthermore, each one of the length is 3-bit long.
-    for (unsigned char i = 0; i < dhf_header -> hclen; ++i) {
-		bitstream_read_bits(bit_stream, 3, lengths + order_of_code_lengths[i]);
-		if (bit_stream -> error) {
-			XCOMP_SAFE_FREE(lengths);
-			return -ZLIB_IO_ERROR;
-		}
-	}
-    
+	NEED_BITS(bit_stream, 3 * dhf_header -> hclen);
+    for (unsigned char i = 0; i < dhf_header -> hclen; ++i) bitstream_read_bits(bit_stream, 3, lengths + order_of_code_lengths[i]);
+
 	int err = 0;
     if ((err = generate_hf(decoder_hf, lengths, HF_TABLE_SIZE)) < 0) {
 		WARNING_LOG("An error occurred while generating the codes for the decoder_hf table.");
 		return err;
 	}
-	
-	XCOMP_SAFE_FREE(lengths);
 
 	return ZLIB_NO_ERROR;
 }
@@ -332,322 +454,672 @@ static int parse_decoder_hf(BitStream* bit_stream, HFTable* decoder_hf, dhf_head
 static int decode_dhf_tables(BitStream* bit_stream, HFTable* literals_hf, HFTable* distance_hf) {
     int err = 0;
 	dhf_header_t dhf_header = {0};
-	HFTable decoder_hf = {0}; 
+	HFTable decoder_hf = {0};
     if ((err = parse_decoder_hf(bit_stream, &decoder_hf, &dhf_header)) < 0) {
-		WARNING_LOG("An error occurred while generating the codes for the decoder_hf table.");
-		return err;
-	}
-	
-    unsigned char* hf_lengths   = (unsigned char*) xcomp_calloc(dhf_header.hlit + dhf_header.hdist, sizeof(unsigned char));
-    unsigned char* lit_lengths  = (unsigned char*) xcomp_calloc(HF_LITERALS_SIZE, sizeof(unsigned char));
-	unsigned char* dist_lengths = (unsigned char*) xcomp_calloc(HF_DISTANCE_SIZE, sizeof(unsigned char));
-	if ((hf_lengths == NULL) || (lit_lengths == NULL) || (dist_lengths == NULL)) {
 		deallocate_hf_table(&decoder_hf);
-		XCOMP_MULTI_FREE(hf_lengths, lit_lengths, dist_lengths);
-		WARNING_LOG("Failed to allocate buffer for distance_hf -> lengths.");
-		return -ZLIB_IO_ERROR;
-	}
-
-	// Decode the bit_lengths for both the Huffman Trees
-	if ((err = decode_dhf_lengths(bit_stream, decoder_hf, hf_lengths, dhf_header.hlit + dhf_header.hdist)) < 0) {
-		XCOMP_MULTI_FREE(lit_lengths, dist_lengths);
-		WARNING_LOG("An error occurred while decoding the literals lengths.");
 		return err;
 	}
 
-	mem_cpy(lit_lengths, hf_lengths, dhf_header.hlit);
-	mem_cpy(dist_lengths, hf_lengths + dhf_header.hlit, dhf_header.hdist);
+	// Decode the bit_lengths for both the Huffman Trees
+	unsigned char hf_lengths[HF_LITERALS_SIZE + HF_DISTANCE_SIZE] = {0};
+	err = decode_dhf_lengths(bit_stream, &decoder_hf, hf_lengths, dhf_header.hlit + dhf_header.hdist);
 	deallocate_hf_table(&decoder_hf);
-	XCOMP_SAFE_FREE(hf_lengths);
+	if (err < 0) return err;
 
-	err = generate_hf(literals_hf, lit_lengths, HF_LITERALS_SIZE);
-	if (err == 0) err = generate_hf(distance_hf, dist_lengths, HF_DISTANCE_SIZE);
+	err = generate_hf(literals_hf, hf_lengths, dhf_header.hlit);
+	if (err == 0) err = generate_hf(distance_hf, hf_lengths + dhf_header.hlit, dhf_header.hdist);
 
 	if (err < 0) {
 		WARNING_LOG("An error occurred while generating literal and distance dhfs.");
 		DEALLOCATE_TABLES(literals_hf, distance_hf);
 	}
-	
-	XCOMP_MULTI_FREE(lit_lengths, dist_lengths);
 
     return err;
 }
 
-/// Move backwards distance bytes in the output stream, and copy length bytes from this position to the output stream
-static int copy_data(ZLIBBuffer* buffer, unsigned short int length, unsigned short int distance) {
-	if (buffer -> pos < distance) {
-		WARNING_LOG("Invalid distance, which makes buffer pointer negative: %d, (index: %u, distance: %u)", buffer -> pos - distance, buffer -> pos, distance);
+/// Copy a match with wide overlapping chunks, the destination must have at
+/// least FAST_OUTPUT_SLACK bytes of room, as up to 15 bytes past length are written.
+static inline void copy_match(unsigned char* dest, unsigned int length, unsigned int distance) {
+	const unsigned char* src = dest - distance;
+	const unsigned char* end = dest + length;
+	if (distance >= 16) {
+		do {
+			__builtin_memcpy(dest, src, 16);
+			dest += 16, src += 16;
+		} while (dest < end);
+	} else if (distance >= 8) {
+		do {
+			__builtin_memcpy(dest, src, 8);
+			dest += 8, src += 8;
+		} while (dest < end);
+	} else if (distance == 1) {
+		const unsigned long long int pattern = 0x0101010101010101ULL * *src;
+		do {
+			__builtin_memcpy(dest, &pattern, 8);
+			dest += 8;
+		} while (dest < end);
+	} else {
+		// Replicate the short period once, then the copy can proceed with
+		// chunks of the largest multiple of the period that fits in 8 bytes.
+		for (unsigned int i = 0; i < 8; ++i) dest[i] = src[i % distance];
+		const unsigned int step = 8 - (8 % distance);
+		dest += step;
+		while (dest < end) {
+			__builtin_memcpy(dest, dest - step, 8);
+			dest += step;
+		}
+	}
+	return;
+}
+
+/// Copy a match whose source starts before this output buffer, taking the
+/// bytes from the history window until the match reaches the buffer itself.
+static void copy_history(const ZLIBInflateStream* stream, unsigned char* data, unsigned int pos, unsigned int length, unsigned int distance) {
+	unsigned int i = 0;
+	if (distance > pos) {
+		const unsigned int from_window = MIN(length, distance - pos);
+		unsigned int window_idx = (stream -> window_pos + WINDOW_SIZE - (distance - pos)) & (WINDOW_SIZE - 1);
+		for (; i < from_window; ++i) {
+			data[pos + i] = (stream -> window)[window_idx];
+			window_idx = (window_idx + 1) & (WINDOW_SIZE - 1);
+		}
+	}
+
+	// When the match overlaps itself the bytes must be replicated forward one by one
+	unsigned char* dest = data + pos;
+	const unsigned char* src = dest - distance;
+	if (distance >= length - i) mem_cpy(dest + i, src + i, length - i);
+	else for (; i < length; ++i) dest[i] = src[i];
+
+	return;
+}
+
+/// Decode the symbols while the input holds a whole word past the position and
+/// the output has FAST_OUTPUT_SLACK bytes of room, keeping the bits in a local
+/// buffer refilled once per symbol, as a full literal/length and distance pair
+/// with their extra bits takes at most 48 bits.
+/// Returns with the stream synced back, leaving the tail to the careful path.
+static int inflate_fast(const ZLIBInflateStream* stream, BitStream* bit_stream, ZLIBBuffer* buffer, unsigned char* end_of_block) {
+	const HFTable* literals_hf = &(stream -> literals_hf);
+	const HFTable* distance_hf = &(stream -> distance_hf);
+	const unsigned char* in = bit_stream -> stream;
+	const unsigned int in_limit = bit_stream -> size - FAST_INPUT_SLACK;
+	unsigned char* out = buffer -> data;
+	const unsigned int out_limit = buffer -> size - FAST_OUTPUT_SLACK;
+
+	unsigned int in_pos = bit_stream -> byte_pos;
+	unsigned int out_pos = buffer -> pos;
+	unsigned long long int bits = xcomp_read_le64(in + in_pos) >> bit_stream -> bit_pos;
+	unsigned char bits_len = 56 - bit_stream -> bit_pos;
+	in_pos += 7;
+
+	int err = ZLIB_NO_ERROR;
+	while (in_pos <= in_limit && out_pos <= out_limit) {
+		// Top up the buffer to at least 56 bits, the bytes only partially
+		// loaded are loaded again, which is harmless as the bits are the same.
+		bits |= xcomp_read_le64(in + in_pos) << bits_len;
+		in_pos += (63 - bits_len) >> 3;
+		bits_len |= 56;
+
+		HFEntry entry = hf_lookup(literals_hf, bits);
+		if (entry.length == 0 || entry.value > 285) {
+			err = -ZLIB_CORRUPTED_DATA;
+			break;
+		}
+		bits >>= entry.length, bits_len -= entry.length;
+
+		if (entry.value < 256) {
+			out[out_pos++] = entry.value;
+			continue;
+		} else if (entry.value == 256) {
+			*end_of_block = TRUE;
+			break;
+		}
+
+		const unsigned char length_code = entry.value - 257;
+		const unsigned int length = length_base_values[length_code] + (bits & XCOMP_MASK_BITS_PRECEDING(length_extra_bits[length_code]));
+		bits >>= length_extra_bits[length_code], bits_len -= length_extra_bits[length_code];
+
+		entry = hf_lookup(distance_hf, bits);
+		if (entry.length == 0 || entry.value >= HF_DISTANCE_SIZE) {
+			err = -ZLIB_CORRUPTED_DATA;
+			break;
+		}
+		bits >>= entry.length, bits_len -= entry.length;
+
+		const unsigned int distance = distance_base_values[entry.value] + (bits & XCOMP_MASK_BITS_PRECEDING(distance_extra_bits[entry.value]));
+		bits >>= distance_extra_bits[entry.value], bits_len -= distance_extra_bits[entry.value];
+		if (distance <= out_pos) copy_match(out + out_pos, length, distance);
+		else if (distance <= out_pos + stream -> window_len) copy_history(stream, out, out_pos, length, distance);
+		else {
+			WARNING_LOG("Invalid distance, which makes buffer pointer negative: (index: %u, distance: %u)", out_pos, distance);
+			err = -ZLIB_CORRUPTED_DATA;
+			break;
+		}
+
+		out_pos += length;
+	}
+
+	// Move the stream to the first unused bit, dropping the cached bits
+	const unsigned long long int bit_position = in_pos * 8ULL - bits_len;
+	bit_stream -> byte_pos = bit_position >> 3;
+	bit_stream -> bit_pos = bit_position & 7;
+	bit_stream -> bit_buffer_len = 0;
+	buffer -> pos = out_pos;
+
+	return err;
+}
+
+/// Careful counterpart of the fast loop: the symbol, along with its extra bits
+/// and distance, is consumed only once it's known to be entirely available.
+/// Returns the literal/length value, setting length and distance for the matches.
+static int decode_symbol(BitStream* bit_stream, const HFTable* literals_hf, const HFTable* distance_hf, unsigned int* length, unsigned int* distance) {
+	const unsigned long long int available = bitstream_available_bits(bit_stream);
+	const unsigned long long int bits = bitstream_peek_bits(bit_stream, 48);
+
+	HFEntry entry = hf_lookup(literals_hf, bits);
+	if (entry.length == 0 || entry.length > available) return (available < literals_hf -> max_bit_length) ? -ZLIB_NEED_MORE_INPUT : -ZLIB_CORRUPTED_DATA;
+	else if (entry.value > 285) {
+		WARNING_LOG("Invalid literal/length value: %u.", entry.value);
 		return -ZLIB_CORRUPTED_DATA;
 	}
 
-	const int copy_len = MIN(MAX((buffer -> size - buffer -> pos), 0), length);
-	if (copy_len > 0) {
-		mem_cpy(buffer -> data + buffer -> pos, buffer -> data + buffer -> pos - distance, copy_len);
-		buffer -> pos += copy_len;
+	const unsigned short int value = entry.value;
+	unsigned char used_bits = entry.length;
+	if (value > 256) {
+		const unsigned char length_code = value - 257;
+		*length = length_base_values[length_code] + ((bits >> used_bits) & XCOMP_MASK_BITS_PRECEDING(length_extra_bits[length_code]));
+		used_bits += length_extra_bits[length_code];
+
+		entry = hf_lookup(distance_hf, bits >> used_bits);
+		if (entry.length == 0 || used_bits + entry.length > available) return (available < used_bits + distance_hf -> max_bit_length) ? -ZLIB_NEED_MORE_INPUT : -ZLIB_CORRUPTED_DATA;
+		else if (entry.value >= HF_DISTANCE_SIZE) {
+			WARNING_LOG("Invalid distance value: %u.", entry.value);
+			return -ZLIB_CORRUPTED_DATA;
+		}
+		used_bits += entry.length;
+
+		*distance = distance_base_values[entry.value] + ((bits >> used_bits) & XCOMP_MASK_BITS_PRECEDING(distance_extra_bits[entry.value]));
+		used_bits += distance_extra_bits[entry.value];
 	}
-	
-	return ZLIB_NO_ERROR;
+
+	if (used_bits > available) return -ZLIB_NEED_MORE_INPUT;
+	bitstream_consume_bits(bit_stream, used_bits);
+
+	return value;
 }
 
-/// Get length from table defined in the specification.
-static int get_length(BitStream* bit_stream, unsigned short int value) {
-    const unsigned short int base_values[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
-    const unsigned char extra_bits[]       = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
-	
-	// Some of the entries require to read additional bits.
-	unsigned char extra = 0;
-	bitstream_read_bits(bit_stream, extra_bits[value - 257], &extra);
-	if (bit_stream -> error) return -ZLIB_IO_ERROR;
+static void release_tables(ZLIBInflateStream* stream) {
+	DEALLOCATE_TABLES(&(stream -> literals_hf), &(stream -> distance_hf));
+	stream -> literals_hf = (HFTable) {0};
+	stream -> distance_hf = (HFTable) {0};
+	return;
+}
 
-    return (base_values[value - 257] + extra);
+static void end_block(ZLIBInflateStream* stream) {
+	release_tables(stream);
+	if (!(stream -> is_final)) stream -> state = INFLATE_BLOCK_HEADER;
+	else stream -> state = (stream -> has_zlib_wrapper) ? INFLATE_ZLIB_TRAILER : INFLATE_DONE;
+	return;
 }
 
-/// Similarly, as above, we perform a lookup operation.
-static int get_distance(BitStream* bit_stream, unsigned short int value) {
-    const unsigned short int base_values[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
-    const unsigned char extra_bits[]       = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
-	
-	// Some of the entries require to read additional bits.
-	int extra = 0;
-	bitstream_read_bits(bit_stream, extra_bits[value], &extra);
+static int read_zlib_header(BitStream* bit_stream, zlib_header_t* zlib_header) {
+	unsigned char compress_data = bitstream_read_next_byte(bit_stream);
 	if (bit_stream -> error) return -ZLIB_IO_ERROR;
-	
-    return (base_values[value] + extra);
+    
+	unsigned char flags = bitstream_read_next_byte(bit_stream);
+	if (bit_stream -> error) return -ZLIB_IO_ERROR;
+
+	zlib_header -> compression_method = compress_data & 0x0F;
+    zlib_header -> window_size        = (compress_data >> 4) & 0x0F;
+    zlib_header -> preset_dictionary  = ((flags & 0x20) >> 5) & 0x01;
+    zlib_header -> compression_level  = ((flags & 0xC0) >> 6) & 0x03;
+
+    if (zlib_header -> compression_method != 8)       return -ZLIB_INVALID_COMPRESSION_METHOD;
+	else if (zlib_header -> window_size > 7)          return -ZLIB_INVALID_WINDOW_SIZE;
+	else if (zlib_header -> preset_dictionary)        return -ZLIB_DICTIONARY_NOT_SUPPORTED;
+	else if ((compress_data * 256 + flags) % 31 != 0) return -ZLIB_INVALID_CHECKSUM;
+    
+	zlib_header -> window_size = 1 << (zlib_header -> window_size + 8);
+
+	DEBUG_LOG("-- ZLIB HEADER --");
+    DEBUG_LOG("compression method: %u", zlib_header -> compression_method);
+    DEBUG_LOG("window size:        %u", zlib_header -> window_size);
+    DEBUG_LOG("preset dictionary:  %u", zlib_header -> preset_dictionary);
+    DEBUG_LOG("compression level:  %u", zlib_header -> compression_level);
+	DEBUG_LOG("-----------------");
+
+    return 0;
+}
+
+static int inflate_zlib_header(ZLIBInflateStream* stream, BitStream* bit_stream) {
+	NEED_BITS(bit_stream, 16);
+	zlib_header_t zlib_header = {0};
+	int err = read_zlib_header(bit_stream, &zlib_header);
+	if (err < 0) return err;
+	stream -> state = INFLATE_BLOCK_HEADER;
+	return ZLIB_NO_ERROR;
 }
 
+static int inflate_block_header(ZLIBInflateStream* stream, BitStream* bit_stream) {
+	NEED_BITS(bit_stream, 3);
+	ZLIBBlock block = {0};
+	bitstream_read_bits(bit_stream, 3, &block);
 
-// TODO: Should probably handle the difference between fixed HF and dynamic HF
-static int decode_compressed_block(BType compression_method, BitStream* bit_stream, ZLIBBuffer* buffer, int* zlib_err) { 
-	HFTable literals_hf = (HFTable) {0};
-	HFTable distance_hf = (HFTable) {0};
-	if (compression_method == COMPRESSED_FIXED_HF) {
-		fixed_literals_hf(&literals_hf);
-		fixed_distance_hf(&distance_hf);
-	} else if ((*zlib_err = decode_dhf_tables(bit_stream, &literals_hf, &distance_hf)) < 0) {
-		WARNING_LOG("An error occurred during dynamic HF table decoding.");
-		return *zlib_err;
-	}
+	DEBUG_LOG("%sBlock: compression_method: '%s'", block.is_final ? "FINAL " : "", btypes_str[block.compression_method]);
 
-	while ((bit_stream -> error == 0) && (*zlib_err == 0)) {
-		// Decode the literal/length value
-		int literal = decode_hf(bit_stream, bitstream_read_next_bit(bit_stream), literals_hf, zlib_err);
-		if (literal < 0) {
-			DEBUG_LOG("Failed at decoding the literal");
-			break;
+	int err = ZLIB_NO_ERROR;
+	if (block.compression_method == RESERVED) return -ZLIB_INVALID_COMPRESSION_METHOD;
+	else if (block.compression_method == NO_COMPRESSION) stream -> state = INFLATE_STORED_HEADER;
+	else if (block.compression_method == COMPRESSED_FIXED_HF) {
+		if ((err = fixed_hf_tables(&(stream -> literals_hf), &(stream -> distance_hf))) < 0) {
+			WARNING_LOG("An error occurred while generating the fixed HF tables.");
+			return err;
 		}
-		
-		if (literal == 256) break;
-		else if (literal < 256) {
-			// literal/length value < 256: copy value (literal/length byte) to output stream
-			(buffer -> data)[(buffer -> pos)++] = literal;
-		} else {
-			int length = get_length(bit_stream, literal);
-			
-			// Decode the distance value
-			int distance = decode_hf(bit_stream, bitstream_read_next_bit(bit_stream), distance_hf, zlib_err);
-			if (distance < 0) break;
-			distance = get_distance(bit_stream, distance);
-		
-			// Move backwards distance bytes in the output stream, and copy
-			// length bytes from this position to the output stream
-			*zlib_err = copy_data(buffer, length, distance);
+		stream -> state = INFLATE_COMPRESSED_DATA;
+	} else {
+		if ((err = decode_dhf_tables(bit_stream, &(stream -> literals_hf), &(stream -> distance_hf))) < 0) {
+			release_tables(stream);
+			if (err != -ZLIB_NEED_MORE_INPUT) WARNING_LOG("An error occurred during dynamic HF table decoding.");
+			return err;
 		}
+		stream -> state = INFLATE_COMPRESSED_DATA;
 	}
-	
-	if (bit_stream -> error) *zlib_err = -ZLIB_IO_ERROR;	
-	DEALLOCATE_TABLES(&literals_hf, &distance_hf);
-	
-	return *zlib_err;
+
+	stream -> is_final = block.is_final;
+
+	return ZLIB_NO_ERROR;
 }
 
-static int read_uncompressed_data(BitStream* bit_stream, ZLIBBuffer* buffer) {
-	skip_to_next_byte(bit_stream);
-	
-    // Read the length and its one-complement, and check if there's corruption
-	unsigned short int length = 0;
-	mem_cpy(&length, bitstream_read_bytes(bit_stream, sizeof(unsigned short int), 1), sizeof(unsigned short int));
-	if (bit_stream -> error) return -ZLIB_IO_ERROR;
+static int inflate_stored_header(ZLIBInflateStream* stream, BitStream* bit_stream) {
+	// Skip to the next byte, then read the length and its one-complement, and check if there's corruption
+	const unsigned char padding = (8 - bit_stream -> bit_pos) & 7;
+	NEED_BITS(bit_stream, padding + 32);
+	bitstream_consume_bits(bit_stream, padding);
 
+	unsigned short int length = 0;
 	unsigned short int length_c = 0;
-	mem_cpy(&length_c, bitstream_read_bytes(bit_stream, sizeof(unsigned short int), 1), sizeof(unsigned short int));
-	if (bit_stream -> error) return -ZLIB_IO_ERROR;
+	bitstream_read_bits(bit_stream, 16, &length);
+	bitstream_read_bits(bit_stream, 16, &length_c);
 
 	const unsigned short int check = ((length ^ length_c) + 1) & 0xFFFF;
     if (check) {
 		WARNING_LOG("Corrupted length: ((0x%X ^ 0x%X) + 1 = 0x%X) which is not equal to 0.", length, length_c, check);
 		return -ZLIB_INVALID_LEN_CHECKSUM;
-	} else if (length + bit_stream -> byte_pos > bit_stream -> size) {
-		WARNING_LOG("Invalid length: %u would make bitstream pointer read out of bound.", length);
-		PRINT_BIT_STREAM_INFO(bit_stream);
-		return -ZLIB_CORRUPTED_DATA;
 	}
 
-	// Read length bytes from the stream
-	const unsigned int copy_size = MIN(MAX((buffer -> size - buffer -> pos), 0), length);
-	if (copy_size > 0) {
-		mem_cpy(buffer -> data + buffer -> pos, bitstream_read_bytes(bit_stream, sizeof(unsigned char), length), copy_size);
-		if (bit_stream -> error) return -ZLIB_IO_ERROR;
+	stream -> stored_length = length;
+	stream -> state = INFLATE_STORED_DATA;
+
+	return ZLIB_NO_ERROR;
+}
+
+static int inflate_stored_data(ZLIBInflateStream* stream, BitStream* bit_stream, ZLIBBuffer* buffer) {
+	while (stream -> stored_length > 0) {
+		const unsigned int available = (bit_stream -> byte_pos < bit_stream -> size) ? bit_stream -> size - bit_stream -> byte_pos : 0;
+		const unsigned int copy_size = MIN(MIN(stream -> stored_length, available), buffer -> size - buffer -> pos);
+		if (copy_size == 0) return (buffer -> pos == buffer -> size) ? -ZLIB_NEED_MORE_OUTPUT : -ZLIB_NEED_MORE_INPUT;
+
+		mem_cpy(buffer -> data + buffer -> pos, bit_stream -> stream + bit_stream -> byte_pos, copy_size);
+		bit_stream -> byte_pos += copy_size;
+		bit_stream -> bit_buffer_len = 0;
 		buffer -> pos += copy_size;
+		stream -> stored_length -= copy_size;
 	}
 
+	end_block(stream);
+
 	return ZLIB_NO_ERROR;
 }
 
-static int read_block_header(BitStream* bit_stream, ZLIBBlock* block, int* zlib_err) {
-	mem_set(block, 0, sizeof(ZLIBBlock));
-	bitstream_read_bits(bit_stream, 3, block);
-	if (bit_stream -> error) *zlib_err = -ZLIB_IO_ERROR;														
-	return *zlib_err;
+/// Run the fast loop as long as there is enough slack in both the input and the output,
+/// finishing the symbols one at a time, while a match cut by a full output is carried over.
+static int inflate_compressed_data(ZLIBInflateStream* stream, BitStream* bit_stream, ZLIBBuffer* buffer, unsigned int stop_byte_pos) {
+	while (TRUE) {
+		if (stream -> match_length > 0) {
+			const unsigned int copy_len = MIN(stream -> match_length, buffer -> size - buffer -> pos);
+			copy_history(stream, buffer -> data, buffer -> pos, copy_len, stream -> match_distance);
+			buffer -> pos += copy_len;
+			stream -> match_length -= copy_len;
+			if (stream -> match_length > 0) return -ZLIB_NEED_MORE_OUTPUT;
+		}
+
+		if (bit_stream -> byte_pos >= stop_byte_pos) return ZLIB_NO_ERROR;
+
+		if ((bit_stream -> byte_pos + 2 * FAST_INPUT_SLACK <= bit_stream -> size) && (buffer -> pos + FAST_OUTPUT_SLACK <= buffer -> size)) {
+			unsigned char end_of_block = FALSE;
+			const int err = inflate_fast(stream, bit_stream, buffer, &end_of_block);
+			if (err < 0) return err;
+			else if (end_of_block) break;
+			continue;
+		}
+
+		unsigned int length = 0;
+		unsigned int distance = 0;
+		if (buffer -> pos == buffer -> size) {
+			// A full output still leaves room for the end of block, so that the stream can end
+			BitStream peek_stream = *bit_stream;
+			const int value = decode_symbol(&peek_stream, &(stream -> literals_hf), &(stream -> distance_hf), &length, &distance);
+			if (value < 0) return value;
+			else if (value != 256) return -ZLIB_NEED_MORE_OUTPUT;
+			*bit_stream = peek_stream;
+			break;
+		}
+
+		const int value = decode_symbol(bit_stream, &(stream -> literals_hf), &(stream -> distance_hf), &length, &distance);
+		if (value < 0) return value;
+		else if (value < 256) {
+			(buffer -> data)[(buffer -> pos)++] = value;
+			continue;
+		} else if (value == 256) break;
+
+		if (distance > buffer -> pos + stream -> window_len) {
+			WARNING_LOG("Invalid distance, which makes buffer pointer negative: (index: %u, distance: %u)", buffer -> pos, distance);
+			return -ZLIB_CORRUPTED_DATA;
+		}
+
+		stream -> match_length = length;
+		stream -> match_distance = distance;
+	}
+
+	end_block(stream);
+
+	return ZLIB_NO_ERROR;
 }
 
-static unsigned char* deflate_block(BitStream* bit_stream, ZLIBBuffer* buffer, ZLIBBlock* block, int* zlib_err) {
-	// Read header bits
-	if ((read_block_header(bit_stream, block, zlib_err)) < 0) {
-		*zlib_err = -ZLIB_IO_ERROR;
-		return NULL;
+static int inflate_zlib_trailer(ZLIBInflateStream* stream, BitStream* bit_stream, ZLIBBuffer* buffer) {
+	const unsigned char padding = (8 - bit_stream -> bit_pos) & 7;
+	NEED_BITS(bit_stream, padding + 32);
+	bitstream_consume_bits(bit_stream, padding);
+
+	// Read the ADLER-CRC, stored in big-endian
+	unsigned int adler_crc = 0;
+	for (unsigned char i = 0; i < 4; ++i) {
+		unsigned char byte = 0;
+		bitstream_read_bits(bit_stream, 8, &byte);
+		adler_crc = (adler_crc << 8) | byte;
 	}
 
-	DEBUG_LOG("%sBlock: compression_method: '%s'", block -> is_final ? "FINAL " : "", btypes_str[block -> compression_method]);
-	
-	if (block -> compression_method == RESERVED) {
-		*zlib_err = -ZLIB_INVALID_COMPRESSION_METHOD; 
-		return NULL; 
-	} else if (block -> compression_method == NO_COMPRESSION) {
-		*zlib_err = read_uncompressed_data(bit_stream, buffer);
-		if (*zlib_err < 0) return NULL;
-	} else {
-		// Decode compressed data block
-		*zlib_err = decode_compressed_block(block -> compression_method, bit_stream, buffer, zlib_err);
-		if (*zlib_err < 0) return NULL;
+	// Calculate the ADLER-CRC of the blocks
+	stream -> adler = xcomp_adler32(buffer -> data + buffer -> checked_pos, buffer -> pos - buffer -> checked_pos, stream -> adler);
+	buffer -> checked_pos = buffer -> pos;
+	if (adler_crc != stream -> adler) {
+		DEBUG_LOG("adler_register: 0x%X, adler_crc: 0x%X", stream -> adler, adler_crc);
+		return -ZLIB_INVALID_ADLER_CHECKSUM;
 	}
 
-	return buffer -> data;
+	stream -> state = INFLATE_DONE;
+
+	return ZLIB_NO_ERROR;
 }
 
-static unsigned char* zlib_raw_inflate(BitStream* bit_stream, unsigned int window_size, unsigned int* decompressed_data_length, int* zlib_err) {
-	ZLIBBuffer buffer = { .pos = 0, .size = window_size };
-	const unsigned int max_data_length = *decompressed_data_length;
-	if (max_data_length > 0) buffer.size = max_data_length;
-	
-	buffer.data = (unsigned char*) xcomp_calloc(buffer.size, sizeof(unsigned char));
-    if (buffer.data == NULL) {
-		*zlib_err = -ZLIB_IO_ERROR;
-		return NULL;
+/// Decode from the given bit_stream until it ends, the output is full, or the
+/// stream is done, stopping early at the first unit starting past stop_byte_pos.
+/// The headers are atomic: when they are cut by the end of the input, the
+/// position is moved back to their start, to parse them again later.
+static int inflate_units(ZLIBInflateStream* stream, BitStream* bit_stream, ZLIBBuffer* buffer, unsigned int stop_byte_pos) {
+	while (stream -> state != INFLATE_DONE) {
+		if (bit_stream -> byte_pos >= stop_byte_pos) return ZLIB_NO_ERROR;
+
+		const unsigned int byte_pos = bit_stream -> byte_pos;
+		const unsigned char bit_pos = bit_stream -> bit_pos;
+		const InflateState state = stream -> state;
+
+		int err = ZLIB_NO_ERROR;
+		switch (state) {
+			case INFLATE_ZLIB_HEADER:     err = inflate_zlib_header(stream, bit_stream);                            break;
+			case INFLATE_BLOCK_HEADER:    err = inflate_block_header(stream, bit_stream);                           break;
+			case INFLATE_STORED_HEADER:   err = inflate_stored_header(stream, bit_stream);                          break;
+			case INFLATE_STORED_DATA:     err = inflate_stored_data(stream, bit_stream, buffer);                    break;
+			case INFLATE_COMPRESSED_DATA: err = inflate_compressed_data(stream, bit_stream, buffer, stop_byte_pos); break;
+			case INFLATE_ZLIB_TRAILER:    err = inflate_zlib_trailer(stream, bit_stream, buffer);                   break;
+			case INFLATE_DONE:                                                                                      break;
+		}
+
+		if (err == -ZLIB_NEED_MORE_INPUT && state != INFLATE_STORED_DATA && state != INFLATE_COMPRESSED_DATA) {
+			bit_stream -> byte_pos = byte_pos;
+			bit_stream -> bit_pos = bit_pos;
+			bit_stream -> bit_buffer_len = 0;
+		}
+
+		if (err < 0) return err;
 	}
 
-    ZLIBBlock block = {0};
-	while (!block.is_final) {
-		if ((max_data_length > 0) && (buffer.pos > max_data_length)) break;
-		
-		deflate_block(bit_stream, &buffer, &block, zlib_err);
-		if (*zlib_err < 0) {
-			XCOMP_SAFE_FREE(buffer.data);
-			return NULL;
+	return ZLIB_NO_ERROR;
+}
+
+/// Append the produced output to the history window.
+static void update_window(ZLIBInflateStream* stream, const unsigned char* data, unsigned int size) {
+	if (size >= WINDOW_SIZE) {
+		mem_cpy(stream -> window, data + size - WINDOW_SIZE, WINDOW_SIZE);
+		stream -> window_pos = 0;
+		stream -> window_len = WINDOW_SIZE;
+		return;
+	}
+
+	const unsigned int head_size = MIN(size, WINDOW_SIZE - stream -> window_pos);
+	mem_cpy(stream -> window + stream -> window_pos, data, head_size);
+	mem_cpy(stream -> window, data + head_size, size - head_size);
+	stream -> window_pos = (stream -> window_pos + size) & (WINDOW_SIZE - 1);
+	stream -> window_len = MIN(stream -> window_len + size, WINDOW_SIZE);
+
+	return;
+}
+
+static int end_stream_call(ZLIBInflateStream* stream, ZLIBBuffer* buffer, int err, unsigned int* produced) {
+	if (stream -> has_zlib_wrapper) stream -> adler = xcomp_adler32(buffer -> data + buffer -> checked_pos, buffer -> pos - buffer -> checked_pos, stream -> adler);
+	update_window(stream, buffer -> data, buffer -> pos);
+	*produced = buffer -> pos;
+
+	if (err == -ZLIB_NEED_MORE_INPUT || err == -ZLIB_NEED_MORE_OUTPUT) err = ZLIB_NO_ERROR;
+	if (err < 0) return err;
+
+	return (stream -> state == INFLATE_DONE) ? ZLIB_STREAM_END : ZLIB_STREAM_CONTINUE;
+}
+
+void zlib_inflate_stream_init(ZLIBInflateStream* stream, unsigned char has_zlib_wrapper) {
+	mem_set(stream, 0, sizeof(ZLIBInflateStream));
+	stream -> has_zlib_wrapper = has_zlib_wrapper;
+	stream -> state = has_zlib_wrapper ? INFLATE_ZLIB_HEADER : INFLATE_BLOCK_HEADER;
+	stream -> adler = 1;
+	return;
+}
+
+void zlib_inflate_stream_end(ZLIBInflateStream* stream) {
+	release_tables(stream);
+	stream -> pending_len = 0;
+	return;
+}
+
+int zlib_inflate_stream(ZLIBInflateStream* stream, const unsigned char* data, unsigned int size, unsigned int* consumed, unsigned char* out, unsigned int out_size, unsigned int* produced) {
+	*consumed = 0;
+	*produced = 0;
+	if (stream -> state == INFLATE_DONE) return ZLIB_STREAM_END;
+
+	ZLIBBuffer buffer = { .data = out, .size = out_size, .pos = 0, .checked_pos = 0 };
+	unsigned int in_pos = 0;
+	int err = ZLIB_NO_ERROR;
+
+	// Complete first the header left incomplete by the previous chunk, topping
+	// up the carried bytes with the head of this one, then move on to the chunk
+	// itself as soon as the carried bytes are consumed.
+	if (stream -> pending_len > 0) {
+		const unsigned int carried = stream -> pending_len;
+		const unsigned int taken = MIN(size, INFLATE_PENDING_SIZE - carried);
+		mem_cpy(stream -> pending + carried, data, taken);
+
+		BitStream bit_stream = CREATE_BIT_STREAM(stream -> pending, carried + taken);
+		bit_stream.bit_pos = stream -> bit_pos;
+		err = inflate_units(stream, &bit_stream, &buffer, carried);
+		stream -> bit_pos = bit_stream.bit_pos;
+
+		if (bit_stream.byte_pos < carried) {
+			const unsigned char needs_input = (err == -ZLIB_NEED_MORE_INPUT);
+			const unsigned int kept = (stream -> state == INFLATE_DONE) ? 0 : (needs_input ? carried + taken : carried) - bit_stream.byte_pos;
+			mem_move(stream -> pending, stream -> pending + bit_stream.byte_pos, kept);
+			stream -> pending_len = kept;
+			*consumed = needs_input ? taken : 0;
+			return end_stream_call(stream, &buffer, err, produced);
 		}
 
-		if (max_data_length == 0) {
-			buffer.size += window_size;
-			buffer.data = realloc(buffer.data, buffer.size);
-		    if (buffer.data == NULL) {
-				*zlib_err = -ZLIB_IO_ERROR;
-				return NULL;
-			}
+		in_pos = bit_stream.byte_pos - carried;
+		stream -> pending_len = 0;
+		if (stream -> state == INFLATE_DONE) {
+			*consumed = in_pos + (stream -> bit_pos > 0);
+			stream -> bit_pos = 0;
+			return end_stream_call(stream, &buffer, err, produced);
+		} else if (err < 0 && err != -ZLIB_NEED_MORE_INPUT) {
+			*consumed = in_pos;
+			return end_stream_call(stream, &buffer, err, produced);
 		}
 	}
-	
-	*decompressed_data_length = buffer.pos;
-	buffer.data = realloc(buffer.data, buffer.pos);
-	if (buffer.data == NULL) {
+
+	BitStream bit_stream = CREATE_BIT_STREAM((unsigned char*) data + in_pos, size - in_pos);
+	bit_stream.bit_pos = stream -> bit_pos;
+	err = inflate_units(stream, &bit_stream, &buffer, 0xFFFFFFFF);
+	stream -> bit_pos = bit_stream.bit_pos;
+
+	if (err == -ZLIB_NEED_MORE_INPUT) {
+		// Carry over the bytes of the incomplete header
+		const unsigned int left = bit_stream.size - bit_stream.byte_pos;
+		if (left > INFLATE_PENDING_SIZE / 2) {
+			WARNING_LOG("Incomplete header longer than any valid one: %u bytes.", left);
+			return end_stream_call(stream, &buffer, -ZLIB_CORRUPTED_DATA, produced);
+		}
+		mem_cpy(stream -> pending, bit_stream.stream + bit_stream.byte_pos, left);
+		stream -> pending_len = left;
+		*consumed = size;
+	} else if (stream -> state == INFLATE_DONE) {
+		*consumed = in_pos + bit_stream.byte_pos + (bit_stream.bit_pos > 0);
+		stream -> bit_pos = 0;
+	} else *consumed = in_pos + bit_stream.byte_pos;
+
+	return end_stream_call(stream, &buffer, err, produced);
+}
+
+/// Run the stream until its end, appending to the output buffer, which grows as
+/// needed, unless it's fixed, in which case it fails once the buffer is full.
+static int inflate_to_end(ZLIBInflateStream* stream, const unsigned char* data, unsigned int size, unsigned int* in_pos, ZLIBBuffer* output, unsigned char is_fixed_output) {
+	while (TRUE) {
+		unsigned int consumed = 0;
+		unsigned int produced = 0;
+		const int err = zlib_inflate_stream(stream, data + *in_pos, size - *in_pos, &consumed, output -> data + output -> pos, output -> size - output -> pos, &produced);
+		*in_pos += consumed;
+		output -> pos += produced;
+		if (err < 0) return err;
+		else if (err == ZLIB_STREAM_END) return ZLIB_NO_ERROR;
+		else if (consumed > 0 || produced > 0) continue;
+
+		// No progress: either the output is full, or the input ended early
+		if (output -> pos < output -> size) {
+			WARNING_LOG("Truncated compressed stream.");
+			return -ZLIB_IO_ERROR;
+		} else if (is_fixed_output) return -ZLIB_NEED_MORE_OUTPUT;
+		else if (output -> size > 0x3FFFFFFF) {
+			WARNING_LOG("The decompressed data exceeds the maximum supported size.");
+			return -ZLIB_IO_ERROR;
+		}
+
+		const unsigned int capacity = MAX(output -> size * 2, (unsigned int) WINDOW_SIZE);
+		unsigned char* grown_data = (unsigned char*) xcomp_realloc(output -> data, capacity * sizeof(unsigned char));
+		if (grown_data == NULL) {
+			WARNING_LOG("Failed to reallocate the output buffer.");
+			return -ZLIB_IO_ERROR;
+		}
+		output -> data = grown_data;
+		output -> size = capacity;
+	}
+}
+
+/// Shrink the decoded data to its length, or release it on failure.
+static unsigned char* finalize_output(ZLIBBuffer* output, unsigned int* decompressed_data_length, int* zlib_err) {
+	if (*zlib_err < 0) {
+		XCOMP_SAFE_FREE(output -> data);
+		return NULL;
+	}
+
+	*zlib_err = ZLIB_NO_ERROR;
+	*decompressed_data_length = output -> pos;
+	unsigned char* decompressed_data = (unsigned char*) xcomp_realloc(output -> data, MAX(output -> pos, 1) * sizeof(unsigned char));
+	if (decompressed_data == NULL) {
+		XCOMP_SAFE_FREE(output -> data);
 		*zlib_err = -ZLIB_IO_ERROR;
 		return NULL;
 	}
-	
-	return buffer.data;
-}
 
-// -------------------------------------------------------------------------------------------
-// Decode Raw DEFLATE compressed data
-unsigned char* deflate_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zlib_err) {
-	BitStream bit_stream = CREATE_BIT_STREAM(stream, size);
-	unsigned char* decompressed_data = zlib_raw_inflate(&bit_stream, WINDOW_SIZE, decompressed_data_length, zlib_err);
-    if (*zlib_err < 0) XCOMP_SAFE_FREE(stream);
 	return decompressed_data;
 }
 
-// -------------------------------------------------------------------------------------------
-static inline unsigned int __adler_crc(const unsigned char* data, const unsigned int size, unsigned int adler_reg) {
-    const unsigned int prime = 65521;
-	unsigned int low  = adler_reg & 0xFFFF;
-	unsigned int high = (adler_reg >> 16) & 0xFFFF;
-	for (unsigned int i = 0; i < size; ++i) {
-		low  = (low + data[i]) % prime;
-		high = (low + high) % prime;
+/// One-shot decoding on top of the streaming interface, into a buffer that
+/// grows as needed, unless a maximum length of the decompressed data is given.
+static unsigned char* inflate_data(const unsigned char* data, unsigned int size, unsigned char has_zlib_wrapper, unsigned int* decompressed_data_length, int* zlib_err) {
+	ZLIBInflateStream* stream = xcomp_calloc(1, sizeof(ZLIBInflateStream));
+	const unsigned int max_data_length = *decompressed_data_length;
+	ZLIBBuffer output = { .data = NULL, .size = (max_data_length > 0) ? max_data_length : WINDOW_SIZE, .pos = 0, .checked_pos = 0 };
+	output.data = (unsigned char*) xcomp_calloc(output.size, sizeof(unsigned char));
+	if ((stream == NULL) || (output.data == NULL)) {
+		XCOMP_MULTI_FREE(stream, output.data);
+		*zlib_err = -ZLIB_IO_ERROR;
+		return NULL;
 	}
-	return ((high << 16) | low);
+
+	zlib_inflate_stream_init(stream, has_zlib_wrapper);
+
+	unsigned int in_pos = 0;
+	*zlib_err = inflate_to_end(stream, data, size, &in_pos, &output, max_data_length > 0);
+	if (*zlib_err == -ZLIB_NEED_MORE_OUTPUT) *zlib_err = ZLIB_NO_ERROR;
+
+	zlib_inflate_stream_end(stream);
+	XCOMP_SAFE_FREE(stream);
+
+	return finalize_output(&output, decompressed_data_length, zlib_err);
 }
 
-static int read_zlib_header(BitStream* bit_stream, zlib_header_t* zlib_header) {
-	unsigned char compress_data = bitstream_read_next_byte(bit_stream);
-	if (bit_stream -> error) return -ZLIB_IO_ERROR;
-    
-	unsigned char flags = bitstream_read_next_byte(bit_stream);
-	if (bit_stream -> error) return -ZLIB_IO_ERROR;
+/// One-shot decoding into a fixed buffer, whose length is capped to fit the returned int.
+static int inflate_data_into(const unsigned char* data, unsigned int size, unsigned char has_zlib_wrapper, unsigned char* out, unsigned int out_size) {
+	ZLIBInflateStream* stream = xcomp_calloc(1, sizeof(ZLIBInflateStream));
+	if (stream == NULL) return -ZLIB_IO_ERROR;
 
-	zlib_header -> compression_method = compress_data & 0x0F;
-    zlib_header -> window_size        = (compress_data >> 4) & 0x0F;
-    zlib_header -> preset_dictionary  = ((flags & 0x20) >> 5) & 0x01;
-    zlib_header -> compression_level  = ((flags & 0xC0) >> 6) & 0x03;
+	zlib_inflate_stream_init(stream, has_zlib_wrapper);
 
-    if (zlib_header -> compression_method != 8)       return -ZLIB_INVALID_COMPRESSION_METHOD;
-	else if (zlib_header -> window_size > 7)          return -ZLIB_INVALID_WINDOW_SIZE;
-	else if (zlib_header -> preset_dictionary)        return -ZLIB_DICTIONARY_NOT_SUPPORTED;
-	else if ((compress_data * 256 + flags) % 31 != 0) return -ZLIB_INVALID_CHECKSUM;
-    
-	zlib_header -> window_size = 1 << (zlib_header -> window_size + 8);
+	unsigned int in_pos = 0;
+	ZLIBBuffer output = { .data = out, .size = MIN(out_size, 0x7FFFFFFFU), .pos = 0, .checked_pos = 0 };
+	const int err = inflate_to_end(stream, data, size, &in_pos, &output, TRUE);
 
-	DEBUG_LOG("-- ZLIB HEADER --");
-    DEBUG_LOG("compression method: %u", zlib_header -> compression_method);
-    DEBUG_LOG("window size:        %u", zlib_header -> window_size);
-    DEBUG_LOG("preset dictionary:  %u", zlib_header -> preset_dictionary);
-    DEBUG_LOG("compression level:  %u", zlib_header -> compression_level);
-	DEBUG_LOG("-----------------");
+	zlib_inflate_stream_end(stream);
+	XCOMP_SAFE_FREE(stream);
 
-    return 0;
+	return (err < 0) ? err : (int) output.pos;
+}
+
+// -------------------------------------------------------------------------------------------
+// Decode Raw DEFLATE compressed data
+unsigned char* deflate_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zlib_err) {
+	unsigned char* decompressed_data = inflate_data(stream, size, FALSE, decompressed_data_length, zlib_err);
+	XCOMP_SAFE_FREE(stream);
+	return decompressed_data;
 }
 
 unsigned char* zlib_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zlib_err) {
-	BitStream bit_stream = CREATE_BIT_STREAM(stream, size);
 	*decompressed_data_length = 0;
-    
-	zlib_header_t zlib_header = {0};
-	*zlib_err = read_zlib_header(&bit_stream, &zlib_header);
-    if (*zlib_err) return ((unsigned char*) "Invalid ZLIB Header");
+	unsigned char* decompressed_data = inflate_data(stream, size, TRUE, decompressed_data_length, zlib_err);
+	XCOMP_SAFE_FREE(stream);
 
-	unsigned char* decompressed_data = zlib_raw_inflate(&bit_stream, zlib_header.window_size, decompressed_data_length, zlib_err);
-	if (*zlib_err) {
-    	XCOMP_SAFE_FREE(stream);
-		return ((unsigned char*) "Failed to decompress data");
-	}
+	if (*zlib_err == -ZLIB_INVALID_WINDOW_SIZE || *zlib_err == -ZLIB_DICTIONARY_NOT_SUPPORTED || *zlib_err == -ZLIB_INVALID_CHECKSUM) return ((unsigned char*) "Invalid ZLIB Header");
+	else if (*zlib_err == -ZLIB_INVALID_ADLER_CHECKSUM) return ((unsigned char*) "corrupted compressed data blocks");
+	else if (*zlib_err < 0) return ((unsigned char*) "Failed to decompress data");
 
-    // Read the ADLER-CRC
-    unsigned int adler_crc = 0;
-	mem_cpy(&adler_crc, stream + size - 4, sizeof(unsigned int));
-	XCOMP_BE_CONVERT(&adler_crc, sizeof(unsigned int));
-	XCOMP_SAFE_FREE(stream);
+	DEBUG_LOG("decompressed_data_length: %u", *decompressed_data_length);
 
-    // Calculate the ADLER-CRC of the blocks
-    DEBUG_LOG("decompressed_data_length: %u", *decompressed_data_length);
-    
-	unsigned int adler_register = __adler_crc(decompressed_data, *decompressed_data_length, 1);
-    if (adler_crc != adler_register) {
-        *zlib_err = -ZLIB_INVALID_ADLER_CHECKSUM;
-        XCOMP_SAFE_FREE(decompressed_data);
-        DEBUG_LOG("adler_register: 0x%X, adler_crc: 0x%X", adler_register, adler_crc);
-        return ((unsigned char*) "corrupted compressed data blocks");
-    }
+	return decompressed_data;
+}
 
-	*zlib_err = ZLIB_NO_ERROR;
-	return decompressed_data; 
+int deflate_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size) {
+	return inflate_data_into(stream, size, FALSE, out, out_size);
+}
+
+int zlib_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size) {
+	return inflate_data_into(stream, size, TRUE, out, out_size);
 }
 
 #endif //_ZLIB_DECOMPRESS_H_
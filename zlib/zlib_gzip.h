@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2025 TheProgxy <theprogxy@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ZLIB_GZIP_H_
+#define _ZLIB_GZIP_H_
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Resources: gzip <https://www.ietf.org/rfc/rfc1952.txt>  *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// -------
+//  Enums
+// -------
+typedef enum GzipConstants {
+	GZIP_ID1          = 0x1F,
+	GZIP_ID2          = 0x8B,
+	GZIP_CM_DEFLATE   = 8,
+	GZIP_OS_UNKNOWN   = 255,
+	GZIP_HEADER_SIZE  = 10,
+	GZIP_TRAILER_SIZE = 8
+} GzipConstants;
+
+typedef enum GzipFlags {
+	GZIP_FTEXT    = 0x01,
+	GZIP_FHCRC    = 0x02,
+	GZIP_FEXTRA   = 0x04,
+	GZIP_FNAME    = 0x08,
+	GZIP_FCOMMENT = 0x10,
+	GZIP_RESERVED = 0xE0
+} GzipFlags;
+
+/* -------------------------------------------------------------------------------------------------------- */
+// ------------------------
+//  Functions Declarations
+// ------------------------
+
+/// NOTE: the stream will be always deallocated both in case of failure and success.
+/// 	  Furthermore, the function allocates the returned stream of bytes, so that
+/// 	  once it's on the hand of the caller, it's responsible to manage that memory.
+/// 	  All the members of the stream are decoded, and their data concatenated.
+unsigned char* gzip_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zlib_err);
+
+/// NOTE: the stream is only read, and it's never deallocated, while the data is
+/// 	  decompressed straight into the caller's buffer of out_size bytes.
+/// 	  Returns the length of the decompressed data, -ZLIB_NEED_MORE_OUTPUT if it
+/// 	  doesn't fit in the buffer, or another negative ZlibError on failure.
+int gzip_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size);
+
+/// NOTE: the stream will be always deallocated both in case of failure and success.
+/// 	  Furthermore, the function allocates the returned stream of bytes, so that
+/// 	  once it's on the hand of the caller, it's responsible to manage that memory.
+/// 	  The data is written as a single member, so that the outputs of several calls
+/// 	  can be concatenated into a multi-member stream.
+/// 	  The level goes from ZLIB_NO_COMPRESSION (0) to ZLIB_ULTRA_COMPRESSION (10).
+unsigned char* gzip_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned int* compressed_data_len, int* zlib_err);
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+static unsigned int gzip_read_le32(const unsigned char* data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int) data[3] << 24);
+}
+
+/// Skip a zero-terminated field of the header, returning FALSE if it's cut by the end of the data.
+static unsigned char skip_gzip_string(const unsigned char* data, unsigned int size, unsigned int* pos) {
+	while (*pos < size && data[*pos] != '\0') (*pos)++;
+	if (*pos == size) return FALSE;
+	(*pos)++;
+	return TRUE;
+}
+
+static int read_gzip_header(const unsigned char* data, unsigned int size, unsigned int* header_len) {
+	if (size < GZIP_HEADER_SIZE) {
+		WARNING_LOG("Truncated gzip header: %u bytes.", size);
+		return -ZLIB_IO_ERROR;
+	} else if (data[0] != GZIP_ID1 || data[1] != GZIP_ID2) {
+		WARNING_LOG("Invalid gzip magic: 0x%02X%02X.", data[0], data[1]);
+		return -ZLIB_INVALID_GZIP_HEADER;
+	} else if (data[2] != GZIP_CM_DEFLATE) {
+		WARNING_LOG("Invalid compression method: %u, only deflate (%u) is defined.", data[2], GZIP_CM_DEFLATE);
+		return -ZLIB_INVALID_COMPRESSION_METHOD;
+	}
+
+	const unsigned char flags = data[3];
+	if (flags & GZIP_RESERVED) {
+		WARNING_LOG("Used gzip header reserved flags: 0x%02X.", flags & GZIP_RESERVED);
+		return -ZLIB_INVALID_GZIP_HEADER;
+	}
+
+	// MTIME, XFL and OS are only informative
+	unsigned int pos = GZIP_HEADER_SIZE;
+	if (flags & GZIP_FEXTRA) {
+		if (size - pos < 2 || size - pos - 2 < (unsigned int) (data[pos] | (data[pos + 1] << 8))) {
+			WARNING_LOG("Truncated gzip extra field.");
+			return -ZLIB_IO_ERROR;
+		}
+		pos += 2 + (data[pos] | (data[pos + 1] << 8));
+	}
+
+	if ((flags & GZIP_FNAME) && !skip_gzip_string(data, size, &pos)) {
+		WARNING_LOG("Truncated gzip file name.");
+		return -ZLIB_IO_ERROR;
+	} else if ((flags & GZIP_FCOMMENT) && !skip_gzip_string(data, size, &pos)) {
+		WARNING_LOG("Truncated gzip comment.");
+		return -ZLIB_IO_ERROR;
+	}
+
+	if (flags & GZIP_FHCRC) {
+		if (size - pos < 2) {
+			WARNING_LOG("Truncated gzip header checksum.");
+			return -ZLIB_IO_ERROR;
+		}
+
+		// The header checksum is the lower half of the CRC-32 of the preceding header bytes
+		const unsigned short int header_crc = data[pos] | (data[pos + 1] << 8);
+		if (header_crc != (xcomp_crc32(data, pos, 0) & 0xFFFF)) {
+			WARNING_LOG("The gzip header checksum doesn't match: 0x%04X.", header_crc);
+			return -ZLIB_INVALID_GZIP_HEADER;
+		}
+		pos += 2;
+	}
+
+	*header_len = pos;
+
+	return ZLIB_NO_ERROR;
+}
+
+/// Decode each member in turn, appending its data to the output, and checking it against the trailer.
+static int inflate_gzip_members(const unsigned char* data, unsigned int size, ZLIBBuffer* output, unsigned char is_fixed_output) {
+	ZLIBInflateStream* stream = xcomp_calloc(1, sizeof(ZLIBInflateStream));
+	if (stream == NULL) return -ZLIB_IO_ERROR;
+
+	int err = 0;
+	unsigned int in_pos = 0;
+	do {
+		unsigned int header_len = 0;
+		if ((err = read_gzip_header(data + in_pos, size - in_pos, &header_len)) < 0) break;
+		in_pos += header_len;
+
+		const unsigned int member_pos = output -> pos;
+		zlib_inflate_stream_init(stream, FALSE);
+		err = inflate_to_end(stream, data, size, &in_pos, output, is_fixed_output);
+		zlib_inflate_stream_end(stream);
+		if (err < 0) break;
+
+		if (size - in_pos < GZIP_TRAILER_SIZE) {
+			WARNING_LOG("Truncated gzip trailer.");
+			err = -ZLIB_IO_ERROR;
+			break;
+		}
+
+		const unsigned int member_len = output -> pos - member_pos;
+		const unsigned int crc = gzip_read_le32(data + in_pos);
+		const unsigned int isize = gzip_read_le32(data + in_pos + 4);
+		in_pos += GZIP_TRAILER_SIZE;
+
+		// ISIZE holds the length modulo 2^32, as does member_len
+		if (isize != member_len) {
+			WARNING_LOG("The gzip member length doesn't match: %u != %u.", isize, member_len);
+			err = -ZLIB_INVALID_GZIP_LENGTH;
+			break;
+		} else if (xcomp_crc32(output -> data + member_pos, member_len, 0) != crc) {
+			WARNING_LOG("The gzip member checksum doesn't match: 0x%08X.", crc);
+			err = -ZLIB_INVALID_CRC32_CHECKSUM;
+			break;
+		}
+	} while (in_pos < size);
+
+	XCOMP_SAFE_FREE(stream);
+
+	return err;
+}
+
+unsigned char* gzip_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zlib_err) {
+	*decompressed_data_length = 0;
+	ZLIBBuffer output = { .data = NULL, .size = WINDOW_SIZE, .pos = 0, .checked_pos = 0 };
+	output.data = (unsigned char*) xcomp_calloc(output.size, sizeof(unsigned char));
+	if (output.data == NULL) {
+		XCOMP_SAFE_FREE(stream);
+		*zlib_err = -ZLIB_IO_ERROR;
+		return ((unsigned char*) "Failed to allocate the decompressed data buffer");
+	}
+
+	*zlib_err = inflate_gzip_members(stream, size, &output, FALSE);
+	XCOMP_SAFE_FREE(stream);
+
+	unsigned char* decompressed_data = finalize_output(&output, decompressed_data_length, zlib_err);
+	if (*zlib_err == -ZLIB_INVALID_GZIP_HEADER || *zlib_err == -ZLIB_INVALID_COMPRESSION_METHOD) return ((unsigned char*) "Invalid GZIP Header");
+	else if (*zlib_err == -ZLIB_INVALID_CRC32_CHECKSUM || *zlib_err == -ZLIB_INVALID_GZIP_LENGTH) return ((unsigned char*) "corrupted compressed data blocks");
+	else if (*zlib_err < 0) return ((unsigned char*) "Failed to decompress data");
+
+	DEBUG_LOG("decompressed_data_length: %u", *decompressed_data_length);
+
+	return decompressed_data;
+}
+
+int gzip_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size) {
+	ZLIBBuffer output = { .data = out, .size = MIN(out_size, 0x7FFFFFFFU), .pos = 0, .checked_pos = 0 };
+	const int err = inflate_gzip_members(stream, size, &output, TRUE);
+	return (err < 0) ? err : (int) output.pos;
+}
+
+unsigned char* gzip_deflate(unsigned char* data_buffer, unsigned int data_buffer_len, unsigned char level, unsigned int* compressed_data_len, int* zlib_err) {
+	*compressed_data_len = 0;
+
+	// No name, no modification time, and an unknown OS, while XFL hints the slowest and fastest levels
+	const unsigned char xfl = (level >= ZLIB_BEST_COMPRESSION) ? 2 : ((level == ZLIB_BEST_SPEED) ? 4 : 0);
+	const unsigned char header[GZIP_HEADER_SIZE] = { GZIP_ID1, GZIP_ID2, GZIP_CM_DEFLATE, 0, 0, 0, 0, 0, xfl, GZIP_OS_UNKNOWN };
+	const unsigned int crc = xcomp_crc32(data_buffer, data_buffer_len, 0);
+	const unsigned char trailer[GZIP_TRAILER_SIZE] = {
+		crc & 0xFF, (crc >> 8) & 0xFF, (crc >> 16) & 0xFF, (crc >> 24) & 0xFF,
+		data_buffer_len & 0xFF, (data_buffer_len >> 8) & 0xFF, (data_buffer_len >> 16) & 0xFF, (data_buffer_len >> 24) & 0xFF
+	};
+
+	DeflateContext ctx = {0};
+	if ((*zlib_err = init_deflate_context(&ctx, level)) < 0) {
+		XCOMP_SAFE_FREE(data_buffer);
+		return ((unsigned char*) "An error occurred while initializing the deflate context.\n");
+	}
+
+	BitStream compressed_bit_stream = CREATE_BIT_STREAM(NULL, 0);
+	bitstream_write_bytes(&compressed_bit_stream, sizeof(unsigned char), GZIP_HEADER_SIZE, header);
+	if (compressed_bit_stream.error || (*zlib_err = deflate_blocks(&ctx, &compressed_bit_stream, data_buffer, data_buffer_len, NULL)) < 0) {
+		if (compressed_bit_stream.error) *zlib_err = -ZLIB_IO_ERROR;
+		deallocate_deflate_context(&ctx);
+		XCOMP_SAFE_FREE(data_buffer);
+		deallocate_bit_stream(&compressed_bit_stream);
+		return ((unsigned char*) "An error occurred while compressing the block.\n");
+	}
+
+	deallocate_deflate_context(&ctx);
+	XCOMP_SAFE_FREE(data_buffer);
+
+	// The trailer starts at the byte boundary following the last block
+	bitstream_write_bytes(&compressed_bit_stream, sizeof(unsigned char), GZIP_TRAILER_SIZE, trailer);
+	if (compressed_bit_stream.error) {
+		deallocate_bit_stream(&compressed_bit_stream);
+		*zlib_err = -ZLIB_IO_ERROR;
+		return ((unsigned char*) "An error occurred while writing the gzip trailer.\n");
+	}
+
+	*zlib_err = ZLIB_NO_ERROR;
+	*compressed_data_len = compressed_bit_stream.size;
+	return compressed_bit_stream.stream;
+}
+
+#endif //_ZLIB_GZIP_H_
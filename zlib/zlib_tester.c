@@ -59,7 +59,11 @@ int main(int argc, char* argv[]) {
 
 	int err = 0;
 	unsigned int zlib_decompressed_data_length = 0;
-	unsigned char* zlib_decompressed_data = zlib_inflate((unsigned char*) test_data, file_size, &zlib_decompressed_data_length, &err);
+	// Tell the gzip streams apart from the zlib ones by their magic
+	const unsigned char is_gzip = (file_size >= 2) && (test_data[0] == GZIP_ID1) && (test_data[1] == GZIP_ID2);
+	unsigned char* zlib_decompressed_data = NULL;
+	if (is_gzip) zlib_decompressed_data = gzip_inflate((unsigned char*) test_data, file_size, &zlib_decompressed_data_length, &err);
+	else zlib_decompressed_data = zlib_inflate((unsigned char*) test_data, file_size, &zlib_decompressed_data_length, &err);
 	if (err) {
 		printf(COLOR_STR("ZLIB_ERROR::%s: ", RED) "%s\n", zlib_errors_str[-err], zlib_decompressed_data);
 		return err;
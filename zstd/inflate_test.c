@@ -49,6 +49,26 @@ int main(void) {
 
 	DEBUG_LOG("ZSTD decompressed data: '%.*s'\n", zstd_decompressed_data_length, zstd_decompressed_data);
 	
+	// Decode once more into a caller's buffer, first one byte short, then with the exact size
+	unsigned char* into_data = (unsigned char*) xcomp_calloc(zstd_decompressed_data_length, sizeof(unsigned char));
+	if (into_data == NULL) {
+		xcomp_free(zstd_decompressed_data);
+		printf(COLOR_STR("ZSTD_ERROR::%s\n", RED), zstd_errors_str[ZSTD_IO_ERROR]);
+		return 1;
+	}
+
+	const int short_len = zstd_inflate_into(zstd_compressed_data, sizeof(zstd_compressed_data), into_data, zstd_decompressed_data_length - 1);
+	const int into_len = zstd_inflate_into(zstd_compressed_data, sizeof(zstd_compressed_data), into_data, zstd_decompressed_data_length);
+	const int is_into_mismatch = (short_len != -ZSTD_NEED_MORE_OUTPUT) || (into_len != (int) zstd_decompressed_data_length) || mem_n_cmp(into_data, zstd_decompressed_data, zstd_decompressed_data_length);
+	xcomp_free(into_data);
+	if (is_into_mismatch) {
+		printf(COLOR_STR("ZSTD_ERROR::%s: ", RED) "data decoded into the buffer does not match, short: %d, length: %d\n", zstd_errors_str[ZSTD_CORRUPTED_DATA], short_len, into_len);
+		xcomp_free(zstd_decompressed_data);
+		return 1;
+	}
+
+	DEBUG_LOG("ZSTD data decoded into the buffer matches.");
+
 	xcomp_free(zstd_decompressed_data);
 
 	return 0;
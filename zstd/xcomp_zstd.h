@@ -53,6 +53,7 @@ typedef enum PACKED_STRUCT ZstdError {
     ZSTD_UNSUPPORTED_FEATURE,
 	ZSTD_DECOMPRESSED_SIZE_MISMATCH,
 	ZSTD_EXCEEDED_WINDOW_SIZE,
+	ZSTD_NEED_MORE_OUTPUT,
     ZSTD_TODO
 } ZstdError;
 
@@ -70,6 +71,7 @@ static const char* zstd_errors_str[] = {
     "ZSTD_UNSUPPORTED_FEATURE", 
 	"ZSTD_DECOMPRESSED_SIZE_MISMATCH",
 	"ZSTD_EXCEEDED_WINDOW_SIZE",
+	"ZSTD_NEED_MORE_OUTPUT",
     "ZSTD_TODO"
 };
 
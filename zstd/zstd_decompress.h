@@ -42,15 +42,17 @@
 #define UPDATE_HF_STATE(state, hf_literals, hf_table_size, reversed_bit_stream) \
 	state = ((state << (hf_literals)[state].nb_bits) & (hf_table_size - 1)) | reversed_bitstream_read_bits(reversed_bit_stream, (hf_literals)[state].nb_bits)
 
-#define SKIP_PADDING(err, reversed_bit_stream) 																						\
-	do { 																															\
-		unsigned char bit_val = reversed_bitstream_read_next_bit(reversed_bit_stream); 												\
-		if (((reversed_bit_stream) -> bit_pos == 6) && ((reversed_bit_stream) -> byte_pos < (reversed_bit_stream) -> size - 1)) {	\
-			WARNING_LOG("Padding zeros cannot be more than 7.\n");																	\
-			err = -ZSTD_CORRUPTED_DATA;																								\
-			break;																													\
-		} else if (bit_val) break; 																									\
-	} while(TRUE)
+// The last byte holds the padding zeros followed by the set sentinel bit, skip them in one read
+#define SKIP_PADDING(err, reversed_bit_stream) 																			\
+	do { 																												\
+		const unsigned char last_byte = ((reversed_bit_stream) -> size > 0) ? ((reversed_bit_stream) -> stream)[(reversed_bit_stream) -> size - 1] : 0; \
+		if (last_byte == 0) {																							\
+			WARNING_LOG("Padding zeros cannot be more than 7.\n");														\
+			err = -ZSTD_CORRUPTED_DATA;																					\
+			break;																										\
+		}																												\
+		reversed_bitstream_read_bits(reversed_bit_stream, __builtin_clz(last_byte) - 23);								\
+	} while(FALSE)
 
 
 /* -------------------------------------------------------------------------------------------------------- */
@@ -162,6 +164,8 @@ typedef struct Workspace {
 	unsigned int* offset_history;
 	unsigned char* frame_buffer;
 	unsigned int frame_buffer_len;
+	unsigned int frame_buffer_capacity;
+	unsigned char is_fixed_frame_buffer;
 	SequenceSection sequence_section;
 	ZSTDHfEntry* hf_literals;
 	unsigned char table_log;
@@ -181,6 +185,8 @@ static unsigned char highest_bit(unsigned long long int val);
 static void print_fhd(FrameHeaderDescriptor fhd);
 static void deallocate_workspace(Workspace* workspace);
 static void deallocate_sequence_section(SequenceSection* sequence_section);
+static int reserve_frame_buffer(Workspace* workspace, unsigned int length);
+static int check_frame_buffer_space(const Workspace* workspace, unsigned int length);
 static int calc_baseline_and_numbits(unsigned int num_states_total, unsigned int num_states_symbol, unsigned int state_number, unsigned short int* a, unsigned char* b);
 static int read_probabilities(BitStream* compressed_bit_stream, unsigned char table_log, unsigned char max_symbol, short int** frequencies, unsigned short int* probabilities_cnt);
 static int fse_build_table(unsigned char table_log, short int* frequencies, unsigned short int probabilities_cnt, FSETableEntry** fse_table);
@@ -195,13 +201,19 @@ static unsigned int update_off_history(unsigned int* offset_history, unsigned in
 static int sequence_execution(Workspace* workspace);
 static int decompress_block(BitStream* compressed_bit_stream, Workspace* workspace);
 static int parse_block(BitStream* bit_stream, Workspace* workspace, unsigned int block_maximum_size);
-static int parse_frames(BitStream* bit_stream, unsigned char** decompressed_data, unsigned int* decompressed_data_length);
+static int parse_frames(BitStream* bit_stream, unsigned char** decompressed_data, unsigned int* decompressed_data_length, const unsigned int* fixed_capacity);
 
 /// NOTE: the stream will be always deallocated both in case of failure and success.
 /// 	  Furthermore, the function allocates the returned stream of bytes, so that
 /// 	  once it's on the hand of the caller, it's responsible to manage that memory.
 unsigned char* zstd_inflate(unsigned char* stream, unsigned int size, unsigned int* decompressed_data_length, int* zstd_err);
 
+/// NOTE: the stream is only read, and it's never deallocated: the frames are decoded straight
+/// 	  into the caller's buffer, without any intermediate copy.
+/// 	  Returns the length of the decompressed data, -ZSTD_NEED_MORE_OUTPUT if it doesn't
+/// 	  fit in out_size bytes, or another negative ZstdError on failure.
+int zstd_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size);
+
 /* ---------------------------------------------------------------------------------------------------------- */
 
 // ---------------------------
@@ -225,7 +237,7 @@ static void print_fhd(FrameHeaderDescriptor fhd) {
 }
 
 static void deallocate_workspace(Workspace* workspace) {
-	XCOMP_SAFE_FREE(workspace -> frame_buffer);
+	if (!(workspace -> is_fixed_frame_buffer)) XCOMP_SAFE_FREE(workspace -> frame_buffer);
 	XCOMP_SAFE_FREE(workspace -> sequence_section.ll_fse_table);
 	XCOMP_SAFE_FREE(workspace -> sequence_section.ml_fse_table);
 	XCOMP_SAFE_FREE(workspace -> sequence_section.ol_fse_table);
@@ -242,6 +254,40 @@ static void deallocate_sequence_section(SequenceSection* sequence_section) {
 	return;
 }
 
+/// Makes room for length more bytes in the frame buffer, growing it geometrically,
+/// unless the buffer belongs to the caller, in which case it can only fail.
+static int reserve_frame_buffer(Workspace* workspace, unsigned int length) {
+	unsigned long long int required = (unsigned long long int) workspace -> frame_buffer_len + length;
+	if (required <= workspace -> frame_buffer_capacity) return ZSTD_NO_ERROR;
+	
+	if (workspace -> is_fixed_frame_buffer) {
+		WARNING_LOG("The output buffer is too small: %llu > %u.\n", required, workspace -> frame_buffer_capacity);
+		return -ZSTD_NEED_MORE_OUTPUT;
+	} else if (required > 0xFFFFFFFFULL) {
+		WARNING_LOG("The frame exceeds the maximum supported size.\n");
+		return -ZSTD_IO_ERROR;
+	}
+
+	unsigned long long int capacity = MAX(required, (unsigned long long int) workspace -> frame_buffer_capacity * 2);
+	capacity = MIN(capacity, 0xFFFFFFFFULL);
+	workspace -> frame_buffer = (unsigned char*) xcomp_realloc(workspace -> frame_buffer, capacity * sizeof(unsigned char));
+	if (workspace -> frame_buffer == NULL) {
+		WARNING_LOG("Failed to xcomp_reallocate frame buffer.\n");
+		return -ZSTD_IO_ERROR;
+	}
+	workspace -> frame_buffer_capacity = capacity;
+
+	return ZSTD_NO_ERROR;
+}
+
+/// Checks that length more bytes fit in the space already reserved for the frame.
+static int check_frame_buffer_space(const Workspace* workspace, unsigned int length) {
+	if ((unsigned long long int) workspace -> frame_buffer_len + length <= workspace -> frame_buffer_capacity) return ZSTD_NO_ERROR;
+	if (workspace -> is_fixed_frame_buffer) return -ZSTD_NEED_MORE_OUTPUT;
+	WARNING_LOG("The decoded block exceeds the block maximum size.\n");
+	return -ZSTD_CORRUPTED_DATA;
+}
+
 // ---------------------------------------
 //  Literals Parsing and Decoding Section
 // ---------------------------------------
@@ -300,12 +346,16 @@ static int read_probabilities(BitStream* compressed_bit_stream, unsigned char ta
 		unsigned short int max = (1 << (nb_bits - 1)) - 1;
 		unsigned short int low_threshold = ((1 << nb_bits) - 1) - remaining;
 
-		short int value = bitstream_read_bits(compressed_bit_stream, nb_bits);
+		// Peek the larger field, and consume one bit less if the value fits in the smaller one
+		short int value = bitstream_peek_bits(compressed_bit_stream, nb_bits);
 		short int small_count = value & max;
 		if (small_count < low_threshold) {
-			bitstream_unread_bit(compressed_bit_stream);
+			bitstream_consume_bits(compressed_bit_stream, nb_bits - 1);
 			value = small_count;
-		} else if (value > max) value -= low_threshold;
+		} else {
+			bitstream_consume_bits(compressed_bit_stream, nb_bits);
+			if (value > max) value -= low_threshold;
+		}
 
 		value--; // Prediction = value - 1
 		if (value < -1 || remaining <= 1) {
@@ -926,7 +976,9 @@ static unsigned int update_off_history(unsigned int* offset_history, unsigned in
 }
 
 static int sequence_execution(Workspace* workspace) {
+	int err = 0;
 	if (workspace -> sequence_len == 0) {
+		if ((err = check_frame_buffer_space(workspace, workspace -> literals_cnt)) < 0) return err;
 		mem_cpy(workspace -> frame_buffer + workspace -> frame_buffer_len, workspace -> literals, workspace -> literals_cnt);
 		workspace -> frame_buffer_len += workspace -> literals_cnt;
 		return ZSTD_NO_ERROR;
@@ -949,6 +1001,7 @@ static int sequence_execution(Workspace* workspace) {
 				WARNING_LOG("Literals length value makes index out of range (%u > %u).\n", (sequence.ll_value + literals_ind), workspace -> literals_cnt);
 				return -ZSTD_CORRUPTED_DATA;
 			}
+			if ((err = check_frame_buffer_space(workspace, sequence.ll_value)) < 0) return err;
 			mem_cpy(workspace -> frame_buffer + workspace -> frame_buffer_len, workspace -> literals + literals_ind, sequence.ll_value);
 			literals_ind += sequence.ll_value;
 			workspace -> frame_buffer_len += sequence.ll_value;
@@ -968,12 +1021,14 @@ static int sequence_execution(Workspace* workspace) {
 				WARNING_LOG("Offset makes negative index into literals: %ld.\n", ((long int) current_pos - offset));
 				return -ZSTD_CORRUPTED_DATA;
 			}
+			if ((err = check_frame_buffer_space(workspace, sequence.ml_value)) < 0) return err;
 			for (unsigned int i = 0; i < sequence.ml_value; ++i) (workspace -> frame_buffer)[(workspace -> frame_buffer_len)++] = (workspace -> frame_buffer)[current_pos + i - offset];
 			sequence_cnt += sequence.ml_value;
 		}
 	}
 	
 	if (literals_ind < workspace -> literals_cnt) {
+		if ((err = check_frame_buffer_space(workspace, workspace -> literals_cnt - literals_ind)) < 0) return err;
 		mem_cpy(workspace -> frame_buffer + workspace -> frame_buffer_len, workspace -> literals + literals_ind, workspace -> literals_cnt - literals_ind);
 		workspace -> frame_buffer_len += workspace -> literals_cnt - literals_ind;
 		sequence_cnt += workspace -> literals_cnt - literals_ind;
@@ -1020,55 +1075,36 @@ static int parse_block(BitStream* bit_stream, Workspace* workspace, unsigned int
 	
 	if (block_header.block_type == RESERVED_TYPE) return -ZSTD_RESERVED;
 	
+	int err = 0;
 	if (block_header.block_type == RAW_BLOCK) {
-		if (workspace -> frame_buffer_len + block_header.block_size) {
-			workspace -> frame_buffer = (unsigned char*) xcomp_realloc(workspace -> frame_buffer, (workspace -> frame_buffer_len + block_header.block_size) * sizeof(unsigned char));
-			if (workspace -> frame_buffer == NULL) {
-				WARNING_LOG("Failed to xcomp_reallocate frame buffer.\n");
-				return -ZSTD_IO_ERROR;
-			}
-
+		if (block_header.block_size) {
+			if ((err = reserve_frame_buffer(workspace, block_header.block_size)) < 0) return err;
 			unsigned char* raw_block_data = SAFE_BYTE_READ(bit_stream, sizeof(unsigned char), block_header.block_size, raw_block_data);
 			mem_cpy(workspace -> frame_buffer + workspace -> frame_buffer_len, raw_block_data, block_header.block_size * sizeof(unsigned char));
 			workspace -> frame_buffer_len += block_header.block_size;
 		}
 	} else if (block_header.block_type == RLE_BLOCK) {
-		workspace -> frame_buffer = (unsigned char*) xcomp_realloc(workspace -> frame_buffer, (workspace -> frame_buffer_len + block_header.block_size) * sizeof(unsigned char));
-		if (workspace -> frame_buffer == NULL) {
-			WARNING_LOG("Failed to xcomp_reallocate frame buffer.\n");
-			return -ZSTD_IO_ERROR;
-		}
-		
+		if ((err = reserve_frame_buffer(workspace, block_header.block_size)) < 0) return err;
 		unsigned char rle_val = SAFE_BYTE_READ_WITH_CAST(bit_stream, sizeof(unsigned char), 1, unsigned char, rle_val, 0);
 		mem_set(workspace -> frame_buffer + workspace -> frame_buffer_len, rle_val, block_header.block_size * sizeof(unsigned char));
 		workspace -> frame_buffer_len += block_header.block_size;
 	} else {
-		workspace -> frame_buffer = (unsigned char*) xcomp_realloc(workspace -> frame_buffer, (workspace -> frame_buffer_len + block_maximum_size) * sizeof(unsigned char));
-		if (workspace -> frame_buffer == NULL) {
-			WARNING_LOG("Failed to xcomp_reallocate frame buffer.\n");
-			return -ZSTD_IO_ERROR;
-		}
-		
+		// A caller's buffer is never reserved upfront, as the sequence execution checks each copy against its capacity
+		if (!(workspace -> is_fixed_frame_buffer) && (err = reserve_frame_buffer(workspace, block_maximum_size)) < 0) return err;
 		unsigned char* compressed_stream = SAFE_BYTE_READ(bit_stream, sizeof(unsigned char), block_header.block_size, compressed_stream);
 		BitStream compressed_bit_stream = CREATE_BIT_STREAM(compressed_stream, block_header.block_size);
-		int err = 0;
 		if ((err = decompress_block(&compressed_bit_stream, workspace)) < 0) {
-			XCOMP_SAFE_FREE(workspace -> frame_buffer);
 			WARNING_LOG("An error occurred while decompressing the block.\n");
 			return err;
 		}
-
-		workspace -> frame_buffer = (unsigned char*) xcomp_realloc(workspace -> frame_buffer, workspace -> frame_buffer_len * sizeof(unsigned char));
-		if (workspace -> frame_buffer == NULL && workspace -> frame_buffer_len != 0) {
-			WARNING_LOG("Failed to xcomp_reallocate frame buffer.\n");
-			return -ZSTD_IO_ERROR;
-		}
 	}
 
 	return block_header.last_block; // Return the information to the frame parser
 }	
 
-static int parse_frames(BitStream* bit_stream, unsigned char** decompressed_data, unsigned int* decompressed_data_length) {
+/// When fixed_capacity is not NULL, *decompressed_data is the caller's buffer of that capacity,
+/// and the frame is decoded in place right after the *decompressed_data_length bytes already there.
+static int parse_frames(BitStream* bit_stream, unsigned char** decompressed_data, unsigned int* decompressed_data_length, const unsigned int* fixed_capacity) {
 	unsigned int magic = SAFE_BYTE_READ_WITH_CAST(bit_stream, sizeof(unsigned int), 1, unsigned int, magic, 0);
 	DEBUG_LOG("magic: 0x%X\n", magic);
 	
@@ -1133,6 +1169,11 @@ static int parse_frames(BitStream* bit_stream, unsigned char** decompressed_data
 	unsigned int offset_history[] = {1, 4, 8};
 	Workspace workspace = {0};
 	workspace.offset_history = offset_history;
+	if (fixed_capacity != NULL) {
+		workspace.frame_buffer = *decompressed_data + *decompressed_data_length;
+		workspace.frame_buffer_capacity = *fixed_capacity - *decompressed_data_length;
+		workspace.is_fixed_frame_buffer = TRUE;
+	}
 
 	int err = 0;
 	unsigned int blocks_cnt = 0;
@@ -1159,7 +1200,20 @@ static int parse_frames(BitStream* bit_stream, unsigned char** decompressed_data
 		}
 	}
 	
-	if (workspace.frame_buffer_len) {
+	if (workspace.is_fixed_frame_buffer) {
+		*decompressed_data_length += workspace.frame_buffer_len;
+	} else if (workspace.frame_buffer_len && *decompressed_data_length == 0) {
+		// The first frame hands over its buffer, rather than being copied
+		XCOMP_SAFE_FREE(*decompressed_data);
+		*decompressed_data = (unsigned char*) xcomp_realloc(workspace.frame_buffer, workspace.frame_buffer_len * sizeof(unsigned char));
+		if (*decompressed_data == NULL) {
+			deallocate_workspace(&workspace);
+			WARNING_LOG("Failed to xcomp_reallocate the decompressed data buffer.\n");
+			return -ZSTD_IO_ERROR;
+		}
+		workspace.frame_buffer = NULL;
+		*decompressed_data_length = workspace.frame_buffer_len;
+	} else if (workspace.frame_buffer_len) {
 		*decompressed_data = (unsigned char*) xcomp_realloc(*decompressed_data, (*decompressed_data_length + workspace.frame_buffer_len) * sizeof(unsigned char));
 		if (*decompressed_data == NULL) {
 			deallocate_workspace(&workspace);
@@ -1192,7 +1246,7 @@ unsigned char* zstd_inflate(unsigned char* stream, unsigned int size, unsigned i
 	*decompressed_data_length = 0;
 	do {
 		DEBUG_LOG("Parsing frame num %u:\n", frames_cnt);
-		if ((*zstd_err = parse_frames(&bit_stream, &decompressed_data, decompressed_data_length))) {
+		if ((*zstd_err = parse_frames(&bit_stream, &decompressed_data, decompressed_data_length, NULL))) {
 			XCOMP_MULTI_FREE(stream, decompressed_data);
 			return ((unsigned char*) "An error occurred while parsing the frame.\n");
 		}
@@ -1210,4 +1264,20 @@ unsigned char* zstd_inflate(unsigned char* stream, unsigned int size, unsigned i
 	return decompressed_data;
 }
 
+int zstd_inflate_into(const unsigned char* stream, unsigned int size, unsigned char* out, unsigned int out_size) {
+	if (out_size > 0x7FFFFFFF) out_size = 0x7FFFFFFF;
+	
+	int err = 0;
+	unsigned int frames_cnt = 0;
+	unsigned int decompressed_data_length = 0;
+	BitStream bit_stream = CREATE_BIT_STREAM((unsigned char*) stream, size);
+	do {
+		DEBUG_LOG("Parsing frame num %u:\n", frames_cnt);
+		if ((err = parse_frames(&bit_stream, &out, &decompressed_data_length, &out_size))) return err;
+		frames_cnt++;
+	} while (!IS_EOS(&bit_stream) && !bit_stream.error);
+	
+	return decompressed_data_length;
+}
+
 #endif //_ZSTD_DECOMPRESS_H_